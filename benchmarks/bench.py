@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+# Times the benchmark programs in this directory under each execution engine of
+# run_tests.py: the interpreter, lli and a native build. Each program is a template
+# whose ${n} is replaced by its size, --size NAME=N or the default below. It is built
+# once per engine, run --warmups times untimed, then --repetitions times, the engines
+# taking turns so that a drift in the machine's speed falls on all of them alike.
+# Every run must print the same as the first, or the benchmark is reported as a
+# mismatch.
+#
+# The report gives for each program and engine the median wall time with a
+# distribution-free confidence interval, the speedup over --baseline with a bootstrap
+# interval, and the median peak RSS. The samples and the summary are saved as JSON,
+# in results/ unless --json names another file, so runs can be compared over time.
+#
+# Usage: bench.py [-r N] [-w N] [--engines interp,lli] [--size sieve=N] [--bcc-args ARGS]
+#                 [--baseline ENGINE] [--confidence C] [--json FILE] [names]
+# The BCC environment variable overrides the compiler, src/bcc by default.
+
+import argparse
+import datetime
+import json
+import math
+import os
+import platform
+import random
+import shlex
+import shutil
+import subprocess
+import sys
+import tempfile
+
+BENCHMARKS = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(os.path.dirname(BENCHMARKS), 'test-units'))
+import run_tests
+from run_tests import BCC, RUNTIME, measure
+
+# Default sizes, each taking a second or so in the interpreter
+SIZES = {
+	'sieve': 400000,
+	'bubblesort': 1200,
+	'selectionsort': 1500,
+	'nested_loops': 100,
+	'state_machine': 3000,
+	'print_loop': 1000000,
+}
+
+BOOTSTRAP_SAMPLES = 2000
+
+
+class BuildError(Exception):
+	pass
+
+
+def built(command, cwd, timeout):
+	result = measure(command, None, cwd, timeout)
+	if result.code != 0:
+		raise BuildError('%s failed with %s' % (os.path.basename(command[0]), result.transcript().strip() or 'exit %d' % result.code))
+
+
+# The command that runs source under engine, after building what it needs in cwd
+def prepare(engine, source, cwd, bcc_args, timeout):
+	if engine == 'interp':
+		return [BCC, '-q', '--interpret', source]
+	built([BCC, '-q'] + bcc_args + [source], cwd, timeout)
+	if engine == 'lli':
+		command = ['lli', source + '.ll']
+		library = os.path.join(RUNTIME, 'libflatbrt.so')
+		if os.path.exists(library):
+			command[1:1] = ['-load=' + library]
+		return command
+	built(['llc', '-filetype=obj', '-relocation-model=pic', source + '.ll', '-o', source + '.o'], cwd, timeout)
+	built([run_tests.linker(), source + '.o', os.path.join(RUNTIME, 'libflatbrt.a'), '-lpthread', '-o', source + '.out'], cwd, timeout)
+	return [os.path.join(cwd, source + '.out')]
+
+
+def median(values):
+	ordered = sorted(values)
+	middle = len(ordered) // 2
+	return ordered[middle] if len(ordered) % 2 else (ordered[middle - 1] + ordered[middle]) / 2
+
+
+# The interval between order statistics that holds the median with the given
+# confidence, from the binomial distribution; too few samples give the whole range
+def median_interval(values, confidence):
+	ordered = sorted(values)
+	n = len(ordered)
+	below, k = 0.0, 0
+	while k < n and below + math.comb(n, k) / 2 ** n <= (1 - confidence) / 2:
+		below += math.comb(n, k) / 2 ** n
+		k += 1
+	if k == 0:
+		return ordered[0], ordered[-1]
+	return ordered[k - 1], ordered[n - k]
+
+
+# Ratio of the medians of base and other, with a percentile bootstrap interval
+def speedup(base, other, confidence, rng):
+	ratios = sorted(median(rng.choices(base, k=len(base))) / median(rng.choices(other, k=len(other)))
+					for _ in range(BOOTSTRAP_SAMPLES))
+	tail = int(BOOTSTRAP_SAMPLES * (1 - confidence) / 2)
+	return median(base) / median(other), (ratios[tail], ratios[-tail - 1])
+
+
+def benchmark(name, size, engines, args):
+	with open(os.path.join(BENCHMARKS, name + '.b')) as f:
+		text = f.read().replace('${n}', str(size))
+	samples = {engine: [] for engine in engines}
+	problems = {}
+	with tempfile.TemporaryDirectory(prefix='flatb-bench-') as cwd:
+		source = name + '.b'
+		with open(os.path.join(cwd, source), 'w') as f:
+			f.write(text)
+		commands = {}
+		for engine in engines:
+			try:
+				commands[engine] = prepare(engine, source, cwd, shlex.split(args.bcc_args), args.timeout)
+			except BuildError as error:
+				problems[engine] = str(error)
+
+		expected = None
+		for repetition in range(args.warmups + args.repetitions):
+			for engine, command in commands.items():
+				if engine in problems:
+					continue
+				result = measure(command, None, cwd, args.timeout, digest=True)
+				if expected is None:
+					expected = result.transcript()
+				if result.transcript() != expected:
+					problems[engine] = 'output differs from %s' % next(iter(commands))
+				elif repetition >= args.warmups:
+					samples[engine].append(result)
+	return samples, problems
+
+
+def summarise(name, size, samples, problems, args, rng):
+	rows = []
+	base = [result.wall for result in samples.get(args.baseline, [])]
+	for engine, results in samples.items():
+		row = {'benchmark': name, 'size': size, 'engine': engine}
+		if engine in problems or not results:
+			row['error'] = problems.get(engine, 'no runs')
+			rows.append(row)
+			continue
+		walls = [result.wall for result in results]
+		row.update({
+			'wall': walls,
+			'user': [result.user for result in results],
+			'rss': [result.rss for result in results],
+			'median': median(walls),
+			'interval': median_interval(walls, args.confidence),
+			'rss_median': median([result.rss for result in results]),
+		})
+		if base and args.baseline not in problems:
+			row['speedup'], row['speedup_interval'] = speedup(base, walls, args.confidence, rng)
+		rows.append(row)
+	return rows
+
+
+def table(rows, args):
+	level = '%g%%' % (args.confidence * 100)
+	header = ('Benchmark', 'Size', 'Engine', 'Median (s)', level + ' CI (s)', 'Speedup vs ' + args.baseline, level + ' CI', 'Peak RSS (KB)')
+	lines = ['| ' + ' | '.join(header) + ' |', '|' + '|'.join('---' for _ in header) + '|']
+	for row in rows:
+		columns = [row['benchmark'], '%d' % row['size'], row['engine']]
+		if 'error' in row:
+			columns += [row['error']] + ['-'] * 4
+		else:
+			columns += ['%.4f' % row['median'], '%.4f - %.4f' % tuple(row['interval'])]
+			if 'speedup' in row:
+				columns += ['%.2fx' % row['speedup'], '%.2f - %.2fx' % tuple(row['speedup_interval'])]
+			else:
+				columns += ['-', '-']
+			columns.append('%d' % row['rss_median'])
+		lines.append('| ' + ' | '.join(columns) + ' |')
+	return '\n'.join(lines) + '\n'
+
+
+def commit():
+	try:
+		return subprocess.run(['git', 'rev-parse', '--short', 'HEAD'], cwd=BENCHMARKS, capture_output=True,
+								text=True, check=True).stdout.strip()
+	except (OSError, subprocess.CalledProcessError):
+		return None
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Time the benchmark programs under every engine.')
+	parser.add_argument('names', nargs='*', help='benchmarks to run (default: all)')
+	parser.add_argument('-r', '--repetitions', type=int, default=10, help='timed runs of each program and engine')
+	parser.add_argument('-w', '--warmups', type=int, default=1, help='untimed runs before them')
+	parser.add_argument('--engines', default=','.join(run_tests.ENGINES), help='comma separated engines')
+	parser.add_argument('--size', action='append', default=[], metavar='NAME=N', help='size of a benchmark')
+	parser.add_argument('--bcc-args', default='', help='more arguments for bcc when compiling, such as -O')
+	parser.add_argument('--baseline', default='interp', help='engine the speedups are measured against')
+	parser.add_argument('--confidence', type=float, default=0.95, help='confidence level of the intervals')
+	parser.add_argument('--timeout', type=float, default=600, help='seconds allowed for each run')
+	parser.add_argument('--json', help='file for the results (default: results/DATE.json)')
+	args = parser.parse_args()
+
+	sizes = dict(SIZES)
+	for setting in args.size:
+		name, _, size = setting.partition('=')
+		if name not in SIZES or not size.isdigit() or int(size) < 2:
+			parser.error('bad --size %s' % setting)
+		sizes[name] = int(size)
+	names = args.names or list(SIZES)
+	for name in names:
+		if name not in SIZES:
+			parser.error('unknown benchmark ' + name)
+	if args.repetitions < 1:
+		parser.error('--repetitions must be at least 1')
+
+	engines = args.engines.split(',')
+	for engine in list(engines):
+		if engine not in run_tests.ENGINES:
+			parser.error('unknown engine ' + engine)
+		if not run_tests.ENGINES[engine][1]():
+			print('skipping %s: not available' % engine, file=sys.stderr)
+			engines.remove(engine)
+
+	rng = random.Random(0)
+	rows = []
+	for name in names:
+		samples, problems = benchmark(name, sizes[name], engines, args)
+		rows += summarise(name, sizes[name], samples, problems, args, rng)
+		for engine, problem in problems.items():
+			print('%s under %s: %s' % (name, engine, problem), file=sys.stderr)
+	sys.stdout.write(table(rows, args))
+
+	path = args.json
+	if not path:
+		os.makedirs(os.path.join(BENCHMARKS, 'results'), exist_ok=True)
+		path = os.path.join(BENCHMARKS, 'results', datetime.datetime.now().strftime('%Y-%m-%d-%H%M%S.json'))
+	report = {
+		'date': datetime.datetime.now().isoformat(timespec='seconds'),
+		'commit': commit(),
+		'host': {'machine': platform.machine(), 'system': platform.platform(), 'cpus': os.cpu_count(), 'python': platform.python_version()},
+		'settings': {'repetitions': args.repetitions, 'warmups': args.warmups, 'bcc_args': args.bcc_args,
+						'baseline': args.baseline, 'confidence': args.confidence},
+		'results': rows,
+	}
+	with open(path, 'w') as f:
+		json.dump(report, f, indent=1)
+	print('\nresults saved to %s' % os.path.relpath(path))
+	return 1 if any('error' in row for row in rows) else 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,38 @@
+declblock
+{
+	int i, j, n, last, tmp, unsorted;
+	int a[${n}];
+}
+codeblock
+{
+	n = ${n};
+	for i = 0, n - 1, 1
+	{
+		a[i] = (i * 7919) - ((i * 7919) / n) * n;
+	}
+
+	for i = 0, n - 2, 1
+	{
+		last = (n - i) - 2;
+		for j = 0, last, 1
+		{
+			if a[j] > a[j + 1]
+			{
+				tmp = a[j];
+				a[j] = a[j + 1];
+				a[j + 1] = tmp;
+			}
+		}
+	}
+
+	unsorted = 0;
+	for i = 0, n - 2, 1
+	{
+		if a[i] > a[i + 1]
+		{
+			unsorted = unsorted + 1;
+		}
+	}
+	println "unsorted: ", unsorted;
+	println "last: ", a[n - 1];
+}
@@ -0,0 +1,315 @@
+#!/usr/bin/env python3
+# Performance regression gate: runs the benchmarks of bench.py with the sizes,
+# engines and settings of a stored baseline, baseline.json by default, and fails if
+# any program got slower or bigger than the noise allows.
+#
+# Each benchmark has a size of its own under each engine. --update picks them by
+# doubling the default size of bench.py until a run takes at least TARGET / 2
+# seconds, and then scaling it towards TARGET by the growth over the last doubling,
+# so that the compiled engines are timed on runs of about a second and not on their
+# start-up.
+#
+# A benchmark regresses in time when its median is more than --threshold above the
+# baseline's median and a one-sided Mann-Whitney rank test of its runs against the
+# baseline's says they are slower at level --alpha. The rank test looks at every run
+# rather than at the width of an interval, so a consistent slowdown fails even when
+# the runs are noisy, while the threshold keeps tiny but consistent shifts from
+# failing. A suspected time regression is measured again, with as many more runs,
+# and judged on all of them. A benchmark regresses in memory when its median peak
+# RSS grows by more than --memory-threshold and by more than MEMORY_FLOOR. A program
+# whose runs print different things, or that fails to build, fails the gate too, and
+# so does an engine of the baseline that is not available, unless --engines leaves
+# it out.
+#
+# The baseline is a report of bench.py, so any saved run can serve as one; --update
+# replaces it with the run just made. Timings only compare on the same host, and a
+# baseline from another one is reported.
+#
+# Usage: gate.py [--baseline-file FILE] [--engines interp,lli] [--threshold X]
+#                [--alpha P] [--memory-threshold X] [--update] [--json FILE] [names]
+# The BCC environment variable overrides the compiler, src/bcc by default.
+
+import argparse
+import datetime
+import json
+import math
+import os
+import platform
+import random
+import sys
+
+import bench
+
+BASELINE = os.path.join(bench.BENCHMARKS, 'baseline.json')
+
+# Peak RSS changes smaller than this, in KB, are noise whatever the ratio
+MEMORY_FLOOR = 1024
+
+# Seconds a run should take at the sizes --update picks, and how far past the
+# default size of bench.py it may go to get there
+TARGET = 1.0
+MAX_GROWTH = 1024
+
+
+def host():
+	return {'machine': platform.machine(), 'system': platform.platform(), 'cpus': os.cpu_count(), 'python': platform.python_version()}
+
+
+# The settings of bench.py that the baseline was made with
+def settings(baseline, args):
+	stored = baseline.get('settings', {})
+	return argparse.Namespace(
+		repetitions=args.repetitions or stored.get('repetitions', 10),
+		warmups=stored.get('warmups', 1),
+		bcc_args=stored.get('bcc_args', ''),
+		baseline=stored.get('baseline', 'interp'),
+		confidence=stored.get('confidence', 0.95),
+		timeout=args.timeout)
+
+
+# The size at which name takes about TARGET seconds under engine. The default size
+# is doubled until one run takes at least half of that; the time of the last two
+# runs gives the power of the size that the time grows with, at least 1, by which
+# the size is then scaled. A program that slow at the default size keeps it.
+def calibrate(name, engine, settings):
+	probe = argparse.Namespace(**vars(settings))
+	probe.repetitions, probe.warmups = 1, 0
+	size, last = bench.SIZES[name], None
+	while True:
+		samples, problems = bench.benchmark(name, size, [engine], probe)
+		if problems:
+			return size
+		wall = samples[engine][0].wall
+		if wall >= TARGET / 2 or size * 2 > bench.SIZES[name] * MAX_GROWTH:
+			break
+		last = wall
+		size *= 2
+	if last is None or wall < TARGET / 2:
+		return size
+	power = max(1.0, math.log2(wall / last))
+	return max(size // 2, int(size * (TARGET / wall) ** (1 / power)))
+
+
+# The benchmarks run at sizes[(name, engine)]; the engines that share a size take
+# turns, as in bench.py
+def run(names, sizes, engines, settings, rng):
+	rows = []
+	for name in names:
+		groups = {}
+		for engine in engines:
+			groups.setdefault(sizes[(name, engine)], []).append(engine)
+		for size, group in groups.items():
+			samples, problems = bench.benchmark(name, size, group, settings)
+			rows += bench.summarise(name, size, samples, problems, settings, rng)
+			for engine, problem in problems.items():
+				print('%s under %s: %s' % (name, engine, problem), file=sys.stderr)
+	return rows
+
+
+# One-sided p-value of the Mann-Whitney U test that the values of now tend to be
+# larger than those of then, from the normal approximation with a continuity
+# correction and the variance corrected for ties
+def slower(then, now):
+	m, n = len(then), len(now)
+	u = sum(1.0 if b > a else 0.5 if b == a else 0.0 for a in then for b in now)
+	ties = {}
+	for value in then + now:
+		ties[value] = ties.get(value, 0) + 1
+	correction = sum(t ** 3 - t for t in ties.values()) / ((m + n) * (m + n - 1))
+	variance = m * n / 12 * (m + n + 1 - correction)
+	if variance <= 0:
+		return 1.0
+	z = (u - m * n / 2 - 0.5) / math.sqrt(variance)
+	return math.erfc(z / math.sqrt(2)) / 2
+
+
+# The verdict on row against base: a list of (kind, text) where kind is regression,
+# improvement or error
+def compare(base, row, args):
+	if 'error' in row:
+		return [('error', row['error'])]
+	if not base or 'error' in base:
+		return []
+	if row['size'] != base['size']:
+		return [('error', 'size %d differs from the baseline\'s %d' % (row['size'], base['size']))]
+
+	findings = []
+	change = row['median'] / base['median'] - 1
+	if change > args.threshold:
+		p = slower(base['wall'], row['wall'])
+		if p < args.alpha:
+			findings.append(('regression', 'time %.4f s -> %.4f s (%+.1f%%), rank test p = %.2g over %d and %d runs'
+							% (base['median'], row['median'], change * 100, p, len(base['wall']), len(row['wall']))))
+	elif change < -args.threshold and slower(row['wall'], base['wall']) < args.alpha:
+		findings.append(('improvement', 'time %.4f s -> %.4f s (%+.1f%%)' % (base['median'], row['median'], change * 100)))
+
+	growth = row['rss_median'] - base['rss_median']
+	if growth > MEMORY_FLOOR and row['rss_median'] > base['rss_median'] * (1 + args.memory_threshold):
+		findings.append(('regression', 'peak RSS %d KB -> %d KB (%+.1f%%)'
+						% (base['rss_median'], row['rss_median'], growth * 100 / base['rss_median'])))
+	return findings
+
+
+# path relative to the working directory, unless it is outside it
+def shown(path):
+	relative = os.path.relpath(path)
+	return path if relative.startswith('..') else relative
+
+
+def percent(now, then):
+	return '%+.1f%%' % ((now / then - 1) * 100) if then else '-'
+
+
+def table(pairs, verdicts):
+	header = ('Benchmark', 'Engine', 'Size', 'Baseline (s)', 'Now (s)', 'Time', 'Baseline RSS (KB)', 'Now RSS (KB)', 'Memory', 'Verdict')
+	lines = ['| ' + ' | '.join(header) + ' |', '|' + '|'.join('---' for _ in header) + '|']
+	for (base, row), findings in zip(pairs, verdicts):
+		columns = [row['benchmark'], row['engine'], '%d' % row['size']]
+		if 'error' in row or not base or 'error' in base:
+			columns += ['%.4f' % base['median'] if base and 'median' in base else '-',
+						'%.4f' % row['median'] if 'median' in row else '-', '-',
+						'%d' % base['rss_median'] if base and 'rss_median' in base else '-',
+						'%d' % row['rss_median'] if 'rss_median' in row else '-', '-']
+		else:
+			columns += ['%.4f' % base['median'], '%.4f' % row['median'], percent(row['median'], base['median']),
+						'%d' % base['rss_median'], '%d' % row['rss_median'], percent(row['rss_median'], base['rss_median'])]
+		kinds = {kind for kind, _ in findings}
+		if 'error' in kinds:
+			verdict = 'ERROR'
+		elif 'regression' in kinds:
+			verdict = 'REGRESSION'
+		elif not base or 'error' in base:
+			verdict = 'new'
+		elif 'improvement' in kinds:
+			verdict = 'faster'
+		else:
+			verdict = 'ok'
+		columns.append(verdict)
+		lines.append('| ' + ' | '.join(columns) + ' |')
+	return '\n'.join(lines) + '\n'
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Fail when a benchmark is slower or bigger than its baseline.')
+	parser.add_argument('names', nargs='*', help='benchmarks to check (default: all in the baseline)')
+	parser.add_argument('--baseline-file', default=BASELINE, help='baseline report of bench.py (default: baseline.json)')
+	parser.add_argument('--threshold', type=float, default=0.05, help='slowdown of the median allowed whatever the rank test says')
+	parser.add_argument('--alpha', type=float, default=0.01, help='significance level of the rank test')
+	parser.add_argument('--memory-threshold', type=float, default=0.10, help='growth of the peak RSS allowed')
+	parser.add_argument('-r', '--repetitions', type=int, help='timed runs of each program (default: as in the baseline)')
+	parser.add_argument('--timeout', type=float, default=600, help='seconds allowed for each run')
+	parser.add_argument('--engines', help='comma separated engines to check (default: all in the baseline)')
+	parser.add_argument('--update', action='store_true', help='run the benchmarks and make the result the new baseline')
+	parser.add_argument('--json', help='also save this run as a report of bench.py')
+	args = parser.parse_args()
+
+	baseline = {}
+	if os.path.exists(args.baseline_file):
+		with open(args.baseline_file) as f:
+			baseline = json.load(f)
+	elif not args.update:
+		parser.error('no baseline %s; make one with --update' % args.baseline_file)
+
+	stored = {(row['benchmark'], row['engine']): row for row in baseline.get('results', [])}
+	names = args.names or list(dict.fromkeys(name for name, _ in stored)) or list(bench.SIZES)
+	for name in names:
+		if name not in bench.SIZES:
+			parser.error('unknown benchmark ' + name)
+
+	# an engine of the baseline that cannot run fails the gate, unless --engines
+	# leaves it out; a new baseline takes the engines that are available
+	if args.engines:
+		engines = args.engines.split(',')
+		for engine in engines:
+			if engine not in bench.run_tests.ENGINES:
+				parser.error('unknown engine ' + engine)
+	else:
+		engines = list(dict.fromkeys(engine for _, engine in stored)) or list(bench.run_tests.ENGINES)
+	missing = [engine for engine in engines if engine not in bench.run_tests.ENGINES or not bench.run_tests.ENGINES[engine][1]()]
+	if missing and args.update and not args.engines:
+		for engine in missing:
+			print('skipping %s: not available' % engine, file=sys.stderr)
+		engines = [engine for engine in engines if engine not in missing]
+	elif missing:
+		print('%s not available; leave %s out with --engines to check the others'
+				% (', '.join(missing), 'it' if len(missing) == 1 else 'them'), file=sys.stderr)
+		return 1
+	if not engines:
+		parser.error('no engine is available')
+
+	then, now = baseline.get('host', {}), host()
+	if baseline and any(then.get(key) != now[key] for key in ('machine', 'cpus')):
+		print('the baseline was measured on another host (%s, %s cpus); timings may not compare'
+				% (then.get('machine'), then.get('cpus')), file=sys.stderr)
+
+	config = settings(baseline, args)
+	if config.baseline not in engines:
+		config.baseline = engines[0]
+	sizes = {}
+	for name in names:
+		for engine in engines:
+			if args.update:
+				sizes[(name, engine)] = calibrate(name, engine, config)
+			elif (name, engine) in stored:
+				sizes[(name, engine)] = stored[(name, engine)]['size']
+			else:
+				sizes[(name, engine)] = bench.SIZES[name]
+	rng = random.Random(0)
+	rows = run(names, sizes, engines, config, rng)
+
+	report = {
+		'date': datetime.datetime.now().isoformat(timespec='seconds'),
+		'commit': bench.commit(),
+		'host': host(),
+		'settings': {'repetitions': config.repetitions, 'warmups': config.warmups, 'bcc_args': config.bcc_args,
+						'baseline': config.baseline, 'confidence': config.confidence},
+		'results': rows,
+	}
+	if args.update:
+		if any('error' in row for row in rows):
+			print('not updating the baseline: some benchmarks failed', file=sys.stderr)
+			return 1
+		with open(args.baseline_file, 'w') as f:
+			json.dump(report, f, indent=1)
+		print('baseline saved to %s' % shown(args.baseline_file))
+		return 0
+
+	# a suspected time regression is run again, and judged on all its samples
+	for row in rows:
+		base = stored.get((row['benchmark'], row['engine']))
+		if not any(kind == 'regression' and text.startswith('time') for kind, text in compare(base, row, args)):
+			continue
+		print('%s under %s looks slower; measuring again' % (row['benchmark'], row['engine']), file=sys.stderr)
+		samples, problems = bench.benchmark(row['benchmark'], row['size'], [row['engine']], config)
+		if problems:
+			row['error'] = problems[row['engine']]
+			continue
+		walls = row['wall'] + [result.wall for result in samples[row['engine']]]
+		rss = row['rss'] + [result.rss for result in samples[row['engine']]]
+		row.update({'wall': walls, 'rss': rss, 'median': bench.median(walls),
+					'interval': bench.median_interval(walls, config.confidence), 'rss_median': bench.median(rss)})
+
+	pairs = [(stored.get((row['benchmark'], row['engine'])), row) for row in rows]
+	verdicts = [compare(base, row, args) for base, row in pairs]
+	sys.stdout.write(table(pairs, verdicts))
+
+	failures = []
+	failed = 0
+	for (base, row), findings in zip(pairs, verdicts):
+		problems = ['%s %s/%s: %s' % (kind.upper(), row['benchmark'], row['engine'], text) for kind, text in findings if kind != 'improvement']
+		failures += problems
+		failed += bool(problems)
+	if args.json:
+		with open(args.json, 'w') as f:
+			json.dump(report, f, indent=1)
+
+	if failures:
+		print('\n' + '\n'.join(failures))
+		print('\n%d of %d runs failed the gate against %s' % (failed, len(rows), shown(args.baseline_file)))
+		return 1
+	print('\nno regressions against %s (%s)' % (shown(args.baseline_file), baseline.get('commit') or 'unknown commit'))
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,23 @@
+declblock
+{
+	int i, j, k, n, sum, count;
+}
+codeblock
+{
+	n = ${n};
+	sum = 0;
+	count = 0;
+	for i = 1, n, 1
+	{
+		for j = 1, n, 1
+		{
+			for k = 1, n, 1
+			{
+				sum = sum + ((i - j) * k);
+				count = count + 1;
+			}
+		}
+	}
+	println "sum: ", sum;
+	println "iterations: ", count;
+}
@@ -0,0 +1,12 @@
+declblock
+{
+	int i, n;
+}
+codeblock
+{
+	n = ${n};
+	for i = 1, n, 1
+	{
+		println "line ", i;
+	}
+}
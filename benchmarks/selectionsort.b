@@ -0,0 +1,42 @@
+declblock
+{
+	int i, j, n, min, tmp, unsorted;
+	int a[${n}];
+}
+codeblock
+{
+	n = ${n};
+	for i = 0, n - 1, 1
+	{
+		a[i] = (i * 7919) - ((i * 7919) / n) * n;
+	}
+
+	for j = 0, n - 2, 1
+	{
+		min = j;
+		for i = j + 1, n - 1, 1
+		{
+			if a[i] < a[min]
+			{
+				min = i;
+			}
+		}
+		if min != j
+		{
+			tmp = a[j];
+			a[j] = a[min];
+			a[min] = tmp;
+		}
+	}
+
+	unsorted = 0;
+	for i = 0, n - 2, 1
+	{
+		if a[i] > a[i + 1]
+		{
+			unsorted = unsorted + 1;
+		}
+	}
+	println "unsorted: ", unsorted;
+	println "last: ", a[n - 1];
+}
@@ -0,0 +1,33 @@
+declblock
+{
+	int i, n, p, count;
+	int prime[${n}];
+}
+codeblock
+{
+	n = ${n};
+	for i = 0, n - 1, 1
+	{
+		prime[i] = 1;
+	}
+
+	p = 2;
+	while p * p < n
+	{
+		if prime[p] == 1
+		{
+			for i = p * 2, n - 1, p
+			{
+				prime[i] = 0;
+			}
+		}
+		p = p + 1;
+	}
+
+	count = 0;
+	for i = 2, n - 1, 1
+	{
+		count = count + prime[i];
+	}
+	println "primes: ", count;
+}
@@ -0,0 +1,23 @@
+declblock
+{
+	int n, x, y, half, steps;
+}
+codeblock
+{
+	n = ${n};
+	steps = 0;
+	x = 1;
+next:	y = x;
+step:	goto done if y == 1;
+	half = y / 2;
+	goto even if half * 2 == y;
+	y = (3 * y) + 1;
+	steps = steps + 1;
+	goto step;
+even:	y = half;
+	steps = steps + 1;
+	goto step;
+done:	x = x + 1;
+	goto next if x <= n;
+	println "steps: ", steps;
+}
@@ -0,0 +1,321 @@
+#!/usr/bin/env python3
+# Differential fuzzer: runs random programs from generate.py under every engine of
+# run_tests.py, the interpreter, lli and a native build, and reports a program when
+#
+#   mismatch  the engines print different things or exit differently
+#   crash     an engine or bcc dies of a signal
+#   build     bcc, llc or the linker fail on the program, which is well formed
+#   timeout   an engine runs longer than --timeout while another finishes
+#   slow      an engine takes --slowdown times longer, relative to the others, than
+#             it usually does; the usual ratio is the median over the programs so
+#             far, and runs shorter than --min-seconds are not judged
+#
+# A failing program is shrunk: statements are taken out, loops and ifs replaced by
+# their bodies and expressions by their parts, as long as the program keeps failing
+# the same way. The shrunk program, its input and a report go to --failures, with
+# the program as generated next to them.
+#
+# Usage: fuzz.py [-n N] [--seed N] [--statements N] [--depth N] [--engines interp,lli]
+#                [--bcc-args ARGS] [--timeout S] [--slowdown X] [--no-shrink] [--failures DIR]
+# The BCC environment variable overrides the compiler, src/bcc by default.
+
+import argparse
+import difflib
+import os
+import re
+import shlex
+import sys
+import tempfile
+
+import generate
+
+FUZZ = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(os.path.dirname(FUZZ), 'benchmarks'))
+import bench
+import run_tests
+from run_tests import measure
+
+# Programs that must be judged before the usual speed of an engine is known
+CALIBRATION = 5
+
+
+class Outcome:
+	def __init__(self, kind, detail, results):
+		self.kind = kind			# None when the engines agree
+		self.detail = detail
+		self.results = results		# engine: run_tests.Result, or the BuildError text
+
+	def same(self, other):
+		return other.kind == self.kind and other.detail.split(':')[0] == self.detail.split(':')[0]
+
+
+def run_engines(text, input, engines, args):
+	results = {}
+	with tempfile.TemporaryDirectory(prefix='flatb-fuzz-') as cwd:
+		source = 'fuzz.b'
+		with open(os.path.join(cwd, source), 'w') as f:
+			f.write(text)
+		with open(os.path.join(cwd, 'fuzz.in'), 'w') as f:
+			f.write(input)
+		for engine in engines:
+			try:
+				command = bench.prepare(engine, source, cwd, shlex.split(args.bcc_args), args.timeout)
+			except bench.BuildError as error:
+				results[engine] = str(error)
+				continue
+			results[engine] = measure(command, os.path.join(cwd, 'fuzz.in'), cwd, args.timeout)
+	return results
+
+
+# What is wrong with the results, if anything; ratios holds for each engine the
+# ratios of its time to the fastest engine's in the programs so far
+def judge(results, args, ratios):
+	for engine, result in results.items():
+		if isinstance(result, str):
+			status = re.search(r'\[exit (\d+)\]', result)
+			kind = 'crash' if status and int(status.group(1)) > 128 else 'build'
+			return Outcome(kind, '%s: %s' % (engine, result.strip()), results)
+
+	for engine, result in results.items():
+		if result.wall >= args.timeout:
+			if all(other.wall < args.timeout for other in results.values() if other is not result):
+				return Outcome('timeout', '%s: over %g s' % (engine, args.timeout), results)
+			return None
+		if result.code > 128:
+			return Outcome('crash', '%s: signal %d' % (engine, result.code - 128), results)
+
+	engines = list(results)
+	first = results[engines[0]].transcript()
+	for engine in engines[1:]:
+		if results[engine].transcript() != first:
+			return Outcome('mismatch', '%s, %s: outputs differ' % (engines[0], engine), results)
+
+	fastest = min(result.wall for result in results.values())
+	for engine, result in results.items():
+		ratio = result.wall / max(fastest, 1e-3)
+		usual = sorted(ratios[engine])[len(ratios[engine]) // 2] if len(ratios[engine]) >= CALIBRATION else None
+		ratios[engine].append(ratio)
+		if usual and result.wall >= args.min_seconds and ratio > usual * args.slowdown:
+			return Outcome('slow', '%s: %.1fx the fastest engine, usually %.1fx' % (engine, ratio, usual), results)
+	return Outcome(None, '', results)
+
+
+# Programs one step simpler than statements, simplest first
+def smaller(statements):
+	for i, statement in enumerate(statements):
+		yield statements[:i] + statements[i + 1:]
+	for i, statement in enumerate(statements):
+		rest_before, rest_after = statements[:i], statements[i + 1:]
+		for replacement in simpler(statement):
+			yield rest_before + replacement + rest_after
+
+
+# Lists of statements that can stand for statement
+def simpler(statement):
+	if statement.kind in ('if', 'while', 'repeat', 'skip'):
+		yield [s.copy() for s in statement.body]
+		if statement.kind == 'if' and statement.orelse:
+			yield [s.copy() for s in statement.orelse]
+	if statement.kind == 'for':
+		# the iterator keeps its first value, which is in bounds wherever it indexes
+		yield [substitute(s, statement.iterator, statement.lo) for s in statement.body]
+		for flag in ('stretch', 'clobber'):
+			if getattr(statement, flag):
+				other = statement.copy()
+				setattr(other, flag, False)
+				yield [other]
+		if statement.step is not None:
+			other = statement.copy()
+			other.step = None
+			yield [other]
+	for field in ('body', 'orelse'):
+		for body in smaller(getattr(statement, field)):
+			other = statement.copy()
+			setattr(other, field, body)
+			yield [other]
+	for field in ('value', 'condition'):
+		current = getattr(statement, field, None)
+		if current is None:
+			continue
+		if field == 'condition':
+			negated, op, left, right = current
+			options = [(False, op, left, right)] if negated else []
+			options += [(negated, op, expr, right) for expr in simpler_expression(left)]
+			options += [(negated, op, left, expr) for expr in simpler_expression(right)]
+			if statement.kind == 'skip':
+				options.append(None)
+		else:
+			options = list(simpler_expression(current))
+			if statement.kind == 'print' and statement.text:
+				options.append(None)
+		for option in options:
+			other = statement.copy()
+			setattr(other, field, option)
+			yield [other]
+
+
+def simpler_expression(expr):
+	kind = expr[0]
+	if kind == 'num':
+		if expr[1] not in (0, 1):
+			yield ('num', 0)
+			yield ('num', 1)
+		return
+	yield ('num', 0)
+	if kind == 'neg':
+		yield ('var', expr[1])
+	elif kind == 'elem' and expr[2] != ('num', 0):
+		yield (kind, expr[1], ('num', 0))
+	elif kind == 'bin':
+		yield expr[2]
+		if expr[1] != '/':
+			yield expr[3]
+		else:
+			yield (kind, expr[1], expr[2], ('num', 2))
+		for left in simpler_expression(expr[2]):
+			yield (kind, expr[1], left, expr[3])
+		if expr[1] != '/':
+			for right in simpler_expression(expr[3]):
+				yield (kind, expr[1], expr[2], right)
+	elif kind == 'builtin':
+		for arg in expr[3]:
+			if arg[0] not in ('num', 'iter'):
+				yield arg
+
+
+def substitute_expression(expr, name, value):
+	kind = expr[0]
+	if kind == 'iter' and expr[1] == name:
+		return ('num', value + expr[2])
+	if kind in ('var', 'neg') and expr[1] == name:
+		return ('num', value if kind == 'var' else -value)
+	if kind == 'elem':
+		return (kind, expr[1], substitute_expression(expr[2], name, value))
+	if kind == 'bin':
+		return (kind, expr[1], substitute_expression(expr[2], name, value), substitute_expression(expr[3], name, value))
+	if kind == 'builtin':
+		return (kind, expr[1], expr[2], [substitute_expression(arg, name, value) for arg in expr[3]])
+	return expr
+
+
+def substitute(statement, name, value):
+	other = statement.copy()
+	for field in ('target', 'value', 'lo', 'hi'):
+		current = getattr(other, field, None)
+		if isinstance(current, tuple):
+			setattr(other, field, substitute_expression(current, name, value))
+	if getattr(other, 'condition', None):
+		negated, op, left, right = other.condition
+		other.condition = (negated, op, substitute_expression(left, name, value), substitute_expression(right, name, value))
+	other.body = [substitute(s, name, value) for s in other.body]
+	other.orelse = [substitute(s, name, value) for s in other.orelse]
+	return other
+
+
+def size(statements):
+	return sum(1 + size(s.body) + size(s.orelse) for s in statements)
+
+
+# Greedily takes the first simpler program that still fails like outcome, until
+# none does or --shrink-runs programs have been tried
+def shrink(array_size, statements, input, outcome, engines, args, ratios):
+	tries = 0
+	progress = True
+	while progress and tries < args.shrink_runs:
+		progress = False
+		for candidate in smaller(statements):
+			if tries >= args.shrink_runs:
+				break
+			tries += 1
+			text = generate.render(array_size, candidate)
+			result = judge(run_engines(text, input, engines, args), args, {engine: list(ratios[engine]) for engine in engines})
+			if result and result.same(outcome):
+				statements, outcome = candidate, result
+				progress = True
+				break
+	return statements, outcome
+
+
+def transcript(result):
+	return result if isinstance(result, str) else result.transcript()
+
+
+def report(name, text, outcome):
+	lines = ['%s: %s %s' % (name, outcome.kind, outcome.detail), '']
+	engines = list(outcome.results)
+	for engine in engines:
+		result = outcome.results[engine]
+		timing = '' if isinstance(result, str) else ' (%.3f s, exit %d)' % (result.wall, result.code)
+		lines.append('%s%s' % (engine, timing))
+	if outcome.kind == 'mismatch':
+		first = engines[0]
+		for engine in engines[1:]:
+			lines.append('')
+			lines += difflib.unified_diff(transcript(outcome.results[first]).splitlines(), transcript(outcome.results[engine]).splitlines(),
+										first, engine, lineterm='')
+	return '\n'.join(lines) + '\n'
+
+
+def save(directory, name, text, original, input, outcome):
+	os.makedirs(directory, exist_ok=True)
+	path = os.path.join(directory, name)
+	for suffix, content in (('.b', text), ('.orig.b', original), ('.in', input), ('.txt', report(name, text, outcome))):
+		with open(path + suffix, 'w') as f:
+			f.write(content)
+	return path
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Compare the engines on random programs.')
+	parser.add_argument('-n', '--programs', type=int, default=100, help='programs to try')
+	parser.add_argument('--seed', type=int, default=1, help='seed of the first program; the others follow it')
+	parser.add_argument('--statements', type=int, default=20, help='top-level statements of each program')
+	parser.add_argument('--depth', type=int, default=3, help='deepest nesting of each program')
+	parser.add_argument('--engines', default=','.join(run_tests.ENGINES), help='comma separated engines')
+	parser.add_argument('--bcc-args', default='', help='more arguments for bcc when compiling, such as -O')
+	parser.add_argument('--timeout', type=float, default=20, help='seconds allowed for each run')
+	parser.add_argument('--slowdown', type=float, default=100, help='how much slower than usual an engine may be')
+	parser.add_argument('--min-seconds', type=float, default=0.5, help='runs shorter than this are never slow')
+	parser.add_argument('--no-shrink', dest='shrink', action='store_false', help='save failing programs as generated')
+	parser.add_argument('--shrink-runs', type=int, default=400, help='most programs tried while shrinking one')
+	parser.add_argument('--failures', default=os.path.join(FUZZ, 'failures'), help='directory for failing programs')
+	args = parser.parse_args()
+
+	engines = args.engines.split(',')
+	for engine in list(engines):
+		if engine not in run_tests.ENGINES:
+			parser.error('unknown engine ' + engine)
+		if not run_tests.ENGINES[engine][1]():
+			print('skipping %s: not available' % engine, file=sys.stderr)
+			engines.remove(engine)
+	if len(engines) < 2:
+		parser.error('at least two engines are needed to compare')
+
+	ratios = {engine: [] for engine in engines}
+	failures = {}
+	for seed in range(args.seed, args.seed + args.programs):
+		array_size, statements = generate.program(args.statements, args.depth, seed)
+		text = generate.render(array_size, statements)
+		input = generate.input_text(seed)
+		outcome = judge(run_engines(text, input, engines, args), args, ratios)
+		if not outcome or not outcome.kind:
+			continue
+
+		name = 'seed%d' % seed
+		print('%s: %s %s' % (name, outcome.kind, outcome.detail), file=sys.stderr)
+		shrunk = text
+		if args.shrink:
+			statements, outcome = shrink(array_size, statements, input, outcome, engines, args, ratios)
+			shrunk = generate.render(array_size, statements)
+			print('  shrunk from %d to %d lines' % (text.count('\n'), shrunk.count('\n')), file=sys.stderr)
+		path = save(args.failures, name, shrunk, text, input, outcome)
+		print('  saved as %s.b' % os.path.relpath(path), file=sys.stderr)
+		failures[outcome.kind] = failures.get(outcome.kind, 0) + 1
+
+	summary = ', '.join('%d %s' % (count, kind) for kind, count in sorted(failures.items()))
+	print('%d programs, %s' % (args.programs, summary or 'no failures'))
+	return 1 if failures else 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
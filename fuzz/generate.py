@@ -0,0 +1,351 @@
+#!/usr/bin/env python3
+# Writes random FlatB programs for differential testing (see fuzz.py). A program
+# uses int and bool scalars and arrays, for and while loops, ifs, forward and
+# backward gotos, reads, prints and the array builtins, and is well formed and
+# well behaved by construction:
+#
+#   - every loop ends: a for loop's bound is a small constant, a while loop and a
+#     backward goto count up to one in a variable of their own, and the other gotos
+#     only jump forward
+#   - every array index is a constant or the iterator of an enclosing loop whose
+#     range lies inside the array, so no access is out of bounds
+#   - a divisor is a non-zero constant, or v * v + 1, which is never 0, even when the
+#     multiplication wraps
+#
+# so whatever two engines print differently is a bug in one of them. The program
+# ends by printing every variable.
+#
+# A program is kept as a tree of Statement objects, which fuzz.py shrinks by taking
+# statements out and by simplifying them; render() turns the tree into FlatB text.
+#
+# Usage: generate.py [--statements N] [--depth N] [--seed N] [-o FILE] [--input FILE]
+
+import argparse
+import random
+import sys
+
+SCALARS = 6
+ARRAYS = 2
+INPUTS = 200			# numbers in the input; a read past the end reads 0
+OPERATORS = '+-*/'
+
+
+# Expressions are tuples:
+#   ('num', n)  ('var', name)  ('neg', name)  ('elem', array, index)
+#   ('bin', op, left, right)  ('square', name), the divisor name * name + 1
+#   ('builtin', function, array, args)
+# An index is always ('num', n) or ('iter', name, offset).
+def expression_text(expr):
+	kind = expr[0]
+	if kind == 'num':
+		return str(expr[1])
+	if kind == 'var':
+		return expr[1]
+	if kind == 'neg':
+		return '-' + expr[1]
+	if kind == 'iter':
+		return expr[1] if not expr[2] else '(%s + %d)' % (expr[1], expr[2])
+	if kind == 'elem':
+		return '%s[%s]' % (expr[1], expression_text(expr[2]))
+	if kind == 'bin':
+		return '(%s %s %s)' % (expression_text(expr[2]), expr[1], expression_text(expr[3]))
+	if kind == 'square':
+		return '(%s * %s + 1)' % (expr[1], expr[1])
+	if kind == 'builtin':
+		return '%s(%s, %s)' % (expr[1], expr[2], ', '.join(expression_text(arg) for arg in expr[3]))
+	raise ValueError(kind)
+
+
+class Statement:
+	# kind is one of assign, read, print, fill, copy, if, for, while, repeat or skip;
+	# body and orelse are lists of statements
+	def __init__(self, kind, **fields):
+		self.kind = kind
+		self.body = fields.pop('body', [])
+		self.orelse = fields.pop('orelse', [])
+		self.__dict__.update(fields)
+
+	def copy(self):
+		other = Statement(self.kind)
+		other.__dict__.update(self.__dict__)
+		other.body = [statement.copy() for statement in self.body]
+		other.orelse = [statement.copy() for statement in self.orelse]
+		return other
+
+
+class Generator:
+	def __init__(self, rng, size):
+		self.rng = rng
+		self.size = size		# of every array
+		self.counters = 0		# loop iterators, while and goto counters, labels
+
+	def fresh(self, prefix):
+		self.counters += 1
+		return '%s%d' % (prefix, self.counters)
+
+	def constant(self):
+		return self.rng.choice([0, 1, 2, 3, 5, 7, 10, 100, 65536, 2147483647, 5000000000, 9223372036854775807, -1, -2, -9, -1000])
+
+	def index(self, iterators):
+		usable = [(name, lo, hi) for name, lo, hi in iterators if lo >= 0 and hi < self.size]
+		if usable and self.rng.random() < 0.7:
+			name, lo, hi = self.rng.choice(usable)
+			offset = self.rng.randint(-lo, self.size - 1 - hi)
+			return ('iter', name, offset)
+		return ('num', self.rng.randrange(self.size))
+
+	def expression(self, iterators, depth):
+		rng = self.rng
+		if depth <= 0 or rng.random() < 0.3:
+			choice = rng.randrange(10)
+			if choice < 3:
+				return ('num', self.constant())
+			if choice < 6:
+				return ('var', 'v%d' % rng.randrange(SCALARS))
+			if choice < 7:
+				return ('neg', rng.choice(['v%d' % rng.randrange(SCALARS), 'f']))
+			if choice < 9:
+				array = rng.choice(['a%d' % rng.randrange(ARRAYS), 'b'])
+				return ('elem', array, self.index(iterators))
+			if iterators:
+				return ('var', rng.choice(iterators)[0])
+			return ('var', 'f')
+		if rng.random() < 0.1:
+			lo, hi = self.index(iterators), self.index(iterators)
+			function = rng.choice(['sum', 'min', 'max', 'count'])
+			args = [lo, hi] if function != 'count' else [self.expression(iterators, depth - 1), lo, hi]
+			return ('builtin', function, 'a%d' % rng.randrange(ARRAYS), args)
+		op = rng.choice(OPERATORS)
+		left = self.expression(iterators, depth - 1)
+		if op == '/':
+			if rng.random() < 0.5:
+				right = ('num', rng.choice([2, 3, 7, 10, -1, -2, -5, 1000]))
+			else:
+				right = ('square', 'v%d' % rng.randrange(SCALARS))
+		else:
+			right = self.expression(iterators, depth - 1)
+		return ('bin', op, left, right)
+
+	def condition(self, iterators):
+		return (self.rng.random() < 0.15, self.rng.choice(['<', '>', '<=', '>=', '==', '!=']),
+				self.expression(iterators, 2), self.expression(iterators, 2))
+
+	def target(self, iterators):
+		rng = self.rng
+		choice = rng.randrange(10)
+		if choice < 6:
+			return ('var', 'v%d' % rng.randrange(SCALARS))
+		if choice < 7:
+			return ('var', 'f')
+		return ('elem', rng.choice(['a%d' % rng.randrange(ARRAYS), 'b']), self.index(iterators))
+
+	def statements(self, count, iterators, depth):
+		return [self.statement(iterators, depth) for _ in range(count)]
+
+	def statement(self, iterators, depth):
+		rng = self.rng
+		choice = rng.randrange(100)
+		nested = depth > 0
+		if choice < 40 or not nested and choice >= 70:
+			return Statement('assign', target=self.target(iterators), value=self.expression(iterators, 3))
+		if choice < 44:
+			return Statement('read', target=self.target(iterators))
+		if choice < 52:
+			text = rng.choice(['', 'x = ', 'value ', '100% ', 'a b '])
+			value = self.expression(iterators, 2) if rng.random() < 0.8 or not text else None
+			return Statement('print', text=text, value=value, newline=rng.random() < 0.6)
+		if choice < 56:
+			lo, hi = self.index(iterators), self.index(iterators)
+			if rng.random() < 0.5:
+				return Statement('fill', array=rng.choice(['a0', 'a1', 'b']), value=self.expression(iterators, 1), lo=lo, hi=hi)
+			return Statement('copy', array='a0', source='a1', lo=lo, hi=hi)
+		if choice < 62:
+			return Statement('if', condition=self.condition(iterators),
+							body=self.statements(rng.randint(1, 3), iterators, depth - 1),
+							orelse=self.statements(rng.randint(1, 3), iterators, depth - 1) if rng.random() < 0.5 else [])
+		if choice < 70:
+			name = self.fresh('i')
+			lo = rng.randint(-2, self.size - 1)
+			hi = rng.randint(lo - 1, lo + self.size)
+			step = rng.choice([None, None, None, 1, 2, 3, 0, -1])
+			last = hi if step is None or step <= 1 else lo + (hi - lo) // step * step
+			inner = iterators + [(name, lo, max(lo, last))]
+			return Statement('for', iterator=name, bound=self.fresh('n'), lo=lo, hi=hi, step=step,
+							stretch=rng.random() < 0.3, clobber=rng.random() < 0.2,
+							body=self.statements(rng.randint(1, 4), inner, depth - 1))
+		if choice < 78:
+			return Statement('while', counter=self.fresh('w'), times=rng.randint(0, 4),
+							body=self.statements(rng.randint(1, 3), iterators, depth - 1))
+		if choice < 85:
+			return Statement('repeat', counter=self.fresh('g'), label=self.fresh('L'), times=rng.randint(1, 3),
+							body=self.statements(rng.randint(1, 3), iterators, depth - 1))
+		return Statement('skip', label=self.fresh('L'), condition=self.condition(iterators) if rng.random() < 0.8 else None,
+						body=self.statements(rng.randint(1, 3), iterators, depth - 1))
+
+
+# Turns statements into FlatB text, declaring only the names they use
+class Renderer:
+	def __init__(self, size):
+		self.size = size
+		self.lines = []
+		self.scalars = set()
+		self.arrays = set()
+
+	def name(self, expr):
+		kind = expr[0]
+		if kind in ('var', 'neg', 'square', 'iter'):
+			self.scalars.add(expr[1])
+		elif kind == 'elem':
+			self.arrays.add(expr[1])
+			self.name(expr[2])
+		elif kind == 'bin':
+			self.name(expr[2])
+			self.name(expr[3])
+		elif kind == 'builtin':
+			self.arrays.add(expr[2])
+			for arg in expr[3]:
+				self.name(arg)
+
+	def text(self, expr):
+		self.name(expr)
+		return expression_text(expr)
+
+	def condition(self, condition):
+		negated, op, left, right = condition
+		return '%s%s %s %s' % ('!' if negated else '', self.text(left), op, self.text(right))
+
+	def emit(self, indent, line, label=None):
+		self.lines.append('%s%s%s' % (label + ':' if label else '', '\t' * indent, line))
+
+	def block(self, statements, indent):
+		for statement in statements:
+			self.statement(statement, indent)
+
+	def statement(self, s, indent):
+		if s.kind == 'assign':
+			self.emit(indent, '%s = %s;' % (self.text(s.target), self.text(s.value)))
+		elif s.kind == 'read':
+			self.emit(indent, 'read %s;' % self.text(s.target))
+		elif s.kind == 'print':
+			keyword = 'println' if s.newline else 'print'
+			if s.value is None:
+				self.emit(indent, '%s "%s";' % (keyword, s.text))
+			elif s.text:
+				self.emit(indent, '%s "%s", %s;' % (keyword, s.text, self.text(s.value)))
+			else:
+				self.emit(indent, '%s %s;' % (keyword, self.text(s.value)))
+		elif s.kind == 'fill':
+			self.arrays.add(s.array)
+			self.emit(indent, 'fill %s, %s, %s, %s;' % (s.array, self.text(s.value), self.text(s.lo), self.text(s.hi)))
+		elif s.kind == 'copy':
+			self.arrays.update((s.array, s.source))
+			self.emit(indent, 'copy %s, %s, %s, %s;' % (s.array, s.source, self.text(s.lo), self.text(s.hi)))
+		elif s.kind == 'if':
+			self.emit(indent, 'if %s {' % self.condition(s.condition))
+			self.block(s.body or [Statement('assign', target=('var', 'v0'), value=('var', 'v0'))], indent + 1)
+			if s.orelse:
+				self.emit(indent, '}')
+				self.emit(indent, 'else {')
+				self.block(s.orelse, indent + 1)
+			self.emit(indent, '}')
+		elif s.kind == 'for':
+			# the bound is a variable the body may change, which must not change the
+			# number of iterations
+			self.scalars.update((s.iterator, s.bound))
+			self.emit(indent, '%s = %d;' % (s.bound, s.hi))
+			step = ', %d' % s.step if s.step is not None else ''
+			self.emit(indent, 'for %s = %d, %s%s {' % (s.iterator, s.lo, s.bound, step))
+			self.block(s.body, indent + 1)
+			if s.stretch:
+				self.emit(indent + 1, '%s = %s + 1;' % (s.bound, s.bound))
+			if s.clobber or not s.body and not s.stretch:
+				self.emit(indent + 1, '%s = %d;' % (s.iterator, s.lo))
+			self.emit(indent, '}')
+		elif s.kind == 'while':
+			self.scalars.add(s.counter)
+			self.emit(indent, '%s = 0;' % s.counter)
+			self.emit(indent, 'while %s < %d {' % (s.counter, s.times))
+			self.block(s.body, indent + 1)
+			self.emit(indent + 1, '%s = %s + 1;' % (s.counter, s.counter))
+			self.emit(indent, '}')
+		elif s.kind == 'repeat':
+			self.scalars.add(s.counter)
+			self.emit(indent, '%s = 0;' % s.counter)
+			self.emit(indent, '%s = %s + 1;' % (s.counter, s.counter), s.label)
+			self.block(s.body, indent)
+			self.emit(indent, 'goto %s if %s < %d;' % (s.label, s.counter, s.times))
+		elif s.kind == 'skip':
+			self.scalars.add('j')
+			if s.condition:
+				self.emit(indent, 'goto %s if %s;' % (s.label, self.condition(s.condition)))
+			else:
+				self.emit(indent, 'goto %s;' % s.label)
+			self.block(s.body, indent)
+			self.emit(indent, 'j = j + 1;', s.label)
+
+	def program(self, statements):
+		self.block(statements, 1)
+		body = self.lines
+
+		# print everything at the end
+		self.lines = []
+		self.scalars.add('d')
+		for name in sorted(self.scalars - {'d'}):
+			self.emit(1, 'println "%s = ", %s;' % (name, name))
+		for name in sorted(self.arrays):
+			self.emit(1, 'print "%s =";' % name)
+			self.emit(1, 'for d = 0, %d {' % (self.size - 1))
+			self.emit(2, 'print " ", %s[d];' % name)
+			self.emit(1, '}')
+			self.emit(1, 'println "";')
+
+		bools = {'f'} & self.scalars
+		ints = sorted(self.scalars - bools)
+		declarations = []
+		for first in range(0, len(ints), 12):
+			declarations.append('\tint %s;' % ', '.join(ints[first:first + 12]))
+		int_arrays = sorted(self.arrays - {'b'})
+		if int_arrays:
+			declarations.append('\tint %s;' % ', '.join('%s[%d]' % (name, self.size) for name in int_arrays))
+		if bools or 'b' in self.arrays:
+			declarations.append('\tbool %s;' % ', '.join(sorted(bools) + (['b[%d]' % self.size] if 'b' in self.arrays else [])))
+		return 'declblock{\n%s\n}\n\ncodeblock{\n%s\n}\n' % ('\n'.join(declarations), '\n'.join(body + self.lines))
+
+
+def program(statements=20, depth=3, seed=1):
+	rng = random.Random(seed)
+	generator = Generator(rng, rng.randint(4, 12))
+	return generator.size, generator.statements(statements, [], depth)
+
+
+def render(size, statements):
+	return Renderer(size).program(statements)
+
+
+def input_text(seed=1):
+	rng = random.Random(seed)
+	return ' '.join(str(rng.choice([rng.randint(-100, 100), rng.randint(-2 ** 40, 2 ** 40)])) for _ in range(INPUTS)) + '\n'
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Write a random FlatB program.')
+	parser.add_argument('--statements', type=int, default=20, help='top-level statements')
+	parser.add_argument('--depth', type=int, default=3, help='deepest nesting of loops, ifs and gotos')
+	parser.add_argument('--seed', type=int, default=1)
+	parser.add_argument('-o', '--output', help='file to write (default: stdout)')
+	parser.add_argument('--input', help='also write input for the program\'s reads to this file')
+	args = parser.parse_args()
+
+	text = render(*program(args.statements, args.depth, args.seed))
+	if args.output:
+		with open(args.output, 'w') as f:
+			f.write(text)
+	else:
+		sys.stdout.write(text)
+	if args.input:
+		with open(args.input, 'w') as f:
+			f.write(input_text(args.seed))
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Writes a FlatB program whose size is set along each dimension that bcc's cost may
+# grow with, for measuring how the compiler scales (see scale.py):
+#
+#   --statements N   top-level statements: assignments, with an if or a print now and then
+#   --variables N    declared scalars, which the statements use at random
+#   --labels N       labelled statements, each the target of a forward goto
+#   --depth N        for loops nested N deep around one assignment
+#   --expr-depth N   one assignment whose expression is N operations long, a left-deep
+#                    tree: v1 + 1 - v2 + 2 ..., so the AST is N deep but the parser's
+#                    stack is not
+#
+# Loops run once and gotos only jump forward, so every program also runs quickly and
+# ends. The same options and --seed give the same program.
+#
+# Usage: generate.py [--statements N] [--variables N] [--labels N] [--depth N]
+#                    [--expr-depth N] [--seed N] [-o FILE]
+
+import argparse
+import random
+import sys
+
+DEFAULTS = {'statements': 100, 'variables': 10, 'labels': 0, 'depth': 1, 'expr_depth': 3}
+
+
+def expression(rng, variables, length):
+	terms = ['v%d' % rng.randrange(variables)]
+	for k in range(length):
+		terms.append('+' if k % 2 == 0 else '-')
+		terms.append(str(rng.randrange(1, 10)) if k % 2 == 0 else 'v%d' % rng.randrange(variables))
+	return ' '.join(terms)
+
+
+def program(statements=100, variables=10, labels=0, depth=1, expr_depth=3, seed=1):
+	rng = random.Random(seed)
+	variables = max(variables, 1)
+	statements = max(statements, labels)
+	out = ['declblock{\n']
+	for first in range(0, variables, 16):
+		out.append('\tint %s;\n' % ', '.join('v%d' % v for v in range(first, min(first + 16, variables))))
+	for first in range(0, depth, 16):
+		out.append('\tint %s;\n' % ', '.join('i%d' % i for i in range(first, min(first + 16, depth))))
+	out.append('}\n\ncodeblock{\n')
+
+	# labels are spread evenly, each with its goto a few statements before it
+	every = statements // labels if labels else 0
+	targets = set(range(every - 1, statements, every)) if labels else set()
+	pending = []
+	placed = 0
+	for s in range(statements):
+		if every and s % every == 0 and placed < labels:
+			label = 'L%d' % placed
+			placed += 1
+			pending.append(label)
+			out.append('\tgoto %s if v%d > %d;\n' % (label, rng.randrange(variables), rng.randrange(100)))
+		prefix = '\t'
+		if s in targets and pending:
+			prefix = pending.pop(0) + ':\t'
+			targets.discard(s)
+		v = rng.randrange(variables)
+		kind = rng.randrange(100)
+		if kind < 5:
+			out.append('%sif v%d < v%d {\n\t\tv%d = %d;\n\t}\n\telse {\n\t\tv%d = %s;\n\t}\n'
+				% (prefix, v, rng.randrange(variables), v, rng.randrange(100), v, expression(rng, variables, 2)))
+		elif kind < 6:
+			out.append('%sprintln "v%d = ", v%d;\n' % (prefix, v, v))
+		else:
+			out.append('%sv%d = %s;\n' % (prefix, v, expression(rng, variables, 2)))
+
+	# nested loops, indented at most a few levels so the file stays linear in depth
+	for d in range(depth):
+		out.append('\t' * min(d + 1, 8) + 'for i%d = 1, 1 {\n' % d)
+	out.append('\t' * min(depth + 1, 8) + 'v0 = v0 + 1;\n')
+	for d in reversed(range(depth)):
+		out.append('\t' * min(d + 1, 8) + '}\n')
+
+	if expr_depth:
+		out.append('\tv0 = %s;\n' % expression(rng, variables, expr_depth))
+	out.append('\tprintln "v0 = ", v0;\n}\n')
+	return ''.join(out)
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Write a FlatB program of the given sizes.')
+	for name, default in DEFAULTS.items():
+		parser.add_argument('--' + name.replace('_', '-'), type=int, default=default)
+	parser.add_argument('--seed', type=int, default=1)
+	parser.add_argument('-o', '--output', help='file to write (default: stdout)')
+	args = parser.parse_args()
+
+	text = program(args.statements, args.variables, args.labels, args.depth, args.expr_depth, args.seed)
+	if args.output:
+		with open(args.output, 'w') as f:
+			f.write(text)
+	else:
+		sys.stdout.write(text)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+# Measures how bcc's time and memory grow with the size of its input. For each
+# dimension of generate.py it compiles programs of geometrically growing size, the
+# other dimensions at their defaults, and records the wall time, peak RSS and the
+# phases of bcc --time-report=json. Each dimension gets a table, and a log-log slope
+# fitted over the runs long enough to time: about 1 is linear, 2 quadratic. A slope
+# above --limit is reported as super-linear.
+#
+# A dimension stops growing once a run fails or takes longer than --timeout.
+#
+# Usage: scale.py [--dimensions statements,depth] [--min N] [--max N] [--factor N]
+#                 [--timeout S] [--bcc-args ARGS] [--json FILE] [--plot FILE]
+# The BCC environment variable overrides the compiler, src/bcc by default.
+
+import argparse
+import json
+import math
+import os
+import shlex
+import signal
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+import generate
+
+SCALING = os.path.dirname(os.path.abspath(__file__))
+BCC = os.environ.get('BCC') or os.path.join(os.path.dirname(SCALING), 'src', 'bcc')
+
+# Runs shorter than this are mostly process start-up and are left out of the fit
+FIT_SECONDS = 0.05
+
+
+class Run:
+	def __init__(self, size, code, wall, rss, phases):
+		self.size = size
+		self.code = code
+		self.wall = wall
+		self.rss = rss
+		self.phases = phases		# top-level phase name: wall seconds
+
+	def status(self):
+		if self.code == 0:
+			return 'ok'
+		if self.code == 'timeout':
+			return 'timeout'
+		return 'signal %d' % (self.code - 128) if self.code > 128 else 'exit %d' % self.code
+
+
+# The report --time-report=json writes to stderr, after anything else bcc said there
+def time_report(stderr):
+	start = stderr.find('{"name": "total"')
+	if start < 0:
+		return {}
+	try:
+		report = json.loads(stderr[start:])
+	except ValueError:
+		return {}
+	return {phase['name']: phase['wall_ms'] / 1000 for phase in report.get('phases', [])}
+
+
+def run_bcc(source, cwd, bcc_args, timeout):
+	with tempfile.TemporaryFile() as stderr:
+		start = time.monotonic()
+		child = subprocess.Popen([BCC, '-q', '--time-report=json'] + bcc_args + [source], cwd=cwd,
+			stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, stderr=stderr)
+		killed = []
+		timer = threading.Timer(timeout, lambda: (killed.append(True), child.send_signal(signal.SIGKILL)))
+		timer.start()
+		_, status, usage = os.wait4(child.pid, 0)
+		wall = time.monotonic() - start
+		timer.cancel()
+		child.returncode = 0		# already reaped
+
+		stderr.seek(0)
+		phases = time_report(stderr.read().decode('utf-8', 'replace'))
+		code = 'timeout' if killed else os.WEXITSTATUS(status) if os.WIFEXITED(status) else 128 + os.WTERMSIG(status)
+		# ru_maxrss is in kilobytes on Linux
+		return wall, usage.ru_maxrss, code, phases
+
+
+def measure(dimension, size, bcc_args, timeout):
+	sizes = dict(generate.DEFAULTS)
+	sizes[dimension] = size
+	with tempfile.TemporaryDirectory(prefix='flatb-scale-') as cwd:
+		with open(os.path.join(cwd, 'scale.b'), 'w') as f:
+			f.write(generate.program(**sizes))
+		wall, rss, code, phases = run_bcc('scale.b', cwd, bcc_args, timeout)
+	return Run(size, code, wall, rss, phases)
+
+
+# Least squares slope of log(value) against log(size)
+def slope(points):
+	points = [(math.log(size), math.log(value)) for size, value in points if size > 0 and value > 0]
+	if len(points) < 2:
+		return None
+	mean_x = sum(x for x, _ in points) / len(points)
+	mean_y = sum(y for _, y in points) / len(points)
+	spread = sum((x - mean_x) ** 2 for x, _ in points)
+	if not spread:
+		return None
+	return sum((x - mean_x) * (y - mean_y) for x, y in points) / spread
+
+
+def growth(runs):
+	timed = [run for run in runs if run.code == 0 and run.wall >= FIT_SECONDS]
+	return {
+		'time': slope([(run.size, run.wall) for run in timed]),
+		'memory': slope([(run.size, run.rss) for run in timed]),
+		'phases': {name: slope([(run.size, run.phases.get(name, 0)) for run in timed])
+					for name in sorted({name for run in timed for name in run.phases})},
+	}
+
+
+def sizes(first, last, factor):
+	size = first
+	while size <= last:
+		yield size
+		size = max(size + 1, int(size * factor))
+
+
+def table(dimension, runs):
+	phases = []
+	for run in runs:
+		phases += [name for name in run.phases if name not in phases]
+	header = (dimension.replace('_', ' ').capitalize(), 'Result', 'Wall (s)', 'Peak RSS (KB)') + tuple(phases)
+	lines = ['| ' + ' | '.join(header) + ' |', '|' + '|'.join('---' for _ in header) + '|']
+	for run in runs:
+		columns = ['%d' % run.size, run.status(), '%.3f' % run.wall, '%d' % run.rss]
+		columns += ['%.3f' % run.phases[name] if name in run.phases else '-' for name in phases]
+		lines.append('| ' + ' | '.join(columns) + ' |')
+	return '\n'.join(lines) + '\n'
+
+
+def summary(dimension, fitted, limit):
+	def described(value):
+		return '-' if value is None else '%.2f%s' % (value, ' (super-linear)' if value > limit else '')
+	text = '%s: time grows as size^%s, memory as size^%s\n' % (dimension, described(fitted['time']), described(fitted['memory']))
+	worst = [(value, name) for name, value in fitted['phases'].items() if value is not None and value > limit]
+	for value, name in sorted(worst, reverse=True):
+		text += '  phase "%s" grows as size^%.2f\n' % (name, value)
+	return text
+
+
+def plot(path, results):
+	try:
+		import matplotlib
+		matplotlib.use('Agg')
+		import matplotlib.pyplot as pyplot
+	except ImportError:
+		print('matplotlib is not installed, so there is no plot; --json keeps the numbers', file=sys.stderr)
+		return
+	figure, axes = pyplot.subplots(2, len(results), figsize=(4 * len(results), 7), squeeze=False)
+	for column, (dimension, runs) in enumerate(results.items()):
+		done = [run for run in runs if run.code == 0]
+		for row, (label, value) in enumerate((('wall time (s)', lambda run: run.wall), ('peak RSS (KB)', lambda run: run.rss))):
+			axis = axes[row][column]
+			axis.loglog([run.size for run in done], [value(run) for run in done], 'o-')
+			axis.set_xlabel(dimension.replace('_', ' '))
+			axis.set_ylabel(label)
+			axis.grid(True, which='both', alpha=0.3)
+	figure.tight_layout()
+	figure.savefig(path)
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Measure how bcc scales with the size of its input.')
+	parser.add_argument('--dimensions', default=','.join(generate.DEFAULTS), help='comma separated dimensions of generate.py')
+	parser.add_argument('--min', type=int, default=100, help='smallest size of each dimension')
+	parser.add_argument('--max', type=int, default=1000000, help='largest size of each dimension')
+	parser.add_argument('--factor', type=float, default=4, help='growth from one size to the next')
+	parser.add_argument('--timeout', type=float, default=300, help='seconds allowed for one compile')
+	parser.add_argument('--limit', type=float, default=1.3, help='slopes above this are super-linear')
+	parser.add_argument('--bcc-args', default='', help='more arguments for bcc, such as -O')
+	parser.add_argument('--json', help='write the runs and slopes to this file')
+	parser.add_argument('--plot', help='draw time and memory against size to this image (needs matplotlib)')
+	args = parser.parse_args()
+
+	dimensions = args.dimensions.replace('-', '_').split(',')
+	for dimension in dimensions:
+		if dimension not in generate.DEFAULTS:
+			parser.error('unknown dimension %s' % dimension)
+
+	results = {}
+	for dimension in dimensions:
+		runs = results[dimension] = []
+		for size in sizes(args.min, args.max, args.factor):
+			run = measure(dimension, size, shlex.split(args.bcc_args), args.timeout)
+			runs.append(run)
+			print('%s %d: %s, %.3f s, %d KB' % (dimension, size, run.status(), run.wall, run.rss), file=sys.stderr)
+			if run.code != 0:
+				break
+
+	report = {}
+	for dimension, runs in results.items():
+		fitted = growth(runs)
+		report[dimension] = {'runs': [vars(run) for run in runs], 'slopes': fitted}
+		print('\n' + table(dimension, runs))
+		print(summary(dimension, fitted, args.limit), end='')
+
+	if args.json:
+		with open(args.json, 'w') as f:
+			json.dump(report, f, indent=1)
+	if args.plot:
+		plot(args.plot, results)
+
+
+if __name__ == '__main__':
+	main()
@@ -3,13 +3,14 @@
 #include <fstream>
 #include <exception>
 #include <algorithm>
+#include <climits>
+#include <mutex>
+#include "runtime/Output.h"
+#include "runtime/ThreadPool.h"
+#include "runtime/flatbrt.h"
 
 using namespace std;
 
-ofstream xml("AST_XML.xml");
-int tabs = 0;
-ASTCodeStatement *currentStatement = nullptr;
-
 struct GotoException : public exception 
 {
 	const char* what() const throw () 
@@ -18,7 +19,7 @@ struct GotoException : public exception
 	}
 };
 
-void insertTabs()
+void ASTVisitor::insertTabs()
 {
 	for(int i = 0; i < tabs; i++)
 		xml << "\t";
@@ -102,7 +103,30 @@ string toStringIOStmt(IOInstruction iostmt)
 	}
 }
 
+Builtin toBuiltin(string name)
+{
+	if(name == "fill")
+		return fillbuiltin;
+	if(name == "copy")
+		return copybuiltin;
+	if(name == "sum")
+		return sumbuiltin;
+	if(name == "min")
+		return minbuiltin;
+	if(name == "max")
+		return maxbuiltin;
+	if(name == "count")
+		return countbuiltin;
+	return nobuiltin;
+}
+
 /*************************** ASTNode ********************************/
+ASTNode::ASTNode()
+{
+	parent = nullptr;
+	line = 0;
+}
+
 void ASTNode::setParent(ASTNode *parent)
 {
 	this->parent = parent;
@@ -116,9 +140,15 @@ ASTNode* ASTNode::getParent()
 /************************** End ASTNode *****************************/
 
 /*************************** ASTVisitor **************************************/
-ASTVisitor::ASTVisitor()
+ASTVisitor::ASTVisitor(): file("AST_XML.xml"), xml(file.rdbuf())
 {
-	return;
+	tabs = 0;
+}
+
+// A null buffer discards the listing
+ASTVisitor::ASTVisitor(streambuf *listing): xml(listing)
+{
+	tabs = 0;
 }
 
 void ASTVisitor::printLabel(ASTCodeStatement *statement)
@@ -134,8 +164,7 @@ void ASTVisitor::printLabel(ASTCodeStatement *statement)
 		}
 		else
 		{
-			cerr << "[ERROR] Label " << statement->label << " defined before" << endl;
-			exit(1);
+			throw SemanticError("Label " + statement->label + " defined before");
 		}
 	}
 }
@@ -237,7 +266,12 @@ void ASTVisitor::visit(ASTForLoop *forloop)
 {
 	printLabel(forloop);
 	insertTabs();
-	xml << "<forloop>" << endl;
+	if(forloop->schedule == staticchunks)
+		xml << "<forloop schedule=\'static\'>" << endl;
+	else if(forloop->schedule == dynamicchunks)
+		xml << "<forloop schedule=\'dynamic\'>" << endl;
+	else
+		xml << "<forloop>" << endl;
 	tabs++;
 	insertTabs();
 	xml << "<init>" << endl;
@@ -267,6 +301,13 @@ void ASTVisitor::visit(ASTForLoop *forloop)
 	tabs--;
 	insertTabs();
 	xml << "</forloop>" << endl;
+
+	if(forloop->schedule != sequential)
+	{
+		ASTDataSharing sharing(forloop, symboltable);
+		if(!sharing.errors.empty())
+			throw SemanticError(sharing.errors);
+	}
 }
 
 void ASTVisitor::visit(ASTMathExpr *mathexpr)
@@ -294,9 +335,7 @@ void ASTVisitor::visit(ASTTargetVar *var_location)
 {
 	if(symboltable.find(var_location->var_name) == symboltable.end())
 	{
-		cerr << "[ERROR] Variable " << var_location->var_name 
-									<< " not defined" << endl;
-		exit(1);
+		throw SemanticError("Variable " + var_location->var_name + " not defined");
 	}
 
 	insertTabs();
@@ -337,6 +376,69 @@ void ASTVisitor::visit(ASTAssignment *assignment)
 	xml << "</equals>" << endl;
 }
 
+// The symbol table entry of the array a builtin works on; bool arrays only if
+// bitAllowed
+SymbolTableEntry* ASTVisitor::builtinArray(string builtin, string array, bool bitAllowed)
+{
+	if(symboltable.find(array) == symboltable.end())
+		throw SemanticError("Variable " + array + " not defined");
+
+	SymbolTableEntry *entry = symboltable[array];
+	if(!entry->isArray)
+		throw SemanticError(builtin + " needs an array, " + array + " is not one");
+	if(entry->isBit && !bitAllowed)
+		throw SemanticError(builtin + " needs an int array, " + array + " is a bool array");
+	return entry;
+}
+
+void ASTVisitor::visit(ASTBuiltinStatement *builtin)
+{
+	printLabel(builtin);
+	if(builtin->builtin != fillbuiltin && builtin->builtin != copybuiltin)
+		throw SemanticError("Unknown statement " + builtin->name);
+	builtinArray(builtin->name, builtin->array, builtin->builtin == fillbuiltin);
+
+	if(builtin->builtin == copybuiltin)
+	{
+		ASTTargetVar *source = dynamic_cast<ASTTargetVar *>(builtin->args[0]);
+		if(!source || source->array_type || source->op != noop)
+			throw SemanticError("copy needs an array to copy from");
+		builtinArray(builtin->name, source->var_name, false);
+		builtin->source = source->var_name;
+	}
+
+	insertTabs();
+	xml << "<" << builtin->name << " array=\'" << builtin->array << "\'";
+	if(builtin->builtin == copybuiltin)
+		xml << " source=\'" << builtin->source << "\'";
+	xml << ">" << endl;
+	tabs++;
+	for(size_t i = builtin->builtin == copybuiltin ? 1 : 0; i < builtin->args.size(); i++)
+		builtin->args[i]->accept(this);
+	tabs--;
+	insertTabs();
+	xml << "</" << builtin->name << ">" << endl;
+}
+
+void ASTVisitor::visit(ASTBuiltinExpr *builtin)
+{
+	if(builtin->builtin != sumbuiltin && builtin->builtin != minbuiltin
+		&& builtin->builtin != maxbuiltin && builtin->builtin != countbuiltin)
+		throw SemanticError("Unknown function " + builtin->name);
+	if(builtin->args.size() != (builtin->builtin == countbuiltin ? 3 : 2))
+		throw SemanticError("Wrong number of arguments to " + builtin->name);
+	builtinArray(builtin->name, builtin->array, false);
+
+	insertTabs();
+	xml << "<" << builtin->name << " array=\'" << builtin->array << "\'>" << endl;
+	tabs++;
+	for(auto arg: builtin->args)
+		arg->accept(this);
+	tabs--;
+	insertTabs();
+	xml << "</" << builtin->name << ">" << endl;
+}
+
 void ASTVisitor::visit(ASTCodeBlock *code_block)
 {
 	insertTabs();
@@ -359,18 +461,17 @@ void ASTVisitor::visit(ASTVariable *variable)
 		if(variable->array_type)
 		{
 			xml << "size=\'" << variable->length << "\' ";
-			ste = new SymbolTableEntry(variable->var_name, variable->length);
+			ste = new SymbolTableEntry(variable->var_name, variable->length, variable->isBitType());
 		}
 		else
-			ste = new SymbolTableEntry(variable->var_name);
+			ste = new SymbolTableEntry(variable->var_name, variable->isBitType());
 		xml << "type=\'" << variable->data_type << "\' />" << endl;
 
 		symboltable[variable->var_name] = ste;
 	}
 	else
 	{
-		cerr << "[ERROR] Multiple variable declarations of " << variable->var_name << endl;
-		exit(1);
+		throw SemanticError("Multiple variable declarations of " + variable->var_name);
 	}
 }
 
@@ -419,20 +520,32 @@ map<string, SymbolTableEntry *> ASTVisitor::getSymbolTable()
 /************************** End ASTVisitor ***********************************/
 
 /*************************** SymbolTableEntry ********************************/
-SymbolTableEntry::SymbolTableEntry(string identifier, unsigned int size)
+SymbolTableEntry::SymbolTableEntry(string identifier, unsigned int size, bool isBit)
 {
 	this->identifier = identifier;
 	this->isArray = true;
+	this->isBit = isBit;
 	this->size = size;
-	this->value = new int[size];
 	this->node = nullptr;
+	if(isBit)
+	{
+		this->value = nullptr;
+		this->bits = new uint64_t[(size + 63) / 64]();
+	}
+	else
+	{
+		this->value = new int64_t[size]();
+		this->bits = nullptr;
+	}
 }
 
-SymbolTableEntry::SymbolTableEntry(string identifier)
+SymbolTableEntry::SymbolTableEntry(string identifier, bool isBit)
 {
 	this->identifier = identifier;
 	this->isArray = false;
-	this->value = new int[1];
+	this->isBit = isBit;
+	this->value = new int64_t[1]();
+	this->bits = nullptr;
 	this->node = nullptr;
 }
 
@@ -440,16 +553,27 @@ SymbolTableEntry::SymbolTableEntry(string identifier, ASTCodeStatement *node)
 {
 	this->identifier = identifier;
 	this->isArray = false;
+	this->isBit = false;
 	this->value = nullptr;
+	this->bits = nullptr;
 	this->node = node;
 }
 
-int SymbolTableEntry::getValue(unsigned int index)
+// Whether index is an element of the array, compared at full width so that a
+// large index cannot wrap around onto a small one
+bool SymbolTableEntry::contains(int64_t index)
+{
+	return index >= 0 && index < (int64_t)size;
+}
+
+int64_t SymbolTableEntry::getValue(int64_t index)
 {
 	if(isArray)
 	{
-		if(index < size)
+		if(contains(index))
 		{
+			if(isBit)
+				return (bits[index >> 6] >> (index & 63)) & 1;
 			return value[index];
 		}
 		else
@@ -465,13 +589,23 @@ int SymbolTableEntry::getValue(unsigned int index)
 	}
 }
 
-void SymbolTableEntry::setValue(unsigned int index, int lexval)
+void SymbolTableEntry::setValue(int64_t index, int64_t lexval)
 {
 	if(isArray)
 	{
-		if(index < size)
+		if(contains(index))
 		{
-			value[index] = lexval;
+			if(isBit)
+			{
+				// other threads may be setting other bits of the same word
+				uint64_t mask = (uint64_t)1 << (index & 63);
+				if(lexval)
+					__atomic_fetch_or(&bits[index >> 6], mask, __ATOMIC_RELAXED);
+				else
+					__atomic_fetch_and(&bits[index >> 6], ~mask, __ATOMIC_RELAXED);
+			}
+			else
+				value[index] = lexval;
 		}
 		else
 		{
@@ -486,7 +620,7 @@ void SymbolTableEntry::setValue(unsigned int index, int lexval)
 	}
 }
 
-int SymbolTableEntry::getValue()
+int64_t SymbolTableEntry::getValue()
 {
 	if(!isArray)
 	{
@@ -507,13 +641,13 @@ int SymbolTableEntry::getValue()
 	}
 }
 
-void SymbolTableEntry::setValue(int lexval)
+void SymbolTableEntry::setValue(int64_t lexval)
 {
 	if(!isArray)
 	{
 		if(value)
 		{
-			value[0] = lexval;
+			value[0] = isBit ? lexval != 0 : lexval;
 		}
 		else
 		{
@@ -528,6 +662,127 @@ void SymbolTableEntry::setValue(int lexval)
 	}
 }
 
+// Sets elements lo..hi (inclusive) to lexval. Bool arrays are written a word at a time
+void SymbolTableEntry::fill(int64_t lo, int64_t hi, int64_t lexval)
+{
+	if(lo > hi)
+		return;
+
+	if(!isArray)
+	{
+		cout << "Identifier is not an array" << endl;
+		exit(1);
+	}
+
+	if(!contains(lo) || !contains(hi))
+	{
+		cout << "Array index out of bounds" << endl;
+		exit(1);
+	}
+
+	if(!isBit)
+	{
+		__flatb_fill(value, lo, hi, lexval);
+		return;
+	}
+
+	uint64_t word = lexval ? ~(uint64_t)0 : 0;
+	int64_t first = lo >> 6, last = hi >> 6;
+	uint64_t headMask = ~(uint64_t)0 << (lo & 63);
+	uint64_t tailMask = ~(uint64_t)0 >> (63 - (hi & 63));
+
+	if(first == last)
+		headMask &= tailMask;
+
+	// the edge words may hold bits that other threads are setting
+	if(lexval)
+		__atomic_fetch_or(&bits[first], headMask, __ATOMIC_RELAXED);
+	else
+		__atomic_fetch_and(&bits[first], ~headMask, __ATOMIC_RELAXED);
+	if(first == last)
+		return;
+
+	fill_n(bits + first + 1, last - first - 1, word);
+	if(lexval)
+		__atomic_fetch_or(&bits[last], tailMask, __ATOMIC_RELAXED);
+	else
+		__atomic_fetch_and(&bits[last], ~tailMask, __ATOMIC_RELAXED);
+}
+
+// Returns the first index in from..to (inclusive) holding lexval, or to + 1 if there
+// is none. Bool arrays skip over whole words that cannot match.
+int64_t SymbolTableEntry::scan(int64_t from, int64_t to, int64_t lexval)
+{
+	if(from > to)
+		return from;
+
+	if(!isArray)
+	{
+		cout << "Identifier is not an array" << endl;
+		exit(1);
+	}
+
+	int64_t i = from;
+	while(i <= to)
+	{
+		if(!contains(i))
+		{
+			cout << "Array index out of bounds" << endl;
+			exit(1);
+		}
+
+		if(!isBit)
+		{
+			if(value[i] == lexval)
+				return i;
+			i++;
+			continue;
+		}
+
+		uint64_t word = bits[i >> 6];
+		if(!lexval)
+			word = ~word;
+		word >>= (i & 63);
+
+		if(word)
+		{
+			i += __builtin_ctzll(word);
+			if(i > to)
+				return to + 1;
+			if(i >= size)
+				continue;
+			return i;
+		}
+		i = (i | 63) + 1;
+	}
+	return to + 1;
+}
+
+// The elements of an int array, for a runtime kernel to work on elements lo..hi
+// (inclusive) of; exits if they are not all in the array. An empty range is never
+// out of bounds.
+int64_t* SymbolTableEntry::range(int64_t lo, int64_t hi)
+{
+	if(!isArray)
+	{
+		cout << "Identifier is not an array" << endl;
+		exit(1);
+	}
+
+	if(lo <= hi && (!contains(lo) || !contains(hi)))
+	{
+		cout << "Array index out of bounds" << endl;
+		exit(1);
+	}
+	return value;
+}
+
+SymbolTableEntry::~SymbolTableEntry()
+{
+	delete[] value;
+	delete[] bits;
+}
+
 ASTCodeStatement* SymbolTableEntry::getLabelPtr()
 {
 	if(!isArray)
@@ -552,6 +807,29 @@ ASTCodeStatement* SymbolTableEntry::getLabelPtr()
 /************************** End SymbolTableEntry *****************************/
 
 /*************************** ASTInterpreter **********************************/
+
+// Integer arithmetic wraps around, as it does in compiled code. Signed overflow is
+// undefined in C++, so it is done on the unsigned values; INT64_MIN / -1 is INT64_MIN.
+static int64_t wrapAdd(int64_t a, int64_t b)
+{
+	return (uint64_t)a + (uint64_t)b;
+}
+
+static int64_t wrapSub(int64_t a, int64_t b)
+{
+	return (uint64_t)a - (uint64_t)b;
+}
+
+static int64_t wrapMul(int64_t a, int64_t b)
+{
+	return (uint64_t)a * (uint64_t)b;
+}
+
+static int64_t wrapDiv(int64_t a, int64_t b)
+{
+	return b == -1 ? wrapSub(0, a) : a / b;
+}
+
 ASTInterpreter::ASTInterpreter(map<string, SymbolTableEntry *> symboltable)
 {
 	this->symboltable = symboltable;
@@ -561,7 +839,8 @@ void ASTInterpreter::visit(ASTIOBlock *ioblock)
 {
 	if(ioblock->iostmt == readvar)
 	{
-		int input;
+		// a read past the end of the input gives 0
+		int64_t input = 0;
 		cin >> input;
 
 		ASTTargetVar *target = static_cast<ASTTargetVar *>(ioblock->expr);
@@ -569,14 +848,13 @@ void ASTInterpreter::visit(ASTIOBlock *ioblock)
 	}
 	else
 	{
-		if(!ioblock->output.empty())
-			cout << ioblock->output;
-
+		// written in one piece, in iteration order inside parallel loops
+		string text = ioblock->output;
 		if(ioblock->expr)
-			cout << ioblock->expr->accept_value(this);
-
+			text += to_string(ioblock->expr->accept_value(this));
 		if(ioblock->iostmt == println)
-			cout << endl;
+			text += "\n";
+		flatb::write(text.data(), text.size());
 	}
 }
 
@@ -613,8 +891,8 @@ void ASTInterpreter::visit(ASTIfElse *ifelse)
 
 bool ASTInterpreter::visit_value(ASTCondExpr *condition)
 {
-	int ltree_val = condition->ltree->accept_value(this);
-	int rtree_val = condition->rtree->accept_value(this);
+	int64_t ltree_val = condition->ltree->accept_value(this);
+	int64_t rtree_val = condition->rtree->accept_value(this);
 
 	bool outcome;
 
@@ -664,29 +942,151 @@ void ASTInterpreter::visit(ASTWhileLoop *whileloop)
 	}
 }
 
-void ASTInterpreter::visit(ASTForLoop *forloop)
+bool ASTInterpreter::bitFillLoop(ASTForLoop *forloop)
 {
-	forloop->assignment->accept(this);
+	ASTAssignment *assignment = LoopIdiom::bitFill(forloop, symboltable);
+	if(!assignment)
+		return false;
+
+	int64_t lo = forloop->assignment->target->accept_value(this);
+	int64_t hi = forloop->ulimit->accept_value(this);
+	if(lo > hi)
+		return true;
+
+	symboltable[LoopIdiom::arrayName(assignment)]->fill(lo, hi, LoopIdiom::fillValue(assignment));
+	forloop->assignment->target->accept_value(this, hi + 1);
+	return true;
+}
+
+bool ASTInterpreter::bitScanLoop(ASTForLoop *forloop)
+{
+	ASTIfElse *ifelse = LoopIdiom::bitScan(forloop, symboltable);
+	if(!ifelse)
+		return false;
 
-	int i = forloop->assignment->target->accept_value(this);
-	int ulimit = forloop->ulimit->accept_value(this);
+	SymbolTableEntry *entry = symboltable[LoopIdiom::arrayName(ifelse)];
+	int64_t lexval = LoopIdiom::scanValue(ifelse);
+	int64_t lo = forloop->assignment->target->accept_value(this);
+	int64_t ulimit = forloop->ulimit->accept_value(this);
 
-	while(i <= ulimit)
+	for(int64_t i = lo; i <= ulimit; i++)
 	{
-		forloop->statements->accept(this);
-		ulimit = forloop->ulimit->accept_value(this);
-		if(forloop->increment)
-			i += forloop->increment->accept_value(this);
-		else
-			i += 1;
+		i = entry->scan(i, ulimit, lexval);
+		if(i > ulimit)
+			break;
+
 		forloop->assignment->target->accept_value(this, i);
+		ifelse->iftrue->accept(this);
 	}
+
+	if(lo <= ulimit)
+		forloop->assignment->target->accept_value(this, ulimit + 1);
+	return true;
+}
+
+void ASTInterpreter::visit(ASTForLoop *forloop)
+{
+	forloop->assignment->accept(this);
+
+	int64_t lo = forloop->assignment->target->accept_value(this);
+
+	// bool array fills and scans go a word at a time; negative starts take the slow
+	// path so that the bounds error is reported as usual
+	if(lo >= 0 && (bitFillLoop(forloop) || bitScanLoop(forloop)))
+		return;
+
+	int64_t ulimit = forloop->ulimit->accept_value(this);
+	int64_t step = 1;
+	if(forloop->increment)
+		step = forloop->increment->accept_value(this);
+
+	long long trips = LoopIdiom::tripCount(lo, ulimit, step);
+	if(forloop->schedule != sequential)
+		parallelLoop(forloop, lo, step, trips);
+	else
+		for(long long k = 0; k < trips; k++)
+		{
+			forloop->assignment->target->accept_value(this, wrapAdd(lo, wrapMul(k, step)));
+			forloop->statements->accept(this);
+		}
+	forloop->assignment->target->accept_value(this, wrapAdd(lo, wrapMul(trips, step)));
+}
+
+// Runs the iterations of a parallel for-loop in chunks on the thread pool. Each chunk
+// has an interpreter of its own, whose symbol table shares the arrays and the scalars
+// the loop only reads with this one, and has fresh entries for the iterator, the
+// private scalars and the partial results of reductions. See ASTDataSharing.
+void ASTInterpreter::parallelLoop(ASTForLoop *forloop, int64_t lo, int64_t step, long long trips)
+{
+	ASTDataSharing sharing(forloop, symboltable);
+	string iterator = forloop->assignment->target->var_name;
+	mutex combineLock;
+
+	flatb::OrderedOutput output;
+	flatb::Chunking chunking = forloop->schedule == dynamicchunks ? flatb::dynamicchunking : flatb::staticchunking;
+	flatb::ThreadPool::instance().parallelFor(trips, chunking, [&](int64_t first, int64_t last)
+	{
+		ASTInterpreter worker(symboltable);
+		vector<string> owned(sharing.privates.begin(), sharing.privates.end());
+		owned.push_back(iterator);
+		for(auto reduction: sharing.reductions)
+			owned.push_back(reduction.first);
+		for(auto name: owned)
+			worker.symboltable[name] = new SymbolTableEntry(name, symboltable[name]->isBit);
+
+		for(auto reduction: sharing.reductions)
+		{
+			int64_t identity = 0;
+			if(reduction.second == productreduction)
+				identity = 1;
+			else if(reduction.second == minreduction)
+				identity = INT64_MAX;
+			else if(reduction.second == maxreduction)
+				identity = INT64_MIN;
+			worker.symboltable[reduction.first]->setValue(identity);
+		}
+
+		output.chunk(first, [&]()
+		{
+			for(int64_t k = first; k < last; k++)
+			{
+				worker.symboltable[iterator]->setValue(wrapAdd(lo, wrapMul(k, step)));
+				forloop->statements->accept(&worker);
+			}
+		});
+
+		{
+			lock_guard<mutex> guard(combineLock);
+			for(auto reduction: sharing.reductions)
+			{
+				SymbolTableEntry *shared = symboltable[reduction.first];
+				int64_t partial = worker.symboltable[reduction.first]->getValue();
+				int64_t total = shared->getValue();
+				if(reduction.second == sumreduction)
+					total = wrapAdd(total, partial);
+				else if(reduction.second == productreduction)
+					total = wrapMul(total, partial);
+				else if(reduction.second == minreduction)
+					total = min(total, partial);
+				else
+					total = max(total, partial);
+				shared->setValue(total);
+			}
+
+			if(last == trips)
+				for(auto name: sharing.privates)
+					symboltable[name]->setValue(worker.symboltable[name]->getValue());
+		}
+
+		for(auto name: owned)
+			delete worker.symboltable[name];
+	});
 }
 
 
-int ASTInterpreter::visit_value(ASTMathExpr *mathexpr)
+int64_t ASTInterpreter::visit_value(ASTMathExpr *mathexpr)
 {
-	int ltree_val = 0, rtree_val = 0;
+	int64_t ltree_val = 0, rtree_val = 0;
 	if(mathexpr->ltree)
 		ltree_val = mathexpr->ltree->accept_value(this);
 	if(mathexpr->rtree)
@@ -695,23 +1095,23 @@ int ASTInterpreter::visit_value(ASTMathExpr *mathexpr)
 	switch(mathexpr->op)
 	{
 		case add:
-			return ltree_val + rtree_val;
+			return wrapAdd(ltree_val, rtree_val);
 			break;
 
 		case sub:
-			return ltree_val - rtree_val;
+			return wrapSub(ltree_val, rtree_val);
 			break;
 
 		case mult:
-			return ltree_val * rtree_val;
+			return wrapMul(ltree_val, rtree_val);
 			break;
 
 		case divd:
-			return ltree_val / rtree_val;
+			return wrapDiv(ltree_val, rtree_val);
 			break;
 
 		case usub:
-			return -rtree_val;
+			return wrapSub(0, rtree_val);
 			break;
 
 		case noop:
@@ -725,7 +1125,7 @@ void ASTInterpreter::visit(ASTMathExpr *mathexpr)
 	return;
 }
 
-int ASTInterpreter::visit_value(ASTInteger *integer)
+int64_t ASTInterpreter::visit_value(ASTInteger *integer)
 {
 	return integer->getValue();
 }
@@ -735,31 +1135,31 @@ void ASTInterpreter::visit(ASTInteger *integer)
 	return;
 }
 
-void ASTInterpreter::visit_value(ASTTargetVar *var_location, int value)
+void ASTInterpreter::visit_value(ASTTargetVar *var_location, int64_t value)
 {
 	if(var_location->array_type)
 	{
-		int index = var_location->rtree->accept_value(this);
+		int64_t index = var_location->rtree->accept_value(this);
 		symboltable[var_location->var_name]->setValue(index, value);
 	}
 	else
 		symboltable[var_location->var_name]->setValue(value);
 }
 
-int ASTInterpreter::visit_value(ASTTargetVar *var_location)
+int64_t ASTInterpreter::visit_value(ASTTargetVar *var_location)
 {
-	int sign = 1;
+	int64_t sign = 1;
 
 	if(var_location->op == usub)
 		sign = -1;
 
 	if(var_location->array_type)
 	{
-		int index = var_location->rtree->accept_value(this);
-		return sign * symboltable[var_location->var_name]->getValue(index);
+		int64_t index = var_location->rtree->accept_value(this);
+		return wrapMul(sign, symboltable[var_location->var_name]->getValue(index));
 	}
 	else
-		return sign * symboltable[var_location->var_name]->getValue();
+		return wrapMul(sign, symboltable[var_location->var_name]->getValue());
 }
 
 void ASTInterpreter::visit(ASTTargetVar *var_location)
@@ -769,10 +1169,59 @@ void ASTInterpreter::visit(ASTTargetVar *var_location)
 
 void ASTInterpreter::visit(ASTAssignment *assignment)
 {
-	int rexpr_value = assignment->rexpr->accept_value(this);
+	int64_t rexpr_value = assignment->rexpr->accept_value(this);
 	assignment->target->accept_value(this, rexpr_value);
 }
 
+void ASTInterpreter::visit(ASTBuiltinStatement *builtin)
+{
+	SymbolTableEntry *entry = symboltable[builtin->array];
+	int64_t value = builtin->builtin == fillbuiltin ? builtin->args[0]->accept_value(this) : 0;
+	int64_t lo = builtin->args[1]->accept_value(this);
+	int64_t hi = builtin->args[2]->accept_value(this);
+
+	int64_t *elements = entry->range(lo, hi);
+	if(lo > hi)
+		return;
+
+	if(builtin->builtin == fillbuiltin)
+		entry->fill(lo, hi, value);
+	else
+		__flatb_copy(elements, symboltable[builtin->source]->range(lo, hi), lo, hi);
+}
+
+int64_t ASTInterpreter::visit_value(ASTBuiltinExpr *builtin)
+{
+	vector<int64_t> values;
+	for(auto arg: builtin->args)
+		values.push_back(arg->accept_value(this));
+	int64_t lo = values[values.size() - 2], hi = values.back();
+	const int64_t *elements = symboltable[builtin->array]->range(lo, hi);
+
+	switch(builtin->builtin)
+	{
+		case sumbuiltin:
+			return __flatb_sum(elements, lo, hi);
+
+		case minbuiltin:
+			return __flatb_min(elements, lo, hi);
+
+		case maxbuiltin:
+			return __flatb_max(elements, lo, hi);
+
+		case countbuiltin:
+			return __flatb_count(elements, lo, hi, values[0]);
+
+		default:
+			return 0;
+	}
+}
+
+void ASTInterpreter::visit(ASTBuiltinExpr *builtin)
+{
+	return;
+}
+
 void ASTInterpreter::visit(ASTCodeBlock *code_block)
 {
 	for(vector<ASTCodeStatement *>::iterator it = code_block->statements.begin(); 
@@ -817,7 +1266,9 @@ void ASTInterpreter::visit(ASTDeclBlock *decl_block)
 
 void ASTInterpreter::visit(ASTProgram *program)
 {
-	cout << "------------------- INTERPRETER ------------------------" << endl;
+	countSymbolTable("interpreter", symboltable);
+	if(!quiet)
+		cout << "------------------- INTERPRETER ------------------------" << endl;
 	if(program->code_block)
 	{
 		try
@@ -833,94 +1284,1230 @@ void ASTInterpreter::visit(ASTProgram *program)
 
 /************************** End ASTInterpreter *******************************/
 
-/*************************** ASTIOBlock **************************************/
-ASTIOBlock::ASTIOBlock(IOInstruction iostmt, string output, ASTMathExpr *expr)
+/*************************** ASTEffects **************************************/
+ASTEffects::ASTEffects()
 {
-	this->iostmt = iostmt;
-	this->output = output.substr(1, output.size() - 2);  // to remove quotes
-	this->expr = expr;
+	io = false;
 }
 
-ASTIOBlock::ASTIOBlock(IOInstruction iostmt, ASTMathExpr *expr)
+void ASTEffects::visit(ASTIOBlock *ioblock)
 {
-	this->iostmt = iostmt;
-	this->expr = expr;
+	if(!ioblock->label.empty())
+		labels.insert(ioblock->label);
+	io = true;
+	if(ioblock->expr)
+		ioblock->expr->accept(this);
 }
 
-ASTIOBlock::ASTIOBlock(IOInstruction iostmt, string output): 
-							ASTIOBlock(iostmt, output, nullptr)
-{}
-
-ASTIOBlock::ASTIOBlock(IOInstruction iostmt): ASTIOBlock(iostmt, nullptr)
-{}
-
-void ASTIOBlock::accept(Visitor *v)
+void ASTEffects::visit(ASTGotoBlock *gotoblock)
 {
-	v->visit(this);
+	if(!gotoblock->label.empty())
+		labels.insert(gotoblock->label);
+	gotos.insert(gotoblock->targetlabel);
+	if(gotoblock->condition)
+		gotoblock->condition->accept(this);
 }
 
-Value *ASTIOBlock::codegen(CodeGenVisitor *v)
+void ASTEffects::visit(ASTIfElse *ifelse)
 {
-	return v->visit(this);
+	if(!ifelse->label.empty())
+		labels.insert(ifelse->label);
+	ifelse->condition->accept(this);
+	ifelse->iftrue->accept(this);
+	if(ifelse->iffalse)
+		ifelse->iffalse->accept(this);
 }
 
-/************************** End ASTIOBlock ***********************************/
-
-/*************************** ASTGotoBlock ************************************/
-ASTGotoBlock::ASTGotoBlock(string targetlabel, ASTCondExpr *condition)
+void ASTEffects::visit(ASTCondExpr *condition)
 {
-	this->targetlabel = targetlabel;
-	this->condition = condition;
+	condition->ltree->accept(this);
+	condition->rtree->accept(this);
 }
 
-ASTGotoBlock::ASTGotoBlock(string targetlabel): 
-									ASTGotoBlock(targetlabel, nullptr)
-{}
-
-void ASTGotoBlock::accept(Visitor *v)
+void ASTEffects::visit(ASTForLoop *forloop)
 {
-	v->visit(this);
+	if(!forloop->label.empty())
+		labels.insert(forloop->label);
+	forloop->assignment->accept(this);
+	forloop->ulimit->accept(this);
+	if(forloop->increment)
+		forloop->increment->accept(this);
+	forloop->statements->accept(this);
 }
 
-Value *ASTGotoBlock::codegen(CodeGenVisitor *v)
+void ASTEffects::visit(ASTWhileLoop *whileloop)
 {
-	return v->visit(this);
+	if(!whileloop->label.empty())
+		labels.insert(whileloop->label);
+	whileloop->condition->accept(this);
+	whileloop->statements->accept(this);
 }
 
-/************************** End ASTGotoBlock *********************************/
-
-/*************************** ASTIfElse ***************************************/
-ASTIfElse::ASTIfElse(ASTCondExpr *condition, ASTCodeBlock *iftrue, ASTCodeBlock *iffalse)
+void ASTEffects::visit(ASTMathExpr *mathexpr)
 {
-	this->condition = condition;
-	this->iftrue = iftrue;
-	this->iffalse = iffalse;
+	if(mathexpr->ltree)
+		mathexpr->ltree->accept(this);
+	if(mathexpr->rtree)
+		mathexpr->rtree->accept(this);
 }
 
-ASTIfElse::ASTIfElse(ASTCondExpr *condition, ASTCodeBlock *iftrue):
-										ASTIfElse(condition, iftrue, nullptr)
-{}
-
-void ASTIfElse::accept(Visitor *v)
+void ASTEffects::visit(ASTInteger *integer)
 {
-	v->visit(this);
+	return;
 }
 
-Value *ASTIfElse::codegen(CodeGenVisitor *v)
+void ASTEffects::visit(ASTTargetVar *var_location)
 {
-	return v->visit(this);
-}
-
-/************************** End ASTIfElse ************************************/
+	if(var_location->isTarget)
+		writes.insert(var_location->var_name);
+	else
+		reads.insert(var_location->var_name);
+
+	if(var_location->array_type)
+	{
+		elements.push_back(var_location);
+		var_location->rtree->accept(this);
+	}
+}
+
+void ASTEffects::visit(ASTAssignment *assignment)
+{
+	if(!assignment->label.empty())
+		labels.insert(assignment->label);
+	assignment->target->accept(this);
+	assignment->rexpr->accept(this);
+}
+
+void ASTEffects::visit(ASTBuiltinStatement *builtin)
+{
+	if(!builtin->label.empty())
+		labels.insert(builtin->label);
+	writes.insert(builtin->array);
+	rangeWrites.insert(builtin->array);
+	if(builtin->builtin == copybuiltin)
+	{
+		reads.insert(builtin->source);
+		rangeReads.insert(builtin->source);
+	}
+	else
+		builtin->args[0]->accept(this);
+	builtin->args[1]->accept(this);
+	builtin->args[2]->accept(this);
+}
+
+void ASTEffects::visit(ASTBuiltinExpr *builtin)
+{
+	reads.insert(builtin->array);
+	rangeReads.insert(builtin->array);
+	for(auto arg: builtin->args)
+		arg->accept(this);
+}
+
+void ASTEffects::visit(ASTCodeBlock *code_block)
+{
+	for(auto statement: code_block->statements)
+		statement->accept(this);
+}
+
+void ASTEffects::visit(ASTProgram *program)
+{
+	if(program->code_block)
+		program->code_block->accept(this);
+}
+
+/************************** End ASTEffects ***********************************/
+
+/*************************** ASTDataSharing **********************************/
+ASTDataSharing::ASTDataSharing(ASTForLoop *forloop, map<string, SymbolTableEntry *> symboltable)
+{
+	this->symboltable = symboltable;
+	this->iterator = forloop->assignment->target->var_name;
+
+	// a scalar that is also used outside its updates is not a reduction; walk the
+	// body again treating its updates as ordinary assignments
+	bool changed = true;
+	while(changed)
+	{
+		assigned.clear();
+		exposed.clear();
+		reads.clear();
+		written.clear();
+		updates.clear();
+		errors.clear();
+		assigned.insert(iterator);
+
+		forloop->statements->accept(this);
+
+		changed = false;
+		for(auto update: updates)
+			if(reads.count(update.first) || written.count(update.first))
+			{
+				excluded.insert(update.first);
+				changed = true;
+			}
+	}
+
+	for(auto update: updates)
+	{
+		if(update.second.size() > 1)
+			errors.push_back(update.first + " mixes different reductions in a parallel loop");
+		else
+			reductions[update.first] = *update.second.begin();
+	}
+
+	for(auto name: written)
+	{
+		if(name == iterator || updates.count(name))
+			continue;
+
+		if(exposed.count(name))
+			errors.push_back(name + " is read before it is assigned in a parallel loop");
+		else if(!assigned.count(name))
+			errors.push_back(name + " is not assigned in every iteration of a parallel loop");
+		else
+			privates.insert(name);
+	}
+}
+
+// The reduction statement performs, or noreduction if it is not one or updates
+// the iterator or a scalar that is used otherwise as well
+Reduction ASTDataSharing::reduction(ASTCodeStatement *statement, string &name, ASTMathExpr *&operand)
+{
+	Reduction kind = LoopIdiom::reduction(statement, symboltable, name, operand);
+	if(name == iterator || excluded.count(name))
+		return noreduction;
+	return kind;
+}
+
+void ASTDataSharing::visit(ASTIOBlock *ioblock)
+{
+	if(!ioblock->label.empty())
+		errors.push_back("label " + ioblock->label + " inside a parallel loop");
+	if(ioblock->iostmt == readvar)
+		errors.push_back("read inside a parallel loop");
+	if(ioblock->expr)
+		ioblock->expr->accept(this);
+}
+
+void ASTDataSharing::visit(ASTGotoBlock *gotoblock)
+{
+	errors.push_back("goto " + gotoblock->targetlabel + " inside a parallel loop");
+}
+
+void ASTDataSharing::visit(ASTIfElse *ifelse)
+{
+	string name;
+	ASTMathExpr *operand;
+	Reduction kind = reduction(ifelse, name, operand);
+	if(kind != noreduction)
+	{
+		updates[name].insert(kind);
+		operand->accept(this);
+		return;
+	}
+
+	if(!ifelse->label.empty())
+		errors.push_back("label " + ifelse->label + " inside a parallel loop");
+	ifelse->condition->accept(this);
+
+	set<string> before = assigned;
+	ifelse->iftrue->accept(this);
+	set<string> iftrue = assigned;
+
+	assigned = before;
+	if(ifelse->iffalse)
+		ifelse->iffalse->accept(this);
+
+	set<string> both;
+	for(auto name: iftrue)
+		if(assigned.count(name))
+			both.insert(name);
+	assigned = both;
+}
+
+void ASTDataSharing::visit(ASTCondExpr *condition)
+{
+	condition->ltree->accept(this);
+	condition->rtree->accept(this);
+}
+
+// A nested loop's body may not run, so it assigns nothing for certain beyond the
+// nested loop's own iterator
+void ASTDataSharing::visit(ASTForLoop *forloop)
+{
+	if(!forloop->label.empty())
+		errors.push_back("label " + forloop->label + " inside a parallel loop");
+	forloop->assignment->accept(this);
+	forloop->ulimit->accept(this);
+	if(forloop->increment)
+		forloop->increment->accept(this);
+
+	set<string> before = assigned;
+	forloop->statements->accept(this);
+	assigned = before;
+}
+
+void ASTDataSharing::visit(ASTWhileLoop *whileloop)
+{
+	if(!whileloop->label.empty())
+		errors.push_back("label " + whileloop->label + " inside a parallel loop");
+	whileloop->condition->accept(this);
+
+	set<string> before = assigned;
+	whileloop->statements->accept(this);
+	assigned = before;
+}
+
+void ASTDataSharing::visit(ASTMathExpr *mathexpr)
+{
+	if(mathexpr->ltree)
+		mathexpr->ltree->accept(this);
+	if(mathexpr->rtree)
+		mathexpr->rtree->accept(this);
+}
+
+void ASTDataSharing::visit(ASTInteger *integer)
+{
+	return;
+}
+
+// Array elements are shared; only scalars are tracked
+void ASTDataSharing::visit(ASTTargetVar *var_location)
+{
+	if(var_location->array_type)
+	{
+		var_location->rtree->accept(this);
+		return;
+	}
+
+	string name = var_location->var_name;
+	if(var_location->isTarget)
+	{
+		written.insert(name);
+		assigned.insert(name);
+	}
+	else
+	{
+		reads.insert(name);
+		if(!assigned.count(name))
+			exposed.insert(name);
+	}
+}
+
+void ASTDataSharing::visit(ASTAssignment *assignment)
+{
+	if(!assignment->label.empty())
+		errors.push_back("label " + assignment->label + " inside a parallel loop");
+
+	string name;
+	ASTMathExpr *operand;
+	Reduction kind = reduction(assignment, name, operand);
+	if(kind != noreduction)
+	{
+		updates[name].insert(kind);
+		operand->accept(this);
+		return;
+	}
+
+	assignment->rexpr->accept(this);
+	assignment->target->accept(this);
+}
+
+// Arrays are shared, so only the scalars in the arguments matter. Filling a bool
+// array writes whole words, which may hold elements other iterations are setting.
+void ASTDataSharing::visit(ASTBuiltinStatement *builtin)
+{
+	if(!builtin->label.empty())
+		errors.push_back("label " + builtin->label + " inside a parallel loop");
+	if(builtin->builtin == fillbuiltin && symboltable[builtin->array]->isBit)
+		errors.push_back("fill of bool array " + builtin->array + " inside a parallel loop");
+	if(builtin->builtin != copybuiltin)
+		builtin->args[0]->accept(this);
+	builtin->args[1]->accept(this);
+	builtin->args[2]->accept(this);
+}
+
+void ASTDataSharing::visit(ASTBuiltinExpr *builtin)
+{
+	for(auto arg: builtin->args)
+		arg->accept(this);
+}
+
+void ASTDataSharing::visit(ASTCodeBlock *code_block)
+{
+	for(auto statement: code_block->statements)
+		statement->accept(this);
+}
+
+/************************** End ASTDataSharing *******************************/
+
+/*************************** ASTAutoParallel *********************************/
+ASTAutoParallel::ASTAutoParallel(map<string, SymbolTableEntry *> symboltable)
+{
+	this->symboltable = symboltable;
+}
+
+// Adds scale * expr to terms (coefficients of scalars) and constant. False if expr
+// is not an affine function of scalars.
+bool ASTAutoParallel::affine(ASTMathExpr *expr, long long scale, map<string, long long> &terms, long long &constant)
+{
+	if(ASTInteger *integer = dynamic_cast<ASTInteger *>(expr))
+	{
+		constant += scale * integer->getValue();
+		return true;
+	}
+
+	if(ASTTargetVar *var = dynamic_cast<ASTTargetVar *>(expr))
+	{
+		if(var->array_type)
+			return false;
+		terms[var->var_name] += var->op == usub ? -scale : scale;
+		return true;
+	}
+
+	if(dynamic_cast<ASTBuiltinExpr *>(expr))
+		return false;
+
+	switch(expr->op)
+	{
+		case add:
+			return affine(expr->ltree, scale, terms, constant) && affine(expr->rtree, scale, terms, constant);
+
+		case sub:
+			return affine(expr->ltree, scale, terms, constant) && affine(expr->rtree, -scale, terms, constant);
+
+		case noop:
+			return affine(expr->rtree, scale, terms, constant);
+
+		case mult:
+		{
+			// one side has to be a constant
+			map<string, long long> factorTerms;
+			long long factor = 0;
+			if(affine(expr->ltree, 1, factorTerms, factor) && factorTerms.empty())
+				return affine(expr->rtree, scale * factor, terms, constant);
+
+			factorTerms.clear();
+			factor = 0;
+			if(affine(expr->rtree, 1, factorTerms, factor) && factorTerms.empty())
+				return affine(expr->ltree, scale * factor, terms, constant);
+			return false;
+		}
+
+		default:
+			return false;
+	}
+}
+
+static long long gcd(long long a, long long b)
+{
+	a = a < 0 ? -a : a;
+	b = b < 0 ? -b : b;
+	while(b)
+	{
+		long long t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// Empty if the iterations of forloop are independent, otherwise the reason they
+// may not be
+string ASTAutoParallel::dependence(ASTForLoop *forloop)
+{
+	string iterator = forloop->assignment->target->var_name;
+
+	ASTEffects effects;
+	forloop->statements->accept(&effects);
+	if(!effects.labels.empty())
+		return "body has a label";
+	if(!effects.gotos.empty())
+		return "body has a goto";
+	if(effects.io)
+		return "body prints or reads";
+	if(effects.writes.count(iterator))
+		return "body assigns the iterator";
+	if(!effects.rangeWrites.empty())
+		return "body fills or copies " + *effects.rangeWrites.begin();
+	for(auto name: effects.rangeReads)
+		if(effects.writes.count(name))
+			return "body reads a range of " + name + ", which it writes";
+
+	ASTDataSharing sharing(forloop, symboltable);
+	if(!sharing.errors.empty())
+		return sharing.errors[0];
+
+	long long step = 0;		// 0 if not known
+	if(!forloop->increment)
+		step = 1;
+	else if(ASTInteger *increment = dynamic_cast<ASTInteger *>(forloop->increment))
+		step = increment->getValue();
+
+	// every pair of accesses to the same array, at least one a write, in two
+	// different iterations i1 and i2, must address different elements
+	for(auto write: effects.elements)
+	{
+		if(!write->isTarget)
+			continue;
+
+		map<string, long long> writeTerms;
+		long long writeConstant = 0;
+		if(!affine(write->rtree, 1, writeTerms, writeConstant))
+			return "index of " + write->var_name + " is not affine";
+
+		for(auto other: effects.elements)
+		{
+			if(other->var_name != write->var_name)
+				continue;
+
+			map<string, long long> otherTerms;
+			long long otherConstant = 0;
+			if(!affine(other->rtree, 1, otherTerms, otherConstant))
+				return "index of " + other->var_name + " is not affine";
+
+			long long a = writeTerms[iterator], b = otherTerms[iterator];
+			writeTerms.erase(iterator);
+			otherTerms.erase(iterator);
+
+			// what is left must be the same loop-invariant offset on both sides
+			for(auto term: writeTerms)
+				if(term.second && effects.writes.count(term.first))
+					return "index of " + write->var_name + " depends on " + term.first + ", which the loop assigns";
+			for(auto term: otherTerms)
+				if(term.second && effects.writes.count(term.first))
+					return "index of " + other->var_name + " depends on " + term.first + ", which the loop assigns";
+
+			bool sameOffset = true;
+			for(auto term: writeTerms)
+				sameOffset = sameOffset && term.second == otherTerms[term.first];
+			for(auto term: otherTerms)
+				sameOffset = sameOffset && term.second == writeTerms[term.first];
+			writeTerms[iterator] = a;
+
+			string conflict = write->var_name + " may be written in one iteration and used in another";
+			if(!sameOffset)
+				return conflict;
+
+			// a * i1 + writeConstant == b * i2 + otherConstant
+			long long difference = otherConstant - writeConstant;
+			if(a == 0 && b == 0)
+			{
+				if(difference == 0)
+					return conflict;
+				continue;
+			}
+
+			long long divisor = gcd(a, b);
+			if(difference % divisor != 0)
+				continue;
+
+			if(a != b)
+				return conflict;
+
+			// i1 - i2 = difference / a, and iterators of different iterations differ
+			// by a non-zero multiple of the step
+			long long distance = difference / a;
+			if(distance == 0 || (step > 0 && distance % step != 0))
+				continue;
+			return conflict;
+		}
+	}
+
+	return "";
+}
+
+void ASTAutoParallel::visit(ASTIfElse *ifelse)
+{
+	ifelse->iftrue->accept(this);
+	if(ifelse->iffalse)
+		ifelse->iffalse->accept(this);
+}
+
+void ASTAutoParallel::visit(ASTForLoop *forloop)
+{
+	string loop = "line " + to_string(forloop->getLine()) + ": for " + forloop->assignment->target->var_name;
+	if(forloop->schedule != sequential)
+	{
+		report.push_back(loop + ": already parallel");
+		return;
+	}
+
+	string reason = dependence(forloop);
+	if(reason.empty())
+	{
+		forloop->setSchedule(staticchunks);
+		string reductions;
+		ASTDataSharing sharing(forloop, symboltable);
+		for(auto reduction: sharing.reductions)
+		{
+			const char *kinds[] = {"", "+", "*", "min", "max"};
+			reductions += (reductions.empty() ? ", reduction of " : ", ") + reduction.first + " (" + kinds[reduction.second] + ")";
+		}
+		report.push_back(loop + ": parallelized" + reductions);
+		return;
+	}
+
+	report.push_back(loop + ": not parallelized, " + reason);
+	forloop->statements->accept(this);
+}
+
+void ASTAutoParallel::visit(ASTWhileLoop *whileloop)
+{
+	whileloop->statements->accept(this);
+}
+
+void ASTAutoParallel::visit(ASTCodeBlock *code_block)
+{
+	for(auto statement: code_block->statements)
+		statement->accept(this);
+}
+
+void ASTAutoParallel::visit(ASTProgram *program)
+{
+	if(program->code_block)
+		program->code_block->accept(this);
+}
+
+/************************** End ASTAutoParallel ******************************/
+
+/*************************** ASTConstantFolder *******************************/
+ASTConstantFolder::ASTConstantFolder(map<string, SymbolTableEntry *> symboltable)
+{
+	this->symboltable = symboltable;
+	this->folded = nullptr;
+}
+
+// Returns the folded replacement for expr, which may be expr itself
+ASTMathExpr* ASTConstantFolder::fold(ASTMathExpr *expr)
+{
+	folded = expr;
+	expr->accept(this);
+	return folded;
+}
+
+// Drops what is known about every variable the subtree writes. A subtree with a
+// label can be entered from anywhere, so then nothing is known at all.
+void ASTConstantFolder::forget(ASTNode *node)
+{
+	ASTEffects effects;
+	node->accept(&effects);
+
+	if(!effects.labels.empty())
+	{
+		constants.clear();
+		return;
+	}
+
+	for(auto name: effects.writes)
+		constants.erase(name);
+}
+
+void ASTConstantFolder::visit(ASTIOBlock *ioblock)
+{
+	if(ioblock->iostmt == readvar)
+	{
+		ASTTargetVar *target = static_cast<ASTTargetVar *>(ioblock->expr);
+		if(target->array_type)
+			target->rtree = fold(target->rtree);
+		else
+			constants.erase(target->var_name);
+	}
+	else if(ioblock->expr)
+		ioblock->expr = fold(ioblock->expr);
+}
+
+void ASTConstantFolder::visit(ASTGotoBlock *gotoblock)
+{
+	if(gotoblock->condition)
+		gotoblock->condition->accept(this);
+}
+
+void ASTConstantFolder::visit(ASTIfElse *ifelse)
+{
+	ifelse->condition->accept(this);
+
+	map<string, int64_t> before = constants;
+	ifelse->iftrue->accept(this);
+	map<string, int64_t> iftrue = constants;
+
+	constants = before;
+	if(ifelse->iffalse)
+		ifelse->iffalse->accept(this);
+
+	// keep only what both branches agree on
+	for(auto it = constants.begin(); it != constants.end(); )
+	{
+		auto other = iftrue.find(it->first);
+		if(other == iftrue.end() || other->second != it->second)
+			it = constants.erase(it);
+		else
+			++it;
+	}
+}
+
+void ASTConstantFolder::visit(ASTCondExpr *condition)
+{
+	condition->ltree = fold(condition->ltree);
+	condition->rtree = fold(condition->rtree);
+
+	ASTInteger *lconst = dynamic_cast<ASTInteger *>(condition->ltree);
+	ASTInteger *rconst = dynamic_cast<ASTInteger *>(condition->rtree);
+	if(!lconst || !rconst)
+		return;
+
+	int64_t l = lconst->getValue(), r = rconst->getValue();
+	bool outcome = false;
+	switch(condition->condition)
+	{
+		case grt:	outcome = l > r;	break;
+		case geq:	outcome = l >= r;	break;
+		case les:	outcome = l < r;	break;
+		case leq:	outcome = l <= r;	break;
+		case neq:	outcome = l != r;	break;
+		case eqto:	outcome = l == r;	break;
+	}
+
+	// a constant condition is kept in the canonical form outcome != 0
+	condition->ltree = new ASTInteger(outcome != condition->unot);
+	condition->rtree = new ASTInteger(0);
+	condition->condition = neq;
+	condition->unot = false;
+}
+
+void ASTConstantFolder::visit(ASTForLoop *forloop)
+{
+	forloop->assignment->accept(this);
+
+	forget(forloop->statements);
+	constants.erase(forloop->assignment->target->var_name);
+	forloop->ulimit = fold(forloop->ulimit);
+	if(forloop->increment)
+		forloop->increment = fold(forloop->increment);
+
+	map<string, int64_t> header = constants;
+	forloop->statements->accept(this);
+	constants = header;
+}
+
+void ASTConstantFolder::visit(ASTWhileLoop *whileloop)
+{
+	forget(whileloop->statements);
+	whileloop->condition->accept(this);
+
+	map<string, int64_t> header = constants;
+	whileloop->statements->accept(this);
+	constants = header;
+}
+
+void ASTConstantFolder::visit(ASTMathExpr *mathexpr)
+{
+	if(mathexpr->ltree)
+		mathexpr->ltree = fold(mathexpr->ltree);
+	if(mathexpr->rtree)
+		mathexpr->rtree = fold(mathexpr->rtree);
+
+	folded = mathexpr;
+	if(mathexpr->op == noop)
+	{
+		folded = mathexpr->rtree;
+		return;
+	}
+
+	ASTInteger *lconst = dynamic_cast<ASTInteger *>(mathexpr->ltree);
+	ASTInteger *rconst = dynamic_cast<ASTInteger *>(mathexpr->rtree);
+	if(!rconst || (mathexpr->ltree && !lconst))
+		return;
+
+	// anything that overflows 64 bits is left for run time
+	int64_t l = lconst ? lconst->getValue() : 0, r = rconst->getValue();
+	int64_t result;
+	switch(mathexpr->op)
+	{
+		case add:
+			if(__builtin_add_overflow(l, r, &result))
+				return;
+			break;
+
+		case sub:
+			if(__builtin_sub_overflow(l, r, &result))
+				return;
+			break;
+
+		case mult:
+			if(__builtin_mul_overflow(l, r, &result))
+				return;
+			break;
+
+		case divd:
+			if(r == 0 || (l == INT64_MIN && r == -1))
+				return;
+			result = l / r;
+			break;
+
+		case usub:
+			if(__builtin_sub_overflow((int64_t)0, r, &result))
+				return;
+			break;
+
+		default:
+			return;
+	}
+
+	folded = new ASTInteger(result);
+}
+
+void ASTConstantFolder::visit(ASTInteger *integer)
+{
+	folded = integer;
+}
+
+void ASTConstantFolder::visit(ASTTargetVar *var_location)
+{
+	folded = var_location;
+
+	if(var_location->array_type)
+	{
+		var_location->rtree = fold(var_location->rtree);
+		folded = var_location;
+		return;
+	}
+
+	auto constant = constants.find(var_location->var_name);
+	if(constant == constants.end())
+		return;
+
+	if(var_location->op == usub)
+	{
+		if(constant->second != INT64_MIN)
+			folded = new ASTInteger(-constant->second);
+	}
+	else
+		folded = new ASTInteger(constant->second);
+}
+
+void ASTConstantFolder::visit(ASTAssignment *assignment)
+{
+	ASTTargetVar *target = assignment->target;
+	assignment->rexpr = fold(assignment->rexpr);
+
+	if(target->array_type)
+	{
+		target->rtree = fold(target->rtree);
+		return;
+	}
+
+	ASTInteger *constant = dynamic_cast<ASTInteger *>(assignment->rexpr);
+	if(!constant)
+	{
+		constants.erase(target->var_name);
+		return;
+	}
+
+	int64_t value = constant->getValue();
+	if(symboltable[target->var_name]->isBit)
+		value = value != 0;
+	constants[target->var_name] = value;
+}
+
+void ASTConstantFolder::visit(ASTBuiltinStatement *builtin)
+{
+	for(size_t i = builtin->builtin == copybuiltin ? 1 : 0; i < builtin->args.size(); i++)
+		builtin->args[i] = fold(builtin->args[i]);
+}
+
+void ASTConstantFolder::visit(ASTBuiltinExpr *builtin)
+{
+	for(auto &arg: builtin->args)
+		arg = fold(arg);
+	folded = builtin;
+}
+
+void ASTConstantFolder::visit(ASTCodeBlock *code_block)
+{
+	for(auto statement: code_block->statements)
+	{
+		if(!statement->label.empty())
+			constants.clear();
+		statement->accept(this);
+	}
+}
+
+void ASTConstantFolder::visit(ASTProgram *program)
+{
+	if(program->code_block)
+		program->code_block->accept(this);
+}
+
+/************************** End ASTConstantFolder ****************************/
+
+/*************************** LoopIdiom ***************************************/
+
+// True if expr is a plain read of the scalar name
+bool LoopIdiom::isScalarUse(ASTMathExpr *expr, string name)
+{
+	ASTTargetVar *var = dynamic_cast<ASTTargetVar *>(expr);
+	return var && var->var_name == name && !var->array_type && var->op == noop;
+}
+
+// True if the two expressions are written the same way, and so have the same value
+// when nothing is assigned between their evaluations
+bool LoopIdiom::sameExpr(ASTMathExpr *a, ASTMathExpr *b)
+{
+	if(!a || !b)
+		return a == b;
+
+	ASTInteger *integerA = dynamic_cast<ASTInteger *>(a), *integerB = dynamic_cast<ASTInteger *>(b);
+	if(integerA || integerB)
+		return integerA && integerB && integerA->getValue() == integerB->getValue();
+
+	ASTBuiltinExpr *builtinA = dynamic_cast<ASTBuiltinExpr *>(a), *builtinB = dynamic_cast<ASTBuiltinExpr *>(b);
+	if(builtinA || builtinB)
+	{
+		if(!builtinA || !builtinB || builtinA->builtin != builtinB->builtin || builtinA->array != builtinB->array)
+			return false;
+		for(size_t i = 0; i < builtinA->args.size(); i++)
+			if(!sameExpr(builtinA->args[i], builtinB->args[i]))
+				return false;
+		return true;
+	}
+
+	ASTTargetVar *varA = dynamic_cast<ASTTargetVar *>(a), *varB = dynamic_cast<ASTTargetVar *>(b);
+	if(varA || varB)
+		return varA && varB && varA->var_name == varB->var_name && varA->array_type == varB->array_type
+				&& varA->op == varB->op && (!varA->array_type || sameExpr(varA->rtree, varB->rtree));
+
+	return a->op == b->op && sameExpr(a->ltree, b->ltree) && sameExpr(a->rtree, b->rtree);
+}
+
+// The kind of reduction update statement is, with the scalar it updates in name and
+// the expression it combines into it in operand; noreduction if it is none
+Reduction LoopIdiom::reduction(ASTCodeStatement *statement, map<string, SymbolTableEntry *> &symboltable, string &name, ASTMathExpr *&operand)
+{
+	if(!statement->label.empty())
+		return noreduction;
+
+	Reduction kind = noreduction;
+	ASTAssignment *assignment = dynamic_cast<ASTAssignment *>(statement);
+	ASTIfElse *ifelse = dynamic_cast<ASTIfElse *>(statement);
+	if(ifelse)
+	{
+		vector<ASTCodeStatement *> &body = ifelse->iftrue->statements;
+		if(ifelse->iffalse || ifelse->condition->unot || body.size() != 1 || !body[0]->label.empty())
+			return noreduction;
+		assignment = dynamic_cast<ASTAssignment *>(body[0]);
+	}
+	if(!assignment)
+		return noreduction;
+
+	ASTTargetVar *target = assignment->target;
+	ASTMathExpr *expr = assignment->rexpr;
+	name = target->var_name;
+
+	SymbolTableEntry *entry = symboltable[name];
+	if(target->array_type || !entry || entry->isArray || entry->isBit)
+		return noreduction;
+
+	if(ifelse)
+	{
+		ASTCondExpr *condition = ifelse->condition;
+		bool less = condition->condition == les || condition->condition == leq;
+		bool greater = condition->condition == grt || condition->condition == geq;
+
+		// e < s and s > e both select the smaller value
+		if(isScalarUse(condition->rtree, name) && (less || greater))
+		{
+			operand = condition->ltree;
+			kind = less ? minreduction : maxreduction;
+		}
+		else if(isScalarUse(condition->ltree, name) && (less || greater))
+		{
+			operand = condition->rtree;
+			kind = greater ? minreduction : maxreduction;
+		}
+		else
+			return noreduction;
+
+		if(!sameExpr(operand, expr))
+			return noreduction;
+	}
+	else
+	{
+		if(dynamic_cast<ASTTargetVar *>(expr) || dynamic_cast<ASTInteger *>(expr))
+			return noreduction;
+		if(expr->op != add && expr->op != sub && expr->op != mult)
+			return noreduction;
+
+		if(isScalarUse(expr->ltree, name))
+			operand = expr->rtree;
+		else if(expr->op != sub && isScalarUse(expr->rtree, name))
+			operand = expr->ltree;
+		else
+			return noreduction;
+
+		kind = expr->op == mult ? productreduction : sumreduction;
+	}
+
+	ASTEffects effects;
+	operand->accept(&effects);
+	if(effects.reads.count(name))
+		return noreduction;
+
+	return kind;
+}
+
+// Scalars whose every use in the body of forloop is a reduction update outside any
+// nested loop. Iterations of the loop can pass such a scalar on in a register. A body
+// with labels or gotos has none.
+set<string> LoopIdiom::accumulators(ASTForLoop *forloop, map<string, SymbolTableEntry *> &symboltable)
+{
+	set<string> updated, used, result;
+
+	ASTEffects effects;
+	forloop->statements->accept(&effects);
+	if(!effects.labels.empty() || !effects.gotos.empty())
+		return result;
+
+	accumulatorUses(forloop->statements, symboltable, updated, used);
+	used.insert(forloop->assignment->target->var_name);
+
+	for(auto name: updated)
+		if(!used.count(name))
+			result.insert(name);
+	return result;
+}
+
+// Adds the scalars code_block updates by reductions outside nested loops to updated,
+// and the ones it uses any other way to used
+void LoopIdiom::accumulatorUses(ASTCodeBlock *code_block, map<string, SymbolTableEntry *> &symboltable, set<string> &updated, set<string> &used)
+{
+	for(auto statement: code_block->statements)
+	{
+		string name;
+		ASTMathExpr *operand;
+		if(reduction(statement, symboltable, name, operand) != noreduction)
+		{
+			updated.insert(name);
+			ASTEffects effects;
+			operand->accept(&effects);
+			used.insert(effects.reads.begin(), effects.reads.end());
+			continue;
+		}
+
+		ASTIfElse *ifelse = dynamic_cast<ASTIfElse *>(statement);
+		if(!ifelse)
+		{
+			ASTEffects effects;
+			statement->accept(&effects);
+			used.insert(effects.reads.begin(), effects.reads.end());
+			used.insert(effects.writes.begin(), effects.writes.end());
+			continue;
+		}
+
+		ASTEffects effects;
+		ifelse->condition->accept(&effects);
+		used.insert(effects.reads.begin(), effects.reads.end());
+		accumulatorUses(ifelse->iftrue, symboltable, updated, used);
+		if(ifelse->iffalse)
+			accumulatorUses(ifelse->iffalse, symboltable, updated, used);
+	}
+}
+
+// True if the loop steps by one
+bool LoopIdiom::isUnitLoop(ASTForLoop *forloop)
+{
+	if(!forloop->increment)
+		return true;
+
+	ASTInteger *step = dynamic_cast<ASTInteger *>(forloop->increment);
+	return step && step->getValue() == 1;
+}
+
+// Iterations of a counted loop from lo to hi in steps of step, as documented on
+// ASTForLoop. A non-positive step runs no iterations.
+long long LoopIdiom::tripCount(long long lo, long long hi, long long step)
+{
+	if(step <= 0 || lo > hi)
+		return 0;
+	return ((unsigned long long)hi - lo) / step + 1;
+}
+
+ASTAssignment* LoopIdiom::bitFill(ASTForLoop *forloop, map<string, SymbolTableEntry *> &symboltable)
+{
+	vector<ASTCodeStatement *> &body = forloop->statements->statements;
+	if(body.size() != 1 || !body[0]->label.empty())
+		return nullptr;
+
+	ASTAssignment *assignment = dynamic_cast<ASTAssignment *>(body[0]);
+	if(!assignment || !assignment->target->array_type)
+		return nullptr;
+
+	SymbolTableEntry *entry = symboltable[assignment->target->var_name];
+	if(!entry || !entry->isArray || !entry->isBit)
+		return nullptr;
+
+	if(!isScalarUse(assignment->target->rtree, forloop->assignment->target->var_name))
+		return nullptr;
+
+	if(!dynamic_cast<ASTInteger *>(assignment->rexpr))
+		return nullptr;
+
+	return isUnitLoop(forloop) ? assignment : nullptr;
+}
+
+ASTIfElse* LoopIdiom::bitScan(ASTForLoop *forloop, map<string, SymbolTableEntry *> &symboltable)
+{
+	vector<ASTCodeStatement *> &body = forloop->statements->statements;
+	if(body.size() != 1 || !body[0]->label.empty())
+		return nullptr;
+
+	ASTIfElse *ifelse = dynamic_cast<ASTIfElse *>(body[0]);
+	if(!ifelse || ifelse->iffalse)
+		return nullptr;
+
+	ASTTargetVar *element = dynamic_cast<ASTTargetVar *>(ifelse->condition->ltree);
+	if(!element || !element->array_type || element->op != noop)
+		return nullptr;
+
+	SymbolTableEntry *entry = symboltable[element->var_name];
+	if(!entry || !entry->isArray || !entry->isBit)
+		return nullptr;
+
+	if(!isScalarUse(element->rtree, forloop->assignment->target->var_name) || scanValue(ifelse) < 0)
+		return nullptr;
+
+	ASTEffects effects;
+	ifelse->iftrue->accept(&effects);
+	if(!effects.gotos.empty() || !effects.labels.empty())
+		return nullptr;
+
+	return isUnitLoop(forloop) ? ifelse : nullptr;
+}
+
+// The bit value a scan looks for, or -1 if the condition does not test a single bit
+int64_t LoopIdiom::scanValue(ASTIfElse *ifelse)
+{
+	ASTCondExpr *condition = ifelse->condition;
+	ASTInteger *constant = dynamic_cast<ASTInteger *>(condition->rtree);
+	if(!constant || (condition->condition != eqto && condition->condition != neq))
+		return -1;
+
+	int64_t lexval = constant->getValue();
+	if(lexval != 0 && lexval != 1)
+		return -1;
+
+	if(condition->condition == neq)
+		lexval = !lexval;
+	if(condition->unot)
+		lexval = !lexval;
+	return lexval;
+}
+
+string LoopIdiom::arrayName(ASTAssignment *assignment)
+{
+	return assignment->target->var_name;
+}
+
+string LoopIdiom::arrayName(ASTIfElse *ifelse)
+{
+	return static_cast<ASTTargetVar *>(ifelse->condition->ltree)->var_name;
+}
+
+int64_t LoopIdiom::fillValue(ASTAssignment *assignment)
+{
+	return static_cast<ASTInteger *>(assignment->rexpr)->getValue() != 0;
+}
+
+/************************** End LoopIdiom ************************************/
+
+/*************************** ASTIOBlock **************************************/
+ASTIOBlock::ASTIOBlock(IOInstruction iostmt, string output, ASTMathExpr *expr)
+{
+	this->iostmt = iostmt;
+	this->output = output.substr(1, output.size() - 2);  // to remove quotes
+	this->expr = expr;
+}
+
+ASTIOBlock::ASTIOBlock(IOInstruction iostmt, ASTMathExpr *expr)
+{
+	this->iostmt = iostmt;
+	this->expr = expr;
+}
+
+ASTIOBlock::ASTIOBlock(IOInstruction iostmt, string output): 
+							ASTIOBlock(iostmt, output, nullptr)
+{}
+
+ASTIOBlock::ASTIOBlock(IOInstruction iostmt): ASTIOBlock(iostmt, nullptr)
+{}
+
+void ASTIOBlock::accept(Visitor *v)
+{
+	v->visit(this);
+}
+
+Value *ASTIOBlock::codegen(CodeGenVisitor *v)
+{
+	return v->visit(this);
+}
+
+/************************** End ASTIOBlock ***********************************/
+
+/*************************** ASTGotoBlock ************************************/
+ASTGotoBlock::ASTGotoBlock(string targetlabel, ASTCondExpr *condition)
+{
+	this->targetlabel = targetlabel;
+	this->condition = condition;
+}
+
+ASTGotoBlock::ASTGotoBlock(string targetlabel): 
+									ASTGotoBlock(targetlabel, nullptr)
+{}
+
+void ASTGotoBlock::accept(Visitor *v)
+{
+	v->visit(this);
+}
+
+Value *ASTGotoBlock::codegen(CodeGenVisitor *v)
+{
+	return v->visit(this);
+}
+
+/************************** End ASTGotoBlock *********************************/
+
+/*************************** ASTIfElse ***************************************/
+ASTIfElse::ASTIfElse(ASTCondExpr *condition, ASTCodeBlock *iftrue, ASTCodeBlock *iffalse)
+{
+	this->condition = condition;
+	this->iftrue = iftrue;
+	this->iffalse = iffalse;
+}
+
+ASTIfElse::ASTIfElse(ASTCondExpr *condition, ASTCodeBlock *iftrue):
+										ASTIfElse(condition, iftrue, nullptr)
+{}
+
+void ASTIfElse::accept(Visitor *v)
+{
+	v->visit(this);
+}
+
+Value *ASTIfElse::codegen(CodeGenVisitor *v)
+{
+	return v->visit(this);
+}
+
+/************************** End ASTIfElse ************************************/
 
 /*************************** ASTInteger **************************************/
 
-ASTInteger::ASTInteger(int lexval)
+ASTInteger::ASTInteger(int64_t lexval)
 {
 	this->lexval = lexval;
 }
 
-int ASTInteger::getValue()
+int64_t ASTInteger::getValue()
 {
 	return this->lexval;
 }
@@ -930,7 +2517,7 @@ void ASTInteger::accept(Visitor *v)
 	v->visit(this);
 }
 
-int ASTInteger::accept_value(Visitor *v)
+int64_t ASTInteger::accept_value(Visitor *v)
 {
 	return v->visit_value(this);
 }
@@ -998,7 +2585,7 @@ void ASTMathExpr::accept(Visitor *v)
 	v->visit(this);
 }
 
-int ASTMathExpr::accept_value(Visitor *v)
+int64_t ASTMathExpr::accept_value(Visitor *v)
 {
 	return v->visit_value(this);
 }
@@ -1049,12 +2636,12 @@ void ASTTargetVar::accept(Visitor *v)
 	v->visit(this);
 }
 
-void ASTTargetVar::accept_value(Visitor *v, int value)
+void ASTTargetVar::accept_value(Visitor *v, int64_t value)
 {
 	v->visit_value(this, value);
 }
 
-int ASTTargetVar::accept_value(Visitor *v)
+int64_t ASTTargetVar::accept_value(Visitor *v)
 {
 	return v->visit_value(this);
 }
@@ -1066,6 +2653,33 @@ Value *ASTTargetVar::codegen(CodeGenVisitor *v)
 
 /************************** End ASTTargetVar *********************************/
 
+/*************************** ASTBuiltinExpr **********************************/
+ASTBuiltinExpr::ASTBuiltinExpr(string name, string array, vector<ASTMathExpr *> args):
+	ASTMathExpr(nullptr, nullptr, noop)
+{
+	this->name = name;
+	this->array = array;
+	this->builtin = toBuiltin(name);
+	this->args = args;
+}
+
+void ASTBuiltinExpr::accept(Visitor *v)
+{
+	v->visit(this);
+}
+
+int64_t ASTBuiltinExpr::accept_value(Visitor *v)
+{
+	return v->visit_value(this);
+}
+
+Value *ASTBuiltinExpr::codegen(CodeGenVisitor *v)
+{
+	return v->visit(this);
+}
+
+/************************** End ASTBuiltinExpr *******************************/
+
 /*************************** ASTWhileLoop ************************************/
 ASTWhileLoop::ASTWhileLoop(ASTCondExpr *condition, ASTCodeBlock *statements)
 {
@@ -1093,6 +2707,7 @@ ASTForLoop::ASTForLoop(ASTAssignment *assignment, ASTMathExpr *ulimit,
 	this->ulimit = ulimit;
 	this->increment = increment;
 	this->statements = statements;
+	this->schedule = sequential;
 }
 
 ASTForLoop::ASTForLoop(ASTAssignment *assignment, ASTMathExpr *ulimit,
@@ -1131,6 +2746,28 @@ Value *ASTAssignment::codegen(CodeGenVisitor *v)
 
 /************************** End ASTAssignment ********************************/
 
+/*************************** ASTBuiltinStatement *****************************/
+ASTBuiltinStatement::ASTBuiltinStatement(string name, string array, ASTMathExpr *first,
+				ASTMathExpr *lo, ASTMathExpr *hi)
+{
+	this->name = name;
+	this->array = array;
+	this->builtin = toBuiltin(name);
+	this->args = {first, lo, hi};
+}
+
+void ASTBuiltinStatement::accept(Visitor *v)
+{
+	v->visit(this);
+}
+
+Value *ASTBuiltinStatement::codegen(CodeGenVisitor *v)
+{
+	return v->visit(this);
+}
+
+/************************** End ASTBuiltinStatement **************************/
+
 /*************************** ASTCodeStatement ********************************/
 
 void ASTCodeStatement::setLabel(string label)
@@ -1188,6 +2825,11 @@ void ASTVariable::setDataType(string data_type)
 	this->data_type = data_type;
 }
 
+bool ASTVariable::isBitType()
+{
+	return data_type == "bool" || data_type == "bit";
+}
+
 void ASTVariable::accept(Visitor *v)
 {
 	v->visit(this);
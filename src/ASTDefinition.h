@@ -1,8 +1,13 @@
 #include <iostream>
+#include <fstream>
+#include <cstdio>
 #include <string>
 #include <vector>
 #include <stack>
 #include <map>
+#include <set>
+#include <cstdint>
+#include <chrono>
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
@@ -11,10 +16,12 @@
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Target/TargetMachine.h"
 
 using namespace std;
 using namespace llvm;
@@ -22,11 +29,75 @@ using namespace llvm;
 enum Operation {add, sub, mult, divd, usub, noop};
 enum Condition {grt, geq, les, leq, neq, eqto};
 enum IOInstruction {print, println, readvar};
+enum Schedule {sequential, staticchunks, dynamicchunks};
+enum Reduction {noreduction, sumreduction, productreduction, minreduction, maxreduction};
+enum Builtin {nobuiltin, fillbuiltin, copybuiltin, sumbuiltin, minbuiltin, maxbuiltin, countbuiltin};
+
+// Set by bcc -q: nothing but the program's own output goes to stdout
+extern bool quiet;
+
+// Parses a program, returning false on a syntax error. The parser keeps its state in
+// globals, so calls from several threads take turns.
+bool parseProgram(FILE *, class ASTProgram *&);
+
+// bcc --service: runs the programs listed in a job file, see Service.cpp
+int runService(const char *, bool);
+
+// bcc with several files: compiles them as a pipeline, see Pipeline.cpp
+int compileBatch(vector<string>, bool, bool, bool, bool, bool);
+
+// bcc --time-report: prints how long each phase of the run took, and how memory grew
+// meanwhile, when bcc exits; as JSON if asked. See TimeReport.cpp.
+void enableTimeReport(bool);
+
+// bcc --trace: writes the phases of the run, and what the interpreter runs, as Chrome
+// trace events when bcc exits. Slices nest in the ones open around them; the LLVM
+// passes timed since the last call are added to the slice open now. See Trace.cpp.
+void enableTrace(string, string);
+bool traceEnabled();
+void traceBegin(string, const char *, string);
+void traceEnd();
+void tracePasses(vector<pair<string, double>> &);
+
+// bcc --mem-report: counts the bytes held by the lexer's strings, the AST by kind of
+// node, the symbol tables and the LLVM module, and the heap's high-water mark in
+// each phase, and prints them when bcc exits; as JSON if asked. See MemReport.cpp.
+void enableMemReport(bool);
+bool memReportEnabled();
+void countLexeme(int);
+void countAST(class ASTProgram *);
+void countSymbolTable(const char *, const map<string, class SymbolTableEntry *> &);
+void countModule(Module &);
+void memoryPhaseBegin(const char *);
+void memoryPhaseEnd();
+
+// Times the code from its construction to its destruction as a phase of the report,
+// nested in the phases open around it, and traces it with --trace; --mem-report
+// follows the heap over it. Does nothing unless one of them is enabled.
+class TimedPhase
+{
+	private:
+		struct PhaseRow *row;
+		bool traced;
+		bool measured;
+
+	public:
+		TimedPhase(const char *);
+		~TimedPhase();
+};
+
+// Thrown by ASTVisitor for a program that is not valid FlatB
+struct SemanticError
+{
+	vector<string> errors;
+	SemanticError(string error) { errors.push_back(error); }
+	SemanticError(vector<string> errors): errors(errors) {}
+};
 
 // This is the union NODE, which will be used in bison
 union NODE
 {
-	int number;
+	long long number;
 	char *string;
 	class ASTIOBlock *ioblock;
 	class ASTGotoBlock *gotoblock;
@@ -38,6 +109,8 @@ union NODE
 	class ASTInteger *integer;
 	class ASTTargetVar *var_location;
 	class ASTAssignment *assignment;
+	class ASTBuiltinStatement *builtin;
+	class ASTBuiltinExpr *builtin_expr;
 	class ASTCodeStatement *code_statement;
 	class ASTCodeBlock *code_block;
 	class ASTVariable *variable;
@@ -60,6 +133,8 @@ union NODE
 		integer = nullptr;
 		var_location = nullptr;
 		assignment = nullptr;
+		builtin = nullptr;
+		builtin_expr = nullptr;
 		code_statement = nullptr;
 		code_block = nullptr;
 		variable = nullptr;
@@ -75,6 +150,8 @@ union NODE
 
 typedef union NODE YYSTYPE;
 #define YYSTYPE_IS_DECLARED 1
+// NODE only holds pointers, so bison may copy its stack to grow it
+#define YYSTYPE_IS_TRIVIAL 1
 
 // The base virtual class for Visitor Design Pattern
 class Visitor
@@ -90,6 +167,8 @@ class Visitor
 		virtual void visit(ASTInteger 		*) = 0;
 		virtual void visit(ASTTargetVar 	*) = 0;
 		virtual void visit(ASTAssignment 	*) = 0;
+		virtual void visit(ASTBuiltinStatement *) = 0;
+		virtual void visit(ASTBuiltinExpr 	*) = 0;
 		virtual void visit(ASTCodeBlock 	*) = 0;
 		virtual void visit(ASTVariable 		*) = 0;
 		virtual void visit(ASTVariableSet 	*) = 0;
@@ -98,61 +177,141 @@ class Visitor
 		virtual void visit(ASTProgram 		*) = 0;
 
 		virtual bool visit_value(ASTCondExpr *) = 0;
-		virtual int  visit_value(ASTMathExpr *) = 0;
-		virtual int  visit_value(ASTTargetVar*) = 0;
-		virtual int  visit_value(ASTInteger  *) = 0;
-		virtual void visit_value(ASTTargetVar*, int) = 0;
+		virtual int64_t visit_value(ASTMathExpr *) = 0;
+		virtual int64_t visit_value(ASTTargetVar*) = 0;
+		virtual int64_t visit_value(ASTInteger  *) = 0;
+		virtual int64_t visit_value(ASTBuiltinExpr *) = 0;
+		virtual void visit_value(ASTTargetVar*, int64_t) = 0;
 };
 
 class ASTNode
 {
 	protected:
 		ASTNode *parent;
+		int line;					// source line, 0 if not known
 
 	public:
+		ASTNode();
 		void setParent(ASTNode *);
 		ASTNode* getParent();
+		void setLine(int line) { this->line = line; }
+		int getLine() { return line; }
 		virtual void accept(Visitor *) = 0;
 		virtual Value* codegen(class CodeGenVisitor *) = 0;
 };
 
-// Symbol Table Entry class, whose objects will be stored in a map
+// Symbol Table Entry class, whose objects will be stored in a map. Threads of the
+// interpreter may get and set different elements of an array at the same time.
 class SymbolTableEntry
 {
+	friend class ASTMemory;
 	private:
 		string identifier;
 		unsigned int size;
-		int *value;
+		int64_t *value;				// 64 bits an element, as the runtime's kernels expect
+		uint64_t *bits;				// packed storage for bool arrays, 64 elements a word
 		ASTCodeStatement *node;
 
 	public:
 		bool isArray;
-		SymbolTableEntry(string, unsigned int);
-		SymbolTableEntry(string);
+		bool isBit;
+		SymbolTableEntry(string, unsigned int, bool);
+		SymbolTableEntry(string, bool);
 		SymbolTableEntry(string, ASTCodeStatement*);
+		~SymbolTableEntry();
 		ASTCodeStatement* getLabelPtr();
-		int getValue(unsigned int);
-		int getValue();
-		void setValue(unsigned int, int);
-		void setValue(int);
+		int64_t getValue(int64_t);
+		int64_t getValue();
+		void setValue(int64_t, int64_t);
+		void setValue(int64_t);
+		void fill(int64_t, int64_t, int64_t);
+		int64_t scan(int64_t, int64_t, int64_t);
+		int64_t* range(int64_t, int64_t);
+		bool contains(int64_t);
 };
 
+// Each CodeGenVisitor builds its module in an LLVMContext of its own, so programs
+// can be compiled on several threads at once
 class CodeGenVisitor
 {
 	private:
+		LLVMContext TheContext;
+		IRBuilder<> Builder;
+		unique_ptr<Module> TheModule;
+		unique_ptr<TargetMachine> machine;	// created by -O or -c
 		stack<BasicBlock *> blocks;
 		map<string, Value*> variables;
+		map<string, Value*> inductions;		// for-loop iterators held in registers
+		map<string, Value*> accumulators;	// reduction variables held in registers
 		map<string, BasicBlock*> labels;
+		multiset<string> gotos;
 		map<string, SymbolTableEntry *> symboltable;
 		Function *mainFunction;
 		Function *Print, *Scan;
+		Function *BitFill, *BitScan;
+		GlobalVariable *readBuffer;
+		Function *ParallelFor, *OrderedPrint;
+		bool inParallel;			// generating the body of a parallel loop
+		DIBuilder *DBuilder;		// only set when debug info is requested
+		DICompileUnit *compileUnit;
+		DIFile *sourceFile;
+		bool optimizing, objects, outlining;
+		vector<BasicBlock *> enteredBlocks;
 		int errors;
+		bool instrumenting;			// bcc --instrument
+		string tracePath;			// bcc --trace
+		set<ASTCodeStatement *> tracedStatements;
+		Function *TraceStatement;
+		string profilePath, profileShape;
+		vector<uint64_t> profileCounts;	// read by --use-profile
+
+		Value* bitWord(ASTTargetVar *, Value **);
+		Value* storeBit(ASTTargetVar *, Value *);
+		Function* bitFillFunction();
+		Function* bitScanFunction();
+		Value* bitFillLoop(ASTForLoop *, ASTAssignment *);
+		Value* bitScanLoop(ASTForLoop *, ASTIfElse *);
+		Value* tripCount(Value *, Value *, Value *);
+		Value* countedLoopInMemory(ASTForLoop *, Value *, Value *, Value *, Value *);
+		Value* parallelLoop(ASTForLoop *);
+		Function* parallelWorker(ASTForLoop *, class ASTDataSharing &);
+		Function* parallelForFunction();
+		Function* orderedPrintFunction();
+		Function* kernelFunction(string, Type *, vector<Type *>, bool);
+		void vectorizeHint(BranchInst *);
+		Value* elementAddress(string, Value *);
+		void attachAliasInfo();
+		DIType* debugType(ASTVariable *);
+		void setDebugLocation(int, BasicBlock *, Instruction *, BasicBlock *, size_t);
+		Type* IntType();
+		Constant* stringConstant(string);
+		TargetMachine* targetMachine();
+		bool emitPartitions(string);
+		void generateStatement(ASTCodeStatement *);
+		bool outlinable(ASTCodeStatement *);
+		void outlineRegions(ASTCodeBlock *);
+		void outline(vector<ASTCodeStatement *> &, size_t, size_t);
+		void instrument();
+		void applyProfile();
+		void traceStatement(ASTCodeStatement *, BasicBlock *, Instruction *);
+		void traceWrite(string);
 
 	public:
 		CodeGenVisitor(map<string, SymbolTableEntry *> st);
 		void generateCode(ASTProgram*, string);
+		bool buildModule(ASTProgram*, string);
+		void optimize();
+		bool emit(string);
+		unique_ptr<Module> takeModule() { return move(TheModule); }
+		void enableDebugInfo();
+		void enableOptimization();
+		void enableObjectOutput();
+		void enableOutlining();
+		void enableInstrumentation(string);
+		bool useProfile(string);
+		void enableTracing(string);
 		BasicBlock *currentBlock() { return blocks.top(); }
-		void pushBlock(BasicBlock *block) {blocks.push(block); }
+		void pushBlock(BasicBlock *block) {blocks.push(block); if(DBuilder) enteredBlocks.push_back(block); }
 		void popBlock() { blocks.pop(); }
 
 		Value* checkLabel(ASTCodeStatement*);
@@ -166,6 +325,8 @@ class CodeGenVisitor
 		Value* visit(ASTInteger 		*);
 		Value* visit(ASTTargetVar 		*);
 		Value* visit(ASTAssignment 		*);
+		Value* visit(ASTBuiltinStatement *);
+		Value* visit(ASTBuiltinExpr 	*);
 		Value* visit(ASTCodeBlock 		*);
 		Value* visit(ASTVariable 		*);
 		Value* visit(ASTVariableSet 	*);
@@ -179,10 +340,17 @@ class ASTVisitor: public Visitor
 {
 	private:
 		map<string, SymbolTableEntry *> symboltable;
+		ofstream file;
+		ostream xml;
+		int tabs;
+
+		void insertTabs();
 
 	public:
-		ASTVisitor();
+		ASTVisitor();				// writes AST_XML.xml
+		ASTVisitor(streambuf *);
 		void printLabel(ASTCodeStatement *);
+		SymbolTableEntry* builtinArray(string, string, bool);
 		map<string, SymbolTableEntry *> getSymbolTable();
 
 		void visit(ASTIOBlock *);
@@ -195,6 +363,8 @@ class ASTVisitor: public Visitor
 		void visit(ASTInteger *);
 		void visit(ASTTargetVar *);
 		void visit(ASTAssignment *);
+		void visit(ASTBuiltinStatement *);
+		void visit(ASTBuiltinExpr *);
 		void visit(ASTCodeBlock *);
 		void visit(ASTVariable *);
 		void visit(ASTVariableSet *);
@@ -203,10 +373,11 @@ class ASTVisitor: public Visitor
 		void visit(ASTProgram *);
 
 		bool visit_value(ASTCondExpr *) { return true; }
-		int  visit_value(ASTMathExpr *) { return 0; }
-		int  visit_value(ASTTargetVar*) { return 0; }
-		int  visit_value(ASTInteger  *) { return 0; }
-		void visit_value(ASTTargetVar*, int) { return; }
+		int64_t visit_value(ASTMathExpr *) { return 0; }
+		int64_t visit_value(ASTTargetVar*) { return 0; }
+		int64_t visit_value(ASTInteger  *) { return 0; }
+		int64_t visit_value(ASTBuiltinExpr *) { return 0; }
+		void visit_value(ASTTargetVar*, int64_t) { return; }
 };
 
 // The derived ASTInterpreter class for interpreter
@@ -216,6 +387,10 @@ class ASTInterpreter: public Visitor
 		map<string, SymbolTableEntry *> symboltable;
 		ASTCodeStatement *nextGotoNode;
 
+		bool bitFillLoop(ASTForLoop *);
+		bool bitScanLoop(ASTForLoop *);
+		void parallelLoop(ASTForLoop *, int64_t, int64_t, long long);
+
 	public:
 		ASTInterpreter(map<string, SymbolTableEntry *>);
 		void visit(ASTIOBlock *);
@@ -228,6 +403,78 @@ class ASTInterpreter: public Visitor
 		void visit(ASTInteger *);
 		void visit(ASTTargetVar *);
 		void visit(ASTAssignment *);
+		void visit(ASTBuiltinStatement *);
+		void visit(ASTBuiltinExpr *);
+		void visit(ASTCodeBlock *);
+		void visit(ASTVariable *);
+		void visit(ASTVariableSet *);
+		void visit(ASTDeclStatement *);
+		void visit(ASTDeclBlock *);
+		void visit(ASTProgram *);
+
+		bool visit_value(ASTCondExpr *);
+		int64_t visit_value(ASTMathExpr *);
+		int64_t visit_value(ASTTargetVar*);
+		int64_t visit_value(ASTInteger  *);
+		int64_t visit_value(ASTBuiltinExpr *);
+		void visit_value(ASTTargetVar*, int64_t);
+};
+
+// bcc --profile runs the program with ASTProfiler, an interpreter that also counts
+// and times every statement, condition and loop it runs, and counts its visits by
+// node kind. The plain interpreter is untouched, so profiling costs nothing when
+// off. See Profiler.cpp for the reports.
+class ASTProfiler: public ASTInterpreter
+{
+	public:
+		struct Stats
+		{
+			const char *kind;
+			int line;
+			uint64_t count;				// executions, or evaluations of a condition
+			uint64_t iterations;		// of a loop's body; times true for a condition
+			double total, self;			// seconds, with and without what ran inside
+		};
+
+	private:
+		struct Frame
+		{
+			Stats *stats;
+			chrono::steady_clock::time_point started;
+			double inner;				// seconds spent in profiled nodes inside
+		};
+
+		// Ends the timing of the node entered last, also when a goto leaves it
+		struct Scope
+		{
+			ASTProfiler *profiler;
+			~Scope() { profiler->leave(); }
+		};
+
+		string filename;
+		map<ASTNode *, Stats> stats;
+		vector<Frame> frames;
+		vector<uint64_t> visits;		// by node kind
+
+		Stats& enter(ASTNode *, const char *);
+		void leave();
+		void report();
+		void annotate();
+
+	public:
+		ASTProfiler(map<string, SymbolTableEntry *>, string);
+		void visit(ASTIOBlock *);
+		void visit(ASTGotoBlock *);
+		void visit(ASTIfElse *);
+		void visit(ASTCondExpr *);
+		void visit(ASTForLoop *);
+		void visit(ASTWhileLoop *);
+		void visit(ASTMathExpr *);
+		void visit(ASTInteger *);
+		void visit(ASTTargetVar *);
+		void visit(ASTAssignment *);
+		void visit(ASTBuiltinStatement *);
+		void visit(ASTBuiltinExpr *);
 		void visit(ASTCodeBlock *);
 		void visit(ASTVariable *);
 		void visit(ASTVariableSet *);
@@ -236,10 +483,281 @@ class ASTInterpreter: public Visitor
 		void visit(ASTProgram *);
 
 		bool visit_value(ASTCondExpr *);
-		int  visit_value(ASTMathExpr *);
-		int  visit_value(ASTTargetVar*);
-		int  visit_value(ASTInteger  *);
-		void visit_value(ASTTargetVar*, int);
+		int64_t visit_value(ASTMathExpr *);
+		int64_t visit_value(ASTTargetVar*);
+		int64_t visit_value(ASTInteger  *);
+		int64_t visit_value(ASTBuiltinExpr *);
+		void visit_value(ASTTargetVar*, int64_t);
+};
+
+// Runs a program like ASTInterpreter, recording a trace slice for every top-level
+// statement and every loop it executes, for bcc --trace. See Trace.cpp.
+class ASTTracer: public ASTInterpreter
+{
+	private:
+		// Ends the slice opened last, also when a goto leaves it
+		struct Scope
+		{
+			bool traced;
+			~Scope() { if(traced) traceEnd(); }
+		};
+
+		set<ASTCodeStatement *> topLevel;
+
+		bool enter(ASTCodeStatement *, const char *);
+
+	public:
+		ASTTracer(map<string, SymbolTableEntry *>);
+		void visit(ASTIOBlock *);
+		void visit(ASTGotoBlock *);
+		void visit(ASTIfElse *);
+		void visit(ASTForLoop *);
+		void visit(ASTWhileLoop *);
+		void visit(ASTAssignment *);
+		void visit(ASTBuiltinStatement *);
+		void visit(ASTProgram *);
+};
+
+// The derived ASTMemory class counts the nodes of a tree and the bytes they hold for
+// --mem-report, and the bytes of a symbol table
+class ASTMemory: public Visitor
+{
+	public:
+		ASTMemory();
+		static void symbolTable(const char *, const map<string, SymbolTableEntry *> &);
+		void visit(ASTIOBlock *);
+		void visit(ASTGotoBlock *);
+		void visit(ASTIfElse *);
+		void visit(ASTCondExpr *);
+		void visit(ASTForLoop *);
+		void visit(ASTWhileLoop *);
+		void visit(ASTMathExpr *);
+		void visit(ASTInteger *);
+		void visit(ASTTargetVar *);
+		void visit(ASTAssignment *);
+		void visit(ASTBuiltinStatement *);
+		void visit(ASTBuiltinExpr *);
+		void visit(ASTCodeBlock *);
+		void visit(ASTVariable *);
+		void visit(ASTVariableSet *);
+		void visit(ASTDeclStatement *);
+		void visit(ASTDeclBlock *);
+		void visit(ASTProgram *);
+
+		bool visit_value(ASTCondExpr *) { return true; }
+		int64_t visit_value(ASTMathExpr *) { return 0; }
+		int64_t visit_value(ASTTargetVar*) { return 0; }
+		int64_t visit_value(ASTInteger  *) { return 0; }
+		int64_t visit_value(ASTBuiltinExpr *) { return 0; }
+		void visit_value(ASTTargetVar*, int64_t) { return; }
+};
+
+// The derived ASTEffects class collects what a subtree reads, writes and jumps to
+class ASTEffects: public Visitor
+{
+	public:
+		set<string> reads;
+		set<string> writes;
+		set<string> labels;
+		multiset<string> gotos;
+		vector<ASTTargetVar *> elements;	// array element accesses
+		set<string> rangeReads, rangeWrites;	// arrays builtins work on a range of
+		bool io;
+
+		ASTEffects();
+		void visit(ASTIOBlock *);
+		void visit(ASTGotoBlock *);
+		void visit(ASTIfElse *);
+		void visit(ASTCondExpr *);
+		void visit(ASTForLoop *);
+		void visit(ASTWhileLoop *);
+		void visit(ASTMathExpr *);
+		void visit(ASTInteger *);
+		void visit(ASTTargetVar *);
+		void visit(ASTAssignment *);
+		void visit(ASTBuiltinStatement *);
+		void visit(ASTBuiltinExpr *);
+		void visit(ASTCodeBlock *);
+		void visit(ASTVariable *) { return; }
+		void visit(ASTVariableSet *) { return; }
+		void visit(ASTDeclStatement *) { return; }
+		void visit(ASTDeclBlock *) { return; }
+		void visit(ASTProgram *);
+
+		bool visit_value(ASTCondExpr *) { return true; }
+		int64_t visit_value(ASTMathExpr *) { return 0; }
+		int64_t visit_value(ASTTargetVar*) { return 0; }
+		int64_t visit_value(ASTInteger  *) { return 0; }
+		int64_t visit_value(ASTBuiltinExpr *) { return 0; }
+		void visit_value(ASTTargetVar*, int64_t) { return; }
+};
+
+// The derived ASTDataSharing class decides how a parallel for-loop's iterations
+// share the scalars its body assigns. The iterator is private to each iteration. A
+// scalar only ever updated by one kind of LoopIdiom::reduction is a reduction: each
+// thread accumulates its own partial result and the partials are combined into the
+// shared scalar after the loop. Any other scalar the body assigns must be assigned
+// on every path before it is read; it is private, and after the loop holds the
+// value from the last iteration. Anything else, and any label, goto or read
+// statement in the body, is reported in errors.
+class ASTDataSharing: public Visitor
+{
+	private:
+		map<string, SymbolTableEntry *> symboltable;
+		string iterator;
+		set<string> assigned;		// assigned on every path so far in this iteration
+		set<string> exposed;		// read before being assigned
+		set<string> reads, written;
+		map<string, set<Reduction> > updates;
+		set<string> excluded;		// updated like reductions but also used otherwise
+
+		Reduction reduction(ASTCodeStatement *, string &, ASTMathExpr *&);
+
+	public:
+		set<string> privates;
+		map<string, Reduction> reductions;
+		vector<string> errors;
+
+		ASTDataSharing(ASTForLoop *, map<string, SymbolTableEntry *>);
+		void visit(ASTIOBlock *);
+		void visit(ASTGotoBlock *);
+		void visit(ASTIfElse *);
+		void visit(ASTCondExpr *);
+		void visit(ASTForLoop *);
+		void visit(ASTWhileLoop *);
+		void visit(ASTMathExpr *);
+		void visit(ASTInteger *);
+		void visit(ASTTargetVar *);
+		void visit(ASTAssignment *);
+		void visit(ASTBuiltinStatement *);
+		void visit(ASTBuiltinExpr *);
+		void visit(ASTCodeBlock *);
+		void visit(ASTVariable *) { return; }
+		void visit(ASTVariableSet *) { return; }
+		void visit(ASTDeclStatement *) { return; }
+		void visit(ASTDeclBlock *) { return; }
+		void visit(ASTProgram *) { return; }
+
+		bool visit_value(ASTCondExpr *) { return true; }
+		int64_t visit_value(ASTMathExpr *) { return 0; }
+		int64_t visit_value(ASTTargetVar*) { return 0; }
+		int64_t visit_value(ASTInteger  *) { return 0; }
+		int64_t visit_value(ASTBuiltinExpr *) { return 0; }
+		void visit_value(ASTTargetVar*, int64_t) { return; }
+};
+
+// The derived ASTAutoParallel class marks sequential for-loops whose iterations are
+// independent as parallel, and reports on every loop it looked at. A loop qualifies
+// when its scalars can be shared as described at ASTDataSharing, it has no labels,
+// gotos or I/O, it does not assign its iterator, and no array element one iteration
+// writes is touched by another. Element indices are compared as affine functions of
+// the iterator; an index that is not affine, or that depends on a scalar the loop
+// assigns, is assumed to conflict. Loops inside a parallel loop are left alone.
+class ASTAutoParallel: public Visitor
+{
+	private:
+		map<string, SymbolTableEntry *> symboltable;
+
+		string dependence(ASTForLoop *);
+		bool affine(ASTMathExpr *, long long, map<string, long long> &, long long &);
+
+	public:
+		vector<string> report;
+
+		ASTAutoParallel(map<string, SymbolTableEntry *>);
+		void visit(ASTIOBlock *) { return; }
+		void visit(ASTGotoBlock *) { return; }
+		void visit(ASTIfElse *);
+		void visit(ASTCondExpr *) { return; }
+		void visit(ASTForLoop *);
+		void visit(ASTWhileLoop *);
+		void visit(ASTMathExpr *) { return; }
+		void visit(ASTInteger *) { return; }
+		void visit(ASTTargetVar *) { return; }
+		void visit(ASTAssignment *) { return; }
+		void visit(ASTBuiltinStatement *) { return; }
+		void visit(ASTBuiltinExpr *) { return; }
+		void visit(ASTCodeBlock *);
+		void visit(ASTVariable *) { return; }
+		void visit(ASTVariableSet *) { return; }
+		void visit(ASTDeclStatement *) { return; }
+		void visit(ASTDeclBlock *) { return; }
+		void visit(ASTProgram *);
+
+		bool visit_value(ASTCondExpr *) { return true; }
+		int64_t visit_value(ASTMathExpr *) { return 0; }
+		int64_t visit_value(ASTTargetVar*) { return 0; }
+		int64_t visit_value(ASTInteger  *) { return 0; }
+		int64_t visit_value(ASTBuiltinExpr *) { return 0; }
+		void visit_value(ASTTargetVar*, int64_t) { return; }
+};
+
+// The derived ASTConstantFolder class folds constant expressions and propagates scalar
+// constants through straight-line code, rewriting the tree in place. Labels are merge
+// points: nothing is known about any variable at a labelled statement.
+class ASTConstantFolder: public Visitor
+{
+	private:
+		map<string, SymbolTableEntry *> symboltable;
+		map<string, int64_t> constants;
+		ASTMathExpr *folded;
+
+		ASTMathExpr* fold(ASTMathExpr *);
+		void forget(ASTNode *);
+
+	public:
+		ASTConstantFolder(map<string, SymbolTableEntry *>);
+		void visit(ASTIOBlock *);
+		void visit(ASTGotoBlock *);
+		void visit(ASTIfElse *);
+		void visit(ASTCondExpr *);
+		void visit(ASTForLoop *);
+		void visit(ASTWhileLoop *);
+		void visit(ASTMathExpr *);
+		void visit(ASTInteger *);
+		void visit(ASTTargetVar *);
+		void visit(ASTAssignment *);
+		void visit(ASTBuiltinStatement *);
+		void visit(ASTBuiltinExpr *);
+		void visit(ASTCodeBlock *);
+		void visit(ASTVariable *) { return; }
+		void visit(ASTVariableSet *) { return; }
+		void visit(ASTDeclStatement *) { return; }
+		void visit(ASTDeclBlock *) { return; }
+		void visit(ASTProgram *);
+
+		bool visit_value(ASTCondExpr *) { return true; }
+		int64_t visit_value(ASTMathExpr *) { return 0; }
+		int64_t visit_value(ASTTargetVar*) { return 0; }
+		int64_t visit_value(ASTInteger  *) { return 0; }
+		int64_t visit_value(ASTBuiltinExpr *) { return 0; }
+		void visit_value(ASTTargetVar*, int64_t) { return; }
+};
+
+// Matchers for for-loops that the engines lower to word-level bool array operations.
+//   fill:  for i = lo, hi { a[i] = c; }
+//   scan:  for i = lo, hi { if a[i] == c { ... } }
+// and for the reduction updates of integer scalars that loops may accumulate in
+// registers or per thread, where e does not read s:
+//   sum:      s = s + e, s = e + s, s = s - e
+//   product:  s = s * e, s = e * s
+//   min:      if e < s { s = e; }, also with <= or with s > e, s >= e
+//   max:      if e > s { s = e; }, also with >= or with s < e, s <= e
+struct LoopIdiom
+{
+	static bool isScalarUse(ASTMathExpr *, string);
+	static bool sameExpr(ASTMathExpr *, ASTMathExpr *);
+	static Reduction reduction(ASTCodeStatement *, map<string, SymbolTableEntry *> &, string &, ASTMathExpr *&);
+	static set<string> accumulators(ASTForLoop *, map<string, SymbolTableEntry *> &);
+	static void accumulatorUses(ASTCodeBlock *, map<string, SymbolTableEntry *> &, set<string> &, set<string> &);
+	static bool isUnitLoop(ASTForLoop *);
+	static long long tripCount(long long, long long, long long);
+	static ASTAssignment* bitFill(ASTForLoop *, map<string, SymbolTableEntry *> &);
+	static ASTIfElse* bitScan(ASTForLoop *, map<string, SymbolTableEntry *> &);
+	static int64_t scanValue(ASTIfElse *);
+	static string arrayName(ASTAssignment *);
+	static string arrayName(ASTIfElse *);
+	static int64_t fillValue(ASTAssignment *);
 };
 
 class ASTCondExpr: public ASTNode
@@ -247,6 +765,12 @@ class ASTCondExpr: public ASTNode
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		ASTMathExpr *ltree, *rtree;
 		Condition condition;
@@ -265,8 +789,14 @@ class ASTMathExpr: public ASTNode
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	protected:
-		ASTMathExpr *ltree, *rtree;
+		ASTMathExpr *ltree = nullptr, *rtree = nullptr;
 		Operation op;
 		ASTMathExpr();
 
@@ -275,7 +805,7 @@ class ASTMathExpr: public ASTNode
 		ASTMathExpr(ASTMathExpr *, Operation);
 		void accept(Visitor *);
 		Value* codegen(CodeGenVisitor*);
-		virtual int accept_value(Visitor *);
+		virtual int64_t accept_value(Visitor *);
 };
 
 class ASTInteger: public ASTMathExpr
@@ -283,15 +813,21 @@ class ASTInteger: public ASTMathExpr
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
-		int lexval;
+		int64_t lexval;
 
 	public:
-		ASTInteger(int);
-		int getValue();
+		ASTInteger(int64_t);
+		int64_t getValue();
 		void accept(Visitor *);
 		Value* codegen(CodeGenVisitor*);
-		int  accept_value(Visitor *);
+		int64_t accept_value(Visitor *);
 };
 
 class ASTTargetVar: public ASTMathExpr
@@ -299,6 +835,12 @@ class ASTTargetVar: public ASTMathExpr
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		string var_name;
 		bool array_type;
@@ -313,8 +855,34 @@ class ASTTargetVar: public ASTMathExpr
 		void setTarget() { isTarget = true; }
 		void accept(Visitor *);
 		Value* codegen(CodeGenVisitor*);
-		int  accept_value(Visitor *);
-		void accept_value(Visitor *, int);
+		int64_t accept_value(Visitor *);
+		void accept_value(Visitor *, int64_t);
+};
+
+// A builtin expression reduces the elements lo..hi (inclusive) of an int array:
+//   sum(a, lo, hi), min(a, lo, hi), max(a, lo, hi), count(a, v, lo, hi)
+// min and max of an empty range are 0. Both engines call the runtime's kernels.
+class ASTBuiltinExpr: public ASTMathExpr
+{
+	friend class ASTVisitor;
+	friend class ASTInterpreter;
+	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
+	private:
+		string name, array;
+		Builtin builtin;
+		vector<ASTMathExpr *> args;		// lo and hi, after v for count
+
+	public:
+		ASTBuiltinExpr(string, string, vector<ASTMathExpr *>);
+		void accept(Visitor *);
+		Value* codegen(CodeGenVisitor*);
+		int64_t accept_value(Visitor *);
 };
 
 class ASTCodeStatement: public ASTNode
@@ -322,6 +890,12 @@ class ASTCodeStatement: public ASTNode
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	protected:
 		string label;
 
@@ -335,6 +909,12 @@ class ASTIOBlock: public ASTCodeStatement
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		IOInstruction iostmt;
 		string output;
@@ -354,6 +934,12 @@ class ASTGotoBlock: public ASTCodeStatement
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		string targetlabel;
 		ASTCondExpr *condition;
@@ -369,6 +955,12 @@ class ASTIfElse: public ASTCodeStatement
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		ASTCondExpr *condition;
 		ASTCodeBlock *iftrue, *iffalse;
@@ -384,6 +976,12 @@ class ASTWhileLoop: public ASTCodeStatement
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		ASTCondExpr *condition;
 		ASTCodeBlock *statements;
@@ -394,19 +992,33 @@ class ASTWhileLoop: public ASTCodeStatement
 		Value* codegen(CodeGenVisitor*);		
 };
 
+// for i = lo, hi, step { ... } is a counted loop. i is assigned lo, then hi and step
+// are evaluated once. The body runs (hi - lo) / step + 1 times, or not at all if
+// lo > hi or step <= 0, with i set to lo + k * step at the start of iteration k;
+// assignments to i inside the body do not change the count. Afterwards i holds
+// lo + trips * step. A parallel for runs its iterations on several threads; see
+// ASTDataSharing for what its body may do with scalars.
 class ASTForLoop: public ASTCodeStatement
 {
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		ASTAssignment *assignment;
 		ASTMathExpr *ulimit, *increment;
 		ASTCodeBlock *statements;
+		Schedule schedule;
 
 	public:
 		ASTForLoop(ASTAssignment *, ASTMathExpr *, ASTMathExpr *, ASTCodeBlock *);
 		ASTForLoop(ASTAssignment *, ASTMathExpr *, ASTCodeBlock *);
+		void setSchedule(Schedule schedule) { this->schedule = schedule; }
 		void accept(Visitor *);
 		Value* codegen(CodeGenVisitor*);
 };
@@ -416,6 +1028,12 @@ class ASTAssignment: public ASTCodeStatement
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		ASTTargetVar *target;
 		ASTMathExpr *rexpr;
@@ -426,11 +1044,46 @@ class ASTAssignment: public ASTCodeStatement
 		Value* codegen(CodeGenVisitor*);
 };
 
+// A builtin statement sets the elements lo..hi (inclusive) of an array:
+//   fill a, v, lo, hi;		each to v; a may be a bool array
+//   copy a, b, lo, hi;		each to the same element of b; both are int arrays
+// fill and copy are not keywords, so the parser accepts any name here and ASTVisitor
+// rejects the unknown ones.
+class ASTBuiltinStatement: public ASTCodeStatement
+{
+	friend class ASTVisitor;
+	friend class ASTInterpreter;
+	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
+	private:
+		string name, array;
+		Builtin builtin;
+		vector<ASTMathExpr *> args;		// v or b, lo, hi
+		string source;					// b of a copy, set by ASTVisitor
+
+	public:
+		ASTBuiltinStatement(string, string, ASTMathExpr *, ASTMathExpr *, ASTMathExpr *);
+		void accept(Visitor *);
+		Value* codegen(CodeGenVisitor*);
+};
+
 class ASTCodeBlock: public ASTNode
 {
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend class ASTTracer;
+	friend struct LoopIdiom;
 	private:
 		vector<ASTCodeStatement *> statements;
 
@@ -446,6 +1099,12 @@ class ASTVariable: public ASTNode
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		string var_name;
 		string data_type;
@@ -456,6 +1115,7 @@ class ASTVariable: public ASTNode
 		ASTVariable(string, bool, unsigned int);
 		ASTVariable(string, bool);
 		void setDataType(string);
+		bool isBitType();
 		void accept(Visitor *);
 		Value* codegen(CodeGenVisitor*);
 };
@@ -465,6 +1125,12 @@ class ASTVariableSet: public ASTNode
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		vector<ASTVariable *> variables;
 
@@ -480,6 +1146,12 @@ class ASTDeclStatement: public ASTNode
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		vector<ASTVariable *> variables;
 
@@ -494,6 +1166,12 @@ class ASTDeclBlock: public ASTNode
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend struct LoopIdiom;
 	private:
 		vector<ASTDeclStatement *> statements;
 
@@ -509,6 +1187,13 @@ class ASTProgram: public ASTNode
 	friend class ASTVisitor;
 	friend class ASTInterpreter;
 	friend class CodeGenVisitor;
+	friend class ASTEffects;
+	friend class ASTConstantFolder;
+	friend class ASTDataSharing;
+	friend class ASTAutoParallel;
+	friend class ASTMemory;
+	friend class ASTTracer;
+	friend struct LoopIdiom;
 	private:
 		ASTDeclBlock *decl_block;
 		ASTCodeBlock *code_block;
@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <stack>
 #include <map>
+#include <mutex>
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
@@ -20,24 +21,43 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/CodeGen/ParallelCG.h"
+#include "runtime/ThreadPool.h"
 
 using namespace std;
 using namespace llvm;
 
-static LLVMContext TheContext;
-static IRBuilder<> Builder(TheContext);
-static unique_ptr<Module> TheModule;
-
-Type* IntType()
+Type* CodeGenVisitor::IntType()
 {
 	return Type::getInt64Ty(TheModule->getContext());
 }
 
+// A pointer to the first character of a constant, NUL-terminated copy of text
+Constant* CodeGenVisitor::stringConstant(string text)
+{
+	Constant *data = ConstantDataArray::getString(TheContext, text);
+	GlobalVariable *gv = new GlobalVariable(*TheModule, data->getType(), true, GlobalValue::PrivateLinkage, data, "");
+	gv->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+	Constant *zero = ConstantInt::get(Type::getInt32Ty(TheContext), 0);
+	Constant *indices[] = { zero, zero };
+	return ConstantExpr::getInBoundsGetElementPtr(gv->getValueType(), gv, indices);
+}
+
 Value* CodeGenVisitor::checkLabel(ASTCodeStatement *statement)
 {
 	if(!statement->label.empty())
@@ -61,63 +81,608 @@ Value* CodeGenVisitor::checkLabel(ASTCodeStatement *statement)
 
 void CodeGenVisitor::generateCode(ASTProgram *program, string filename)
 {
-	FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), false);
-	mainFunction = Function::Create(ftype, GlobalValue::InternalLinkage, "main", TheModule.get());
+	{
+		TimedPhase phase("codegen");
+		if(!buildModule(program, filename))
+			exit(1);
+	}
+	if(optimizing)
+	{
+		TimedPhase phase("optimize");
+		optimize();
+	}
+
+	if(!quiet)
+	{
+		TimedPhase phase("print IR");
+		cout << "LLVM IR Code" << endl;
+		cout << "--------------------------------" << endl;
+		cout << endl;
+
+		legacy::PassManager PM;
+		PM.add(createPrintModulePass(outs()));
+		PM.run(*TheModule);
+		outs().flush();
+	}
+
+	countModule(*TheModule);
+	TimedPhase phase(objects ? "write object" : "write .ll");
+	if(!emit(filename))
+		exit(1);
+}
+
+// Writes the module next to the program, as filename.ll or, with -c, as an object
+// file filename.o for the host
+bool CodeGenVisitor::emit(string filename)
+{
+	if(objects && outlining)
+		return emitPartitions(filename);
+
+	if(objects)
+	{
+		TargetMachine *machine = targetMachine();
+		if(!machine)
+			return false;
+
+		error_code error;
+		raw_fd_ostream object(filename + ".o", error, sys::fs::F_None);
+		if(error)
+		{
+			cerr << "[ERROR] Cannot write " << filename << ".o: " << error.message() << endl;
+			return false;
+		}
+		legacy::PassManager PM;
+		machine->addPassesToEmitFile(PM, object, TargetMachine::CGFT_ObjectFile);
+		PM.run(*TheModule);
+		return true;
+	}
+
+	filename = filename + ".ll";
+
+	int fileDescriptor = open (filename.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0777);
+	raw_fd_ostream OS(fileDescriptor, true);
+	// WriteBitcodeToFile(TheModule.get(), OS);
+	TheModule->print(OS, NULL);
+	OS.flush();
+	OS.close();
+	close(fileDescriptor);
+	return true;
+}
+
+// A TargetMachine for the host CPU
+static TargetMachine* hostMachine()
+{
+	static std::once_flag initialized;
+	std::call_once(initialized, []()
+	{
+		InitializeNativeTarget();
+		InitializeNativeTargetAsmPrinter();
+	});
+
+	string triple = sys::getDefaultTargetTriple(), error;
+	const Target *target = TargetRegistry::lookupTarget(triple, error);
+	if(!target)
+	{
+		cerr << "[ERROR] " << error << endl;
+		return nullptr;
+	}
+	return target->createTargetMachine(triple, sys::getHostCPUName(), "", TargetOptions(), Reloc::PIC_);
+}
+
+// The TargetMachine that optimize and emit share; the module takes on its triple and
+// data layout
+TargetMachine* CodeGenVisitor::targetMachine()
+{
+	if(!machine)
+	{
+		machine.reset(hostMachine());
+		if(!machine)
+			return nullptr;
+		TheModule->setTargetTriple(machine->getTargetTriple().str());
+		TheModule->setDataLayout(machine->createDataLayout());
+	}
+	return machine.get();
+}
+
+// With -foutline-loops, -c splits the module and generates the parts on as many
+// threads as the thread pool has. They are written as filename.o, filename.1.o and
+// so on, and are linked together.
+bool CodeGenVisitor::emitPartitions(string filename)
+{
+	if(!targetMachine())
+		return false;
+
+	unsigned count = flatb::ThreadPool::instance().size();
+	vector<unique_ptr<raw_fd_ostream>> files;
+	vector<raw_pwrite_stream *> streams;
+	for(unsigned i = 0; i < count; i++)
+	{
+		string name = filename + (i ? "." + to_string(i) : "") + ".o";
+		error_code error;
+		files.emplace_back(new raw_fd_ostream(name, error, sys::fs::F_None));
+		if(error)
+		{
+			cerr << "[ERROR] Cannot write " << name << ": " << error.message() << endl;
+			return false;
+		}
+		streams.push_back(files.back().get());
+	}
+
+	TheModule = splitCodeGen(move(TheModule), streams, {},
+		[]() { return unique_ptr<TargetMachine>(hostMachine()); }, TargetMachine::CGFT_ObjectFile);
+	return true;
+}
+
+// The -O2 pipeline with the loop and SLP vectorizers, using the host's cost model
+void CodeGenVisitor::optimize()
+{
+	TargetMachine *machine = targetMachine();
+
+	PassManagerBuilder builder;
+	builder.OptLevel = 2;
+	builder.LoopVectorize = true;
+	builder.SLPVectorize = true;
+
+	legacy::FunctionPassManager FPM(TheModule.get());
+	legacy::PassManager MPM;
+	if(machine)
+	{
+		FPM.add(createTargetTransformInfoWrapperPass(machine->getTargetIRAnalysis()));
+		MPM.add(createTargetTransformInfoWrapperPass(machine->getTargetIRAnalysis()));
+	}
+	builder.populateFunctionPassManager(FPM);
+	builder.populateModulePassManager(MPM);
+
+	FPM.doInitialization();
+	for(Function &function: *TheModule)
+		FPM.run(function);
+	FPM.doFinalization();
+	MPM.run(*TheModule);
+}
+
+// Generates the module for program without printing or writing it anywhere; false
+// if there were errors. filename is only used for the debug info.
+bool CodeGenVisitor::buildModule(ASTProgram *program, string filename)
+{
+	// int main(), so that the program exits with status 0 when run by lli or linked
+	FunctionType *ftype = FunctionType::get(Type::getInt32Ty(TheContext), false);
+	mainFunction = Function::Create(ftype, GlobalValue::ExternalLinkage, "main", TheModule.get());
 	BasicBlock *bblock = BasicBlock::Create(TheContext, "entry", mainFunction, 0);
 
 	FunctionType *ptype = FunctionType::get(IntegerType::getInt32Ty(TheContext), PointerType::get(Type::getInt8Ty(TheContext), 0), true );
 	Print = dynamic_cast<Function *>(TheModule->getOrInsertFunction("printf", ptype));
 	Scan = dynamic_cast<Function *>(TheModule->getOrInsertFunction("scanf", ptype));
 
+	if(DBuilder)
+	{
+		size_t slash = filename.find_last_of('/');
+		string directory = slash == string::npos ? "." : filename.substr(0, slash);
+		string name = slash == string::npos ? filename : filename.substr(slash + 1);
+
+		compileUnit = DBuilder->createCompileUnit(dwarf::DW_LANG_C, name, directory, "bcc", false, "", 0);
+		sourceFile = DBuilder->createFile(name, directory);
+
+		DISubroutineType *mainType = DBuilder->createSubroutineType(DBuilder->getOrCreateTypeArray(None));
+		DISubprogram *mainScope = DBuilder->createFunction(sourceFile, "main", "main", sourceFile, program->line, mainType, false, true, program->line);
+		mainFunction->setSubprogram(mainScope);
+
+		TheModule->addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+		TheModule->addModuleFlag(Module::Warning, "Dwarf Version", 4);
+	}
+
 	// Push a new variable/block context
 	pushBlock(bblock);
+
+	ASTEffects effects;
+	{
+		TimedPhase phase("find gotos");
+		program->accept(&effects);
+	}
+	gotos = effects.gotos;
 	
 	program->codegen(this);
 
 	if(errors > 0)
-		exit(1);
+		return false;
 
 	bblock = currentBlock();
 	popBlock();
-	ReturnInst::Create(TheContext, bblock);
-
+	ReturnInst::Create(TheContext, ConstantInt::get(Type::getInt32Ty(TheContext), 0), bblock);
+
+	attachAliasInfo();
+	if(instrumenting)
+		instrument();
+	else if(!profileCounts.empty())
+		applyProfile();
+	if(!tracePath.empty())
+		traceWrite(filename);
+	if(DBuilder)
+		DBuilder->finalize();
+
+	TimedPhase phase("verify");
 	verifyModule(*TheModule);
+	return true;
+}
 
-	cout << "LLVM IR Code" << endl;
-	cout << "--------------------------------" << endl;
-	cout << endl;
+CodeGenVisitor::CodeGenVisitor(map<string, SymbolTableEntry *> st): Builder(TheContext)
+{
+	TheModule = make_unique<Module>("main", TheContext);
+	symboltable = st;
+	countSymbolTable("codegen", symboltable);
+	errors = 0;
+	BitFill = nullptr;
+	BitScan = nullptr;
+	readBuffer = nullptr;
+	ParallelFor = nullptr;
+	OrderedPrint = nullptr;
+	inParallel = false;
+	DBuilder = nullptr;
+	optimizing = false;
+	objects = false;
+	outlining = false;
+	instrumenting = false;
+	TraceStatement = nullptr;
+	compileUnit = nullptr;
+	sourceFile = nullptr;
+}
 
-	legacy::PassManager PM;
-	PM.add(createPrintModulePass(outs()));
-	PM.run(*TheModule);
+// Emit DWARF line tables and variable descriptions along with the code
+void CodeGenVisitor::enableDebugInfo()
+{
+	if(!DBuilder)
+		DBuilder = new DIBuilder(*TheModule);
+}
 
-	filename = filename + ".ll";
+void CodeGenVisitor::enableOptimization()
+{
+	optimizing = true;
+}
 
-	int fileDescriptor = open (filename.c_str(), O_RDWR|O_CREAT, 0777);
-	raw_fd_ostream OS(fileDescriptor, true);
-	// WriteBitcodeToFile(TheModule.get(), OS);
-	TheModule->print(OS, NULL);
-	OS.flush();
-	OS.close();
-	close(fileDescriptor);
+void CodeGenVisitor::enableObjectOutput()
+{
+	objects = true;
 }
 
-CodeGenVisitor::CodeGenVisitor(map<string, SymbolTableEntry *> st)
+void CodeGenVisitor::enableOutlining()
 {
-	TheModule = make_unique<Module>("main", TheContext);
-	symboltable = st;
-	errors = 0;
+	outlining = true;
+}
+
+// FlatB values are all 64-bit; bool arrays are described as the words that pack them
+DIType* CodeGenVisitor::debugType(ASTVariable *variable)
+{
+	DIType *element;
+	if(variable->isBitType() && variable->array_type)
+		element = DBuilder->createBasicType("bits", 64, 64, dwarf::DW_ATE_unsigned);
+	else if(variable->isBitType())
+		element = DBuilder->createBasicType("bool", 64, 64, dwarf::DW_ATE_boolean);
+	else
+		element = DBuilder->createBasicType("int", 64, 64, dwarf::DW_ATE_signed);
+
+	if(!variable->array_type)
+		return element;
+
+	uint64_t length = variable->length;
+	if(variable->isBitType())
+		length = (length + 63) / 64;
+
+	Metadata *range = DBuilder->getOrCreateSubrange(0, length);
+	return DBuilder->createArrayType(length * 64, 64, element, DBuilder->getOrCreateArray(range));
+}
+
+// Gives line to every instruction without a location in the code a statement may
+// have emitted: startBlock after the instruction before (all of it if before is null),
+// blocks entered since and blocks created after lastBlock. Nested statements are
+// tagged before the one enclosing them, so they keep their own lines. Starting after
+// before keeps the statements of a long block from each walking all of it.
+void CodeGenVisitor::setDebugLocation(int line, BasicBlock *startBlock, Instruction *before, BasicBlock *lastBlock, size_t entered)
+{
+	Function *function = startBlock->getParent();
+	DILocation *location = DILocation::get(TheContext, line, 0, function->getSubprogram());
+	auto tag = [&](Instruction *instruction)
+	{
+		if(!instruction->getDebugLoc() && !isa<AllocaInst>(instruction))
+			instruction->setDebugLoc(DebugLoc(location));
+	};
+
+	Instruction *first = before ? before->getNextNode() : startBlock->empty() ? nullptr : &startBlock->front();
+	for(Instruction *instruction = first; instruction; instruction = instruction->getNextNode())
+		tag(instruction);
+
+	vector<BasicBlock *> touched(enteredBlocks.begin() + entered, enteredBlocks.end());
+	for(auto block = ++lastBlock->getIterator(); block != function->end(); ++block)
+		touched.push_back(&*block);
+
+	for(auto block: touched)
+		if(block->getParent() == function && block != startBlock)
+			for(auto &instruction: *block)
+				tag(&instruction);
+}
+
+// Address of the 64-bit word holding a bool array element; offset gets the bit position
+Value* CodeGenVisitor::bitWord(ASTTargetVar *var_location, Value **offset)
+{
+	Value *index = var_location->rtree->codegen(this);
+	Value *wordIndex = BinaryOperator::Create(Instruction::LShr, index, ConstantInt::get(IntType(), 6), "tmp", currentBlock());
+	*offset = BinaryOperator::Create(Instruction::And, index, ConstantInt::get(IntType(), 63), "tmp", currentBlock());
+
+	return elementAddress(var_location->var_name, wordIndex);
+}
+
+// Read-modify-write of a single bit; any non-zero value stores a one
+Value* CodeGenVisitor::storeBit(ASTTargetVar *var_location, Value *expr)
+{
+	Value *offset;
+	Value *location = bitWord(var_location, &offset);
+
+	Value *mask = BinaryOperator::Create(Instruction::Shl, ConstantInt::get(IntType(), 1), offset, "tmp", currentBlock());
+	Value *bit = new ZExtInst(new ICmpInst(*currentBlock(), ICmpInst::ICMP_NE, expr, ConstantInt::get(IntType(), 0, true), "tmp"), IntType(), "zext", currentBlock());
+	Value *shifted = BinaryOperator::Create(Instruction::Shl, bit, offset, "tmp", currentBlock());
+
+	// other iterations of a parallel loop may be storing other bits of the same word
+	if(inParallel)
+	{
+		IRBuilder<> B(currentBlock());
+		B.CreateAtomicRMW(AtomicRMWInst::And, location, B.CreateNot(mask), AtomicOrdering::Monotonic);
+		return B.CreateAtomicRMW(AtomicRMWInst::Or, location, shifted, AtomicOrdering::Monotonic);
+	}
+
+	Value *word = new LoadInst(location, "", false, currentBlock());
+	Value *cleared = BinaryOperator::Create(Instruction::And, word, BinaryOperator::CreateNot(mask, "tmp", currentBlock()), "tmp", currentBlock());
+	Value *result = BinaryOperator::Create(Instruction::Or, cleared, shifted, "tmp", currentBlock());
+
+	return new StoreInst(result, location, false, currentBlock());
+}
+
+// Address of element index of an array variable
+Value* CodeGenVisitor::elementAddress(string name, Value *index)
+{
+	GlobalVariable *array = cast<GlobalVariable>(variables[name]);
+	Value *indices[] = { ConstantInt::get(IntType(), 0, true), index };
+	return GetElementPtrInst::CreateInBounds(array->getValueType(), array, indices, "tmp", currentBlock());
+}
+
+// Every FlatB variable is its own global, so accesses to two different variables
+// can never overlap. Each variable gets a TBAA type of its own under one root, which
+// tells LLVM exactly that, and every load and store that addresses a variable
+// directly is tagged with it. Scoped noalias lists would say the same at the cost of
+// naming every other variable on each one, quadratic in the number of variables.
+void CodeGenVisitor::attachAliasInfo()
+{
+	MDBuilder MDB(TheContext);
+	MDNode *root = MDB.createTBAARoot("flatb");
+
+	vector<GlobalVariable *> globals;
+	for(auto &variable: variables)
+		globals.push_back(cast<GlobalVariable>(variable.second));
+	if(readBuffer)
+		globals.push_back(readBuffer);
+
+	map<Value *, MDNode *> tbaa;
+	for(auto global: globals)
+	{
+		MDNode *type = MDB.createTBAAScalarTypeNode(global->getName(), root);
+		tbaa[global] = MDB.createTBAAStructTagNode(type, type, 0);
+	}
+
+	for(auto &function: *TheModule)
+		for(auto &block: function)
+			for(auto &instruction: block)
+			{
+				Value *pointer = nullptr;
+				if(LoadInst *load = dyn_cast<LoadInst>(&instruction))
+					pointer = load->getPointerOperand();
+				else if(StoreInst *store = dyn_cast<StoreInst>(&instruction))
+					pointer = store->getPointerOperand();
+				if(!pointer)
+					continue;
+
+				Value *base = pointer->stripInBoundsOffsets();
+				if(tbaa.find(base) == tbaa.end())
+					continue;
+
+				instruction.setMetadata(LLVMContext::MD_tbaa, tbaa[base]);
+			}
+}
+
+// void flatb.bitfill(i64 *words, i64 lo, i64 hi, i64 value)
+// Sets bits lo..hi, storing whole words wherever a word is fully covered.
+Function* CodeGenVisitor::bitFillFunction()
+{
+	if(BitFill)
+		return BitFill;
+
+	Type *argTypes[] = { PointerType::get(IntType(), 0), IntType(), IntType(), IntType() };
+	FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), argTypes, false);
+	BitFill = Function::Create(ftype, GlobalValue::InternalLinkage, "flatb.bitfill", TheModule.get());
+
+	Function::arg_iterator args = BitFill->arg_begin();
+	Value *words = &*args++;
+	Value *lo = &*args++;
+	Value *hi = &*args++;
+	Value *value = &*args++;
+
+	BasicBlock *entryBlock = BasicBlock::Create(TheContext, "entry", BitFill);
+	BasicBlock *headerBlock = BasicBlock::Create(TheContext, "loop_header", BitFill);
+	BasicBlock *checkBlock = BasicBlock::Create(TheContext, "check", BitFill);
+	BasicBlock *wordBlock = BasicBlock::Create(TheContext, "word", BitFill);
+	BasicBlock *bitBlock = BasicBlock::Create(TheContext, "bit", BitFill);
+	BasicBlock *exitBlock = BasicBlock::Create(TheContext, "exit", BitFill);
+
+	IRBuilder<> B(entryBlock);
+	Value *set = B.CreateICmpNE(value, ConstantInt::get(IntType(), 0));
+	Value *fillWord = B.CreateSelect(set, ConstantInt::get(IntType(), -1, true), ConstantInt::get(IntType(), 0));
+	B.CreateBr(headerBlock);
+
+	B.SetInsertPoint(headerBlock);
+	PHINode *i = B.CreatePHI(IntType(), 3, "i");
+	i->addIncoming(lo, entryBlock);
+	B.CreateCondBr(B.CreateICmpSGT(i, hi), exitBlock, checkBlock);
+
+	B.SetInsertPoint(checkBlock);
+	Value *offset = B.CreateAnd(i, 63);
+	Value *aligned = B.CreateICmpEQ(offset, ConstantInt::get(IntType(), 0));
+	Value *covered = B.CreateICmpSLE(B.CreateAdd(i, ConstantInt::get(IntType(), 63)), hi);
+	Value *location = B.CreateInBoundsGEP(IntType(), words, B.CreateLShr(i, 6));
+	B.CreateCondBr(B.CreateAnd(aligned, covered), wordBlock, bitBlock);
+
+	B.SetInsertPoint(wordBlock);
+	B.CreateStore(fillWord, location);
+	i->addIncoming(B.CreateAdd(i, ConstantInt::get(IntType(), 64)), wordBlock);
+	B.CreateBr(headerBlock);
+
+	B.SetInsertPoint(bitBlock);
+	Value *mask = B.CreateShl(ConstantInt::get(IntType(), 1), offset);
+	Value *word = B.CreateLoad(IntType(), location);
+	Value *cleared = B.CreateAnd(word, B.CreateNot(mask));
+	B.CreateStore(B.CreateOr(cleared, B.CreateAnd(fillWord, mask)), location);
+	i->addIncoming(B.CreateAdd(i, ConstantInt::get(IntType(), 1)), bitBlock);
+	B.CreateBr(headerBlock);
+
+	B.SetInsertPoint(exitBlock);
+	B.CreateRetVoid();
+
+	return BitFill;
+}
+
+// i64 flatb.bitscan(i64 *words, i64 from, i64 to, i64 value)
+// Returns the first index in from..to whose bit equals value, or to + 1 if there is
+// none. Words without a candidate bit are skipped whole using cttz.
+Function* CodeGenVisitor::bitScanFunction()
+{
+	if(BitScan)
+		return BitScan;
+
+	Type *argTypes[] = { PointerType::get(IntType(), 0), IntType(), IntType(), IntType() };
+	FunctionType *ftype = FunctionType::get(IntType(), argTypes, false);
+	BitScan = Function::Create(ftype, GlobalValue::InternalLinkage, "flatb.bitscan", TheModule.get());
+
+	Function::arg_iterator args = BitScan->arg_begin();
+	Value *words = &*args++;
+	Value *from = &*args++;
+	Value *to = &*args++;
+	Value *value = &*args++;
+
+	BasicBlock *entryBlock = BasicBlock::Create(TheContext, "entry", BitScan);
+	BasicBlock *headerBlock = BasicBlock::Create(TheContext, "loop_header", BitScan);
+	BasicBlock *lookBlock = BasicBlock::Create(TheContext, "look", BitScan);
+	BasicBlock *foundBlock = BasicBlock::Create(TheContext, "found", BitScan);
+	BasicBlock *nextBlock = BasicBlock::Create(TheContext, "next", BitScan);
+	BasicBlock *exitBlock = BasicBlock::Create(TheContext, "exit", BitScan);
+
+	IRBuilder<> B(entryBlock);
+	Value *set = B.CreateICmpNE(value, ConstantInt::get(IntType(), 0));
+	Value *invert = B.CreateSelect(set, ConstantInt::get(IntType(), 0), ConstantInt::get(IntType(), -1, true));
+	Value *past = B.CreateAdd(to, ConstantInt::get(IntType(), 1));
+	B.CreateBr(headerBlock);
+
+	B.SetInsertPoint(headerBlock);
+	PHINode *i = B.CreatePHI(IntType(), 2, "i");
+	i->addIncoming(from, entryBlock);
+	B.CreateCondBr(B.CreateICmpSGT(i, to), exitBlock, lookBlock);
+
+	B.SetInsertPoint(lookBlock);
+	Value *location = B.CreateInBoundsGEP(IntType(), words, B.CreateLShr(i, 6));
+	Value *word = B.CreateXor(B.CreateLoad(IntType(), location), invert);
+	Value *shifted = B.CreateLShr(word, B.CreateAnd(i, 63));
+	B.CreateCondBr(B.CreateICmpNE(shifted, ConstantInt::get(IntType(), 0)), foundBlock, nextBlock);
+
+	B.SetInsertPoint(foundBlock);
+	Function *cttz = Intrinsic::getDeclaration(TheModule.get(), Intrinsic::cttz, IntType());
+	Value *found = B.CreateAdd(i, B.CreateCall(cttz, {shifted, B.getTrue()}));
+	B.CreateRet(B.CreateSelect(B.CreateICmpSGT(found, to), past, found));
+
+	B.SetInsertPoint(nextBlock);
+	i->addIncoming(B.CreateAdd(B.CreateOr(i, 63), ConstantInt::get(IntType(), 1)), nextBlock);
+	B.CreateBr(headerBlock);
+
+	B.SetInsertPoint(exitBlock);
+	B.CreateRet(B.CreateSelect(B.CreateICmpSGT(from, to), from, past));
+
+	return BitScan;
+}
+
+// for i = lo, hi { a[i] = c; } on a bool array becomes one call to flatb.bitfill
+Value* CodeGenVisitor::bitFillLoop(ASTForLoop *forloop, ASTAssignment *assignment)
+{
+	Value *iterator = variables[forloop->assignment->target->var_name];
+
+	forloop->assignment->codegen(this);
+	Value *lo = new LoadInst(iterator, "load", currentBlock());
+	Value *hi = forloop->ulimit->codegen(this);
+
+	Value *words = elementAddress(LoopIdiom::arrayName(assignment), ConstantInt::get(IntType(), 0, true));
+
+	Value *ArgsV[] = { words, lo, hi, ConstantInt::get(IntType(), LoopIdiom::fillValue(assignment)) };
+	CallInst::Create(bitFillFunction(), ArgsV, "", currentBlock());
+
+	// the iterator is left one past the bound, as the general loop would leave it
+	ICmpInst *ran = new ICmpInst(*currentBlock(), ICmpInst::ICMP_SLE, lo, hi, "tmp");
+	Value *past = BinaryOperator::Create(Instruction::Add, hi, ConstantInt::get(IntType(), 1), "tmp", currentBlock());
+	return new StoreInst(SelectInst::Create(ran, past, lo, "tmp", currentBlock()), iterator, false, currentBlock());
+}
+
+// for i = lo, hi { if a[i] == c { ... } } on a bool array jumps straight from one
+// matching element to the next with flatb.bitscan
+Value* CodeGenVisitor::bitScanLoop(ASTForLoop *forloop, ASTIfElse *ifelse)
+{
+	Value *iterator = variables[forloop->assignment->target->var_name];
+
+	forloop->assignment->codegen(this);
+	Value *startVal = new LoadInst(iterator, "start", false, currentBlock());
+	Value *endVal = forloop->ulimit->codegen(this);
+
+	BasicBlock *entryBlock = currentBlock();
+	BasicBlock *headerBlock = BasicBlock::Create(TheContext, "loop_header", entryBlock->getParent(), 0);
+	BasicBlock *bodyBlock = BasicBlock::Create(TheContext, "loop_body", entryBlock->getParent(), 0);
+	BasicBlock *afterLoopBlock = BasicBlock::Create(TheContext, "after_loop", entryBlock->getParent(), 0);
+
+	Value *words = elementAddress(LoopIdiom::arrayName(ifelse), ConstantInt::get(IntType(), 0, true));
+	BranchInst::Create(headerBlock, entryBlock);
+
+	PHINode *from = PHINode::Create(IntType(), 2, "from", headerBlock);
+	from->addIncoming(startVal, entryBlock);
+	Value *ArgsV[] = { words, from, endVal, ConstantInt::get(IntType(), LoopIdiom::scanValue(ifelse)) };
+	Value *next = CallInst::Create(bitScanFunction(), ArgsV, "next", headerBlock);
+	new StoreInst(next, iterator, false, headerBlock);
+	ICmpInst *comparison = new ICmpInst(*headerBlock, ICmpInst::ICMP_SLE, next, endVal, "tmp");
+	BranchInst::Create(bodyBlock, afterLoopBlock, comparison, headerBlock);
+
+	pushBlock(bodyBlock);
+	ifelse->iftrue->codegen(this);
+	BasicBlock *latchBlock = currentBlock();
+	popBlock();
+
+	if (!latchBlock->getTerminator())
+	{
+		from->addIncoming(BinaryOperator::Create(Instruction::Add, next, ConstantInt::get(IntType(), 1), "tmp", latchBlock), latchBlock);
+		BranchInst::Create(headerBlock, latchBlock);
+	}
+
+	popBlock();
+	pushBlock(afterLoopBlock);
+
+	return nullptr;
 }
 
 Value* CodeGenVisitor::visit(ASTIOBlock *ioblock)
 {
+	checkLabel(ioblock);
 	if(ioblock->iostmt == readvar)
 	{
 		vector<Value *> ArgsV;
 		ArrayType* arrayType = nullptr;
-		Value *val = ioblock->expr->codegen(this);
+		ASTTargetVar *target = static_cast<ASTTargetVar *>(ioblock->expr);
+		bool isBit = variables.find(target->var_name) != variables.end() && symboltable[target->var_name]->isBit;
+
+		// values are read into a zeroed scratch word first, so that a read past the
+		// end of the input gives 0 as in the interpreter, and bools become a single bit
+		if(!readBuffer)
+			readBuffer = new GlobalVariable(*TheModule, IntType(), false, GlobalValue::InternalLinkage, ConstantInt::get(IntType(), 0, true), "readbuffer");
+		new StoreInst(ConstantInt::get(IntType(), 0, true), readBuffer, false, currentBlock());
+		Value *val = readBuffer;
 
-		ioblock->output += "%d";
+		ioblock->output += "%lld";
 
 		if(!ioblock->output.empty())
 		{
@@ -140,6 +705,14 @@ Value* CodeGenVisitor::visit(ASTIOBlock *ioblock)
 			if(Scan)
 				CallInst::Create(Scan, ArgsV, "scanfCall", currentBlock());
 		}
+
+		Value *input = new LoadInst(readBuffer, "", false, currentBlock());
+		if(!isBit)
+			new StoreInst(input, ioblock->expr->codegen(this), false, currentBlock());
+		else if(target->array_type)
+			storeBit(target, input);
+		else
+			new StoreInst(new ZExtInst(new ICmpInst(*currentBlock(), ICmpInst::ICMP_NE, input, ConstantInt::get(IntType(), 0, true), "tmp"), IntType(), "zext", currentBlock()), variables[target->var_name], false, currentBlock());
 		return nullptr;
 	}
 	else
@@ -148,18 +721,23 @@ Value* CodeGenVisitor::visit(ASTIOBlock *ioblock)
 		ArrayType* arrayType = nullptr;
 		Value *val = nullptr;
 
+		// the text is printed as it is, so a % in it is doubled for printf
+		string format;
+		for(char c: ioblock->output)
+			format += c == '%' ? "%%" : string(1, c);
+
 		if(ioblock->expr)
 		{
 			val = ioblock->expr->codegen(this);
-			ioblock->output += "%d";
+			format += "%lld";
 		}
 
 		if(ioblock->iostmt == println)
-			ioblock->output += "\n";
+			format += "\n";
 
-		if(!ioblock->output.empty())
+		if(!format.empty())
 		{
-			const char *str = ioblock->output.c_str();
+			const char *str = format.c_str();
 
 			Constant *StrConstant = ConstantDataArray::getString(TheContext, str);
 			GlobalVariable *gv = new GlobalVariable(*TheModule, StrConstant->getType(),
@@ -175,8 +753,10 @@ Value* CodeGenVisitor::visit(ASTIOBlock *ioblock)
 			if(ioblock->expr)
 				ArgsV.push_back(val);
 
-			if(Print)
-				CallInst::Create(Print, ArgsV, "printfcall", currentBlock());
+			// parallel iterations print through the runtime, which keeps them in order
+			Function *print = inParallel ? orderedPrintFunction() : Print;
+			if(print)
+				CallInst::Create(print, ArgsV, "printfcall", currentBlock());
 		}
 		return nullptr;
 	}
@@ -217,18 +797,18 @@ Value* CodeGenVisitor::visit(ASTGotoBlock *gotoblock)
 			if(labels.find(gotoblock->targetlabel) != labels.end())
 			{
 				jumpBlock = labels[gotoblock->targetlabel];
-				BranchInst::Create(jumpBlock, currentBlock());
 			}
 			else
 			{
 				jumpBlock = BasicBlock::Create(TheContext, gotoblock->targetlabel, currentBlock()->getParent());
 				labels[gotoblock->targetlabel] = jumpBlock;
-
-				BasicBlock *noJumpBlock = BasicBlock::Create(TheContext, "noJumpBlock", currentBlock()->getParent());
-				BranchInst::Create(jumpBlock, currentBlock());
-				popBlock();
-				pushBlock(noJumpBlock);
 			}
+
+			// what follows the goto, backward or forward, is only reached by a label
+			BasicBlock *noJumpBlock = BasicBlock::Create(TheContext, "noJumpBlock", currentBlock()->getParent());
+			BranchInst::Create(jumpBlock, currentBlock());
+			popBlock();
+			pushBlock(noJumpBlock);
 		}
 	}
 	return nullptr;
@@ -237,6 +817,19 @@ Value* CodeGenVisitor::visit(ASTGotoBlock *gotoblock)
 Value* CodeGenVisitor::visit(ASTIfElse *ifelse)
 {
 	checkLabel(ifelse);
+
+	// a min or max of a register accumulator is a select rather than a branch
+	string name;
+	ASTMathExpr *operand;
+	Reduction kind = LoopIdiom::reduction(ifelse, symboltable, name, operand);
+	if((kind == minreduction || kind == maxreduction) && accumulators.count(name))
+	{
+		Value *value = operand->codegen(this);
+		ICmpInst::Predicate predicate = kind == minreduction ? ICmpInst::ICMP_SLT : ICmpInst::ICMP_SGT;
+		ICmpInst *better = new ICmpInst(*currentBlock(), predicate, value, accumulators[name], "tmp");
+		return accumulators[name] = SelectInst::Create(better, value, accumulators[name], name, currentBlock());
+	}
+
 	BasicBlock *entryBlock = currentBlock();
 	Value *condition = ifelse->condition->codegen(this);
 	ICmpInst * comparison = new ICmpInst(*entryBlock, ICmpInst::ICMP_NE, condition, ConstantInt::get(IntType(), 0, true), "tmp");
@@ -245,6 +838,11 @@ Value* CodeGenVisitor::visit(ASTIfElse *ifelse)
 
 	BasicBlock * returnedBlock = nullptr;
 
+	// register accumulators may reach the merge with a different value from each side
+	map<string, Value *> before = accumulators;
+	map<string, Value *> fromTrue;
+	BasicBlock *trueBlock = nullptr, *falseBlock = entryBlock;
+
 	pushBlock(ifBlock);
 	ifelse->iftrue->codegen(this);
 	returnedBlock = currentBlock();
@@ -253,7 +851,10 @@ Value* CodeGenVisitor::visit(ASTIfElse *ifelse)
 	if (!returnedBlock->getTerminator())
 	{
 		BranchInst::Create(mergeBlock, returnedBlock);
+		trueBlock = returnedBlock;
+		fromTrue = accumulators;
 	}
+	accumulators = before;
 
 	if (ifelse->iffalse)
 	{
@@ -264,9 +865,11 @@ Value* CodeGenVisitor::visit(ASTIfElse *ifelse)
 		returnedBlock = currentBlock();
 		popBlock();
 
+		falseBlock = nullptr;
 		if (!returnedBlock->getTerminator())
 		{
 			BranchInst::Create(mergeBlock, returnedBlock);
+			falseBlock = returnedBlock;
 		}
 
 		BranchInst::Create(ifBlock, elseBlock, comparison, entryBlock);
@@ -276,6 +879,22 @@ Value* CodeGenVisitor::visit(ASTIfElse *ifelse)
 		BranchInst::Create(ifBlock, mergeBlock, comparison, entryBlock);
 	}
 
+	for(auto accumulator: before)
+	{
+		Value *trueValue = trueBlock ? fromTrue[accumulator.first] : nullptr;
+		Value *falseValue = falseBlock ? accumulators[accumulator.first] : nullptr;
+		if(!trueValue || !falseValue || trueValue == falseValue)
+		{
+			accumulators[accumulator.first] = trueValue ? trueValue : falseValue ? falseValue : accumulator.second;
+			continue;
+		}
+
+		PHINode *merged = PHINode::Create(IntType(), 2, accumulator.first, mergeBlock);
+		merged->addIncoming(trueValue, trueBlock);
+		merged->addIncoming(falseValue, falseBlock);
+		accumulators[accumulator.first] = merged;
+	}
+
 	popBlock();
 	pushBlock(mergeBlock);
 	return nullptr;
@@ -319,49 +938,461 @@ Value* CodeGenVisitor::visit(ASTForLoop *forloop)
 {
 	checkLabel(forloop);
 
+	// a parallel loop nested in another runs sequentially inside the enclosing worker
+	if(forloop->schedule != sequential && !inParallel)
+		return parallelLoop(forloop);
+
+	// a word-at-a-time fill would race with other threads storing bits of the edge words
+	if(ASTAssignment *fill = inParallel ? nullptr : LoopIdiom::bitFill(forloop, symboltable))
+		return bitFillLoop(forloop, fill);
+
+	if(ASTIfElse *scan = LoopIdiom::bitScan(forloop, symboltable))
+		return bitScanLoop(forloop, scan);
+
+	string name = forloop->assignment->target->var_name;
+	Value *iterator = variables[name];
+
+	// the bound and the step are evaluated once, after the initial assignment
+	forloop->assignment->codegen(this);
+	Value *startVal = new LoadInst(iterator, "start", false, currentBlock());
+	Value *endVal = forloop->ulimit->codegen(this);
+	Value *stepVal = ConstantInt::get(IntType(), 1, true);
+	if(forloop->increment)
+		stepVal = forloop->increment->codegen(this);
+
+	Value *trips = tripCount(startVal, endVal, stepVal);
+	Value *span = BinaryOperator::Create(Instruction::Mul, trips, stepVal, "tmp", currentBlock());
+	Value *lastVal = BinaryOperator::Create(Instruction::Add, startVal, span, "last", currentBlock());
+
+	ASTEffects effects;
+	forloop->statements->accept(&effects);
+
+	// a goto from outside into the body would bypass the preheader, so such loops keep
+	// their counter in memory
+	for(auto label: effects.labels)
+		if(gotos.count(label) > effects.gotos.count(label))
+			return countedLoopInMemory(forloop, startVal, stepVal, trips, lastVal);
+
 	BasicBlock *entryBlock = currentBlock();
-	BasicBlock *headerBlock = BasicBlock::Create(TheContext, "loop_header", entryBlock->getParent(), 0);
 	BasicBlock *bodyBlock = BasicBlock::Create(TheContext, "loop_body", entryBlock->getParent(), 0);
 	BasicBlock *afterLoopBlock = BasicBlock::Create(TheContext, "after_loop", entryBlock->getParent(), 0);
 
-	// put the increment in the body block
-	ASTTargetVar *iterator = new ASTTargetVar(forloop->assignment->target->var_name);
-	iterator->setTarget();
-	ASTAssignment* increment;
+	// reductions accumulate in registers and reach memory once, after the loop
+	map<string, Value *> initial;
+	for(auto name: LoopIdiom::accumulators(forloop, symboltable))
+		initial[name] = new LoadInst(variables[name], name, false, entryBlock);
 
-	if(forloop->increment)
-		increment = new ASTAssignment(iterator, new ASTMathExpr(new ASTTargetVar(forloop->assignment->target->var_name), forloop->increment, add));
-	else
-		increment = new ASTAssignment(iterator, new ASTMathExpr(new ASTTargetVar(forloop->assignment->target->var_name), new ASTInteger(1), add));
-	forloop->statements->addStatement(increment);
+	ICmpInst *entered = new ICmpInst(*entryBlock, ICmpInst::ICMP_NE, trips, ConstantInt::get(IntType(), 0, true), "tmp");
+	BranchInst::Create(bodyBlock, afterLoopBlock, entered, entryBlock);
 
-	forloop->assignment->codegen(this);
+	// the counter runs 0 .. trips - 1 and is the loop's only induction variable
+	PHINode *counter = PHINode::Create(IntType(), 2, "counter", bodyBlock);
+	counter->addIncoming(ConstantInt::get(IntType(), 0, true), entryBlock);
 
-	Value *endVal = forloop->ulimit->codegen(this);
+	map<string, PHINode *> partials;
+	for(auto value: initial)
+	{
+		partials[value.first] = PHINode::Create(IntType(), 2, value.first, bodyBlock);
+		partials[value.first]->addIncoming(value.second, entryBlock);
+		accumulators[value.first] = partials[value.first];
+	}
+	Value *step = BinaryOperator::Create(Instruction::Mul, counter, stepVal, "tmp", bodyBlock);
+	Value *index = BinaryOperator::Create(Instruction::Add, startVal, step, name, bodyBlock);
 
-	Value *val = new LoadInst(variables[forloop->assignment->target->var_name], "load", headerBlock);
-	ICmpInst *comparison = new ICmpInst(*headerBlock, ICmpInst::ICMP_SLE, val, endVal, "tmp");
+	// the iterator only has to be in memory if the body assigns it or can leave with
+	// a goto; otherwise reads of it use the induction value directly
+	if(!effects.gotos.empty() || effects.writes.count(name))
+		new StoreInst(index, iterator, false, bodyBlock);
 
-	BranchInst::Create(bodyBlock, afterLoopBlock, comparison, headerBlock);
-	BranchInst::Create(headerBlock, entryBlock);
+	Value *outer = inductions.count(name) ? inductions[name] : nullptr;
+	inductions.erase(name);
+	if(!effects.writes.count(name))
+		inductions[name] = index;
 
 	pushBlock(bodyBlock);
 	forloop->statements->codegen(this);
-	bodyBlock = currentBlock();
+	BasicBlock *latchBlock = currentBlock();
+	popBlock();
+
+	inductions.erase(name);
+	if(outer)
+		inductions[name] = outer;
+
+	if (!latchBlock->getTerminator())
+	{
+		Value *next = BinaryOperator::Create(Instruction::Add, counter, ConstantInt::get(IntType(), 1, true), "next", latchBlock);
+		counter->addIncoming(next, latchBlock);
+		ICmpInst *comparison = new ICmpInst(*latchBlock, ICmpInst::ICMP_NE, next, trips, "tmp");
+		BranchInst *latch = BranchInst::Create(bodyBlock, afterLoopBlock, comparison, latchBlock);
+		if(!partials.empty())
+			vectorizeHint(latch);
+	}
+
+	map<string, PHINode *> results;
+	for(auto partial: partials)
+	{
+		Value *value = accumulators[partial.first];
+		partial.second->addIncoming(value, latchBlock);
+		accumulators.erase(partial.first);
+
+		results[partial.first] = PHINode::Create(IntType(), 2, partial.first, afterLoopBlock);
+		results[partial.first]->addIncoming(initial[partial.first], entryBlock);
+		results[partial.first]->addIncoming(value, latchBlock);
+	}
+	for(auto result: results)
+		new StoreInst(result.second, variables[result.first], false, afterLoopBlock);
 
 	popBlock();
+	pushBlock(afterLoopBlock);
+	new StoreInst(lastVal, iterator, false, afterLoopBlock);
 
-	if (!bodyBlock->getTerminator())
+	return nullptr;
+}
+
+// trips = (step > 0 && start <= end) ? (end - start) / step + 1 : 0
+Value* CodeGenVisitor::tripCount(Value *startVal, Value *endVal, Value *stepVal)
+{
+	Value *zero = ConstantInt::get(IntType(), 0, true);
+	Value *one = ConstantInt::get(IntType(), 1, true);
+
+	ICmpInst *forward = new ICmpInst(*currentBlock(), ICmpInst::ICMP_SGT, stepVal, zero, "tmp");
+	ICmpInst *inRange = new ICmpInst(*currentBlock(), ICmpInst::ICMP_SLE, startVal, endVal, "tmp");
+	Value *runs = BinaryOperator::Create(Instruction::And, forward, inRange, "tmp", currentBlock());
+
+	Value *divisor = SelectInst::Create(forward, stepVal, one, "tmp", currentBlock());
+	Value *distance = BinaryOperator::Create(Instruction::Sub, endVal, startVal, "tmp", currentBlock());
+	Value *quotient = BinaryOperator::Create(Instruction::UDiv, distance, divisor, "tmp", currentBlock());
+	Value *count = BinaryOperator::Create(Instruction::Add, quotient, one, "tmp", currentBlock());
+
+	return SelectInst::Create(runs, count, zero, "trips", currentBlock());
+}
+
+// Asks the loop vectorizer to vectorize the loop latch closes, which it does for a
+// reduction by keeping a vector of partial results and combining them after the loop
+void CodeGenVisitor::vectorizeHint(BranchInst *latch)
+{
+	Metadata *enable[] = { MDString::get(TheContext, "llvm.loop.vectorize.enable"), ConstantAsMetadata::get(ConstantInt::getTrue(TheContext)) };
+	Metadata *operands[] = { nullptr, MDNode::get(TheContext, enable) };
+	MDNode *loopID = MDNode::getDistinct(TheContext, operands);
+	loopID->replaceOperandWith(0, loopID);
+	latch->setMetadata(LLVMContext::MD_loop, loopID);
+}
+
+// Same loop as visit(ASTForLoop), with every loop-carried value in a stack slot so
+// that entering the body through a label is well formed
+Value* CodeGenVisitor::countedLoopInMemory(ASTForLoop *forloop, Value *startVal, Value *stepVal, Value *trips, Value *lastVal)
+{
+	Value *iterator = variables[forloop->assignment->target->var_name];
+	BasicBlock *entryBlock = currentBlock();
+	Function *function = entryBlock->getParent();
+	Instruction *allocaPoint = &*function->getEntryBlock().getFirstInsertionPt();
+
+	Value *counterSlot = new AllocaInst(IntType(), "counter", allocaPoint);
+	Value *startSlot = new AllocaInst(IntType(), "start", allocaPoint);
+	Value *stepSlot = new AllocaInst(IntType(), "step", allocaPoint);
+	Value *tripsSlot = new AllocaInst(IntType(), "trips", allocaPoint);
+	Value *lastSlot = new AllocaInst(IntType(), "last", allocaPoint);
+
+	// a loop entered through a label before it was ever started runs no more iterations
+	Value *zero = ConstantInt::get(IntType(), 0, true);
+	new StoreInst(zero, tripsSlot, false, allocaPoint);
+
+	new StoreInst(zero, counterSlot, false, entryBlock);
+	new StoreInst(startVal, startSlot, false, entryBlock);
+	new StoreInst(stepVal, stepSlot, false, entryBlock);
+	new StoreInst(trips, tripsSlot, false, entryBlock);
+	new StoreInst(lastVal, lastSlot, false, entryBlock);
+
+	BasicBlock *headerBlock = BasicBlock::Create(TheContext, "loop_header", function, 0);
+	BasicBlock *bodyBlock = BasicBlock::Create(TheContext, "loop_body", function, 0);
+	BasicBlock *afterLoopBlock = BasicBlock::Create(TheContext, "after_loop", function, 0);
+	BranchInst::Create(headerBlock, entryBlock);
+
+	Value *counter = new LoadInst(counterSlot, "counter", false, headerBlock);
+	Value *total = new LoadInst(tripsSlot, "trips", false, headerBlock);
+	ICmpInst *comparison = new ICmpInst(*headerBlock, ICmpInst::ICMP_ULT, counter, total, "tmp");
+	BranchInst::Create(bodyBlock, afterLoopBlock, comparison, headerBlock);
+
+	Value *step = BinaryOperator::Create(Instruction::Mul, new LoadInst(counterSlot, "counter", false, bodyBlock), new LoadInst(stepSlot, "step", false, bodyBlock), "tmp", bodyBlock);
+	Value *index = BinaryOperator::Create(Instruction::Add, new LoadInst(startSlot, "start", false, bodyBlock), step, "tmp", bodyBlock);
+	new StoreInst(index, iterator, false, bodyBlock);
+
+	pushBlock(bodyBlock);
+	forloop->statements->codegen(this);
+	BasicBlock *latchBlock = currentBlock();
+	popBlock();
+
+	if (!latchBlock->getTerminator())
 	{
-		BranchInst::Create(headerBlock, bodyBlock);
+		Value *current = new LoadInst(counterSlot, "counter", false, latchBlock);
+		Value *next = BinaryOperator::Create(Instruction::Add, current, ConstantInt::get(IntType(), 1, true), "next", latchBlock);
+		new StoreInst(next, counterSlot, false, latchBlock);
+		BranchInst::Create(headerBlock, latchBlock);
 	}
 
 	popBlock();
 	pushBlock(afterLoopBlock);
+	new StoreInst(new LoadInst(lastSlot, "last", false, afterLoopBlock), iterator, false, afterLoopBlock);
 
 	return nullptr;
 }
 
+// The iterations of a parallel for-loop run in an outlined worker function that
+// __flatb_parallel_for calls on chunks of the counter range [0, trips). The worker
+// reads start, step and trips from an environment the caller fills in.
+Value* CodeGenVisitor::parallelLoop(ASTForLoop *forloop)
+{
+	ASTDataSharing sharing(forloop, symboltable);
+	Value *iterator = variables[forloop->assignment->target->var_name];
+
+	forloop->assignment->codegen(this);
+	Value *startVal = new LoadInst(iterator, "start", false, currentBlock());
+	Value *endVal = forloop->ulimit->codegen(this);
+	Value *stepVal = ConstantInt::get(IntType(), 1, true);
+	if(forloop->increment)
+		stepVal = forloop->increment->codegen(this);
+
+	Value *trips = tripCount(startVal, endVal, stepVal);
+	Value *span = BinaryOperator::Create(Instruction::Mul, trips, stepVal, "tmp", currentBlock());
+	Value *lastVal = BinaryOperator::Create(Instruction::Add, startVal, span, "last", currentBlock());
+
+	ArrayType *envType = ArrayType::get(IntType(), 3);
+	Instruction *allocaPoint = &*currentBlock()->getParent()->getEntryBlock().getFirstInsertionPt();
+	Value *env = new AllocaInst(envType, "env", allocaPoint);
+
+	Value *fields[] = { startVal, stepVal, trips };
+	for(int field = 0; field < 3; field++)
+	{
+		Value *index[] = { ConstantInt::get(IntType(), 0, true), ConstantInt::get(IntType(), field, true) };
+		new StoreInst(fields[field], GetElementPtrInst::CreateInBounds(envType, env, index, "tmp", currentBlock()), false, currentBlock());
+	}
+
+	// the worker reads enclosing loops' iterators from memory
+	for(auto induction: inductions)
+		new StoreInst(induction.second, variables[induction.first], false, currentBlock());
+
+	Function *worker = parallelWorker(forloop, sharing);
+
+	Value *ArgsV[] = { worker, new BitCastInst(env, Type::getInt8PtrTy(TheContext), "tmp", currentBlock()), trips,
+						ConstantInt::get(Type::getInt32Ty(TheContext), forloop->schedule == dynamicchunks) };
+	CallInst::Create(parallelForFunction(), ArgsV, "", currentBlock());
+
+	return new StoreInst(lastVal, iterator, false, currentBlock());
+}
+
+// void worker(i64 first, i64 last, i8 *env) runs the iterations with counter values
+// first .. last - 1. The iterator and the private scalars live in the worker's own
+// stack slots, reductions accumulate into a partial result (in a register when the
+// loop allows it) that is combined into the shared variable atomically, and the
+// chunk holding the last iteration copies the private scalars out.
+Function* CodeGenVisitor::parallelWorker(ASTForLoop *forloop, ASTDataSharing &sharing)
+{
+	string name = forloop->assignment->target->var_name;
+
+	Type *argTypes[] = { IntType(), IntType(), Type::getInt8PtrTy(TheContext) };
+	FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), argTypes, false);
+	Function *worker = Function::Create(ftype, GlobalValue::InternalLinkage, "main.parallel", TheModule.get());
+
+	Function::arg_iterator args = worker->arg_begin();
+	Value *first = &*args++;
+	Value *last = &*args++;
+	Value *envArg = &*args++;
+
+	if(DBuilder)
+	{
+		DISubroutineType *workerType = DBuilder->createSubroutineType(DBuilder->getOrCreateTypeArray(None));
+		worker->setSubprogram(DBuilder->createFunction(sourceFile, worker->getName(), worker->getName(), sourceFile, forloop->line, workerType, true, true, forloop->line));
+	}
+
+	BasicBlock *entryBlock = BasicBlock::Create(TheContext, "entry", worker);
+	BasicBlock *bodyBlock = BasicBlock::Create(TheContext, "loop_body", worker);
+	BasicBlock *exitBlock = BasicBlock::Create(TheContext, "exit", worker);
+
+	ArrayType *envType = ArrayType::get(IntType(), 3);
+	Value *env = new BitCastInst(envArg, PointerType::get(envType, 0), "env", entryBlock);
+	Value *fields[3];
+	for(int field = 0; field < 3; field++)
+	{
+		Value *index[] = { ConstantInt::get(IntType(), 0, true), ConstantInt::get(IntType(), field, true) };
+		fields[field] = new LoadInst(GetElementPtrInst::CreateInBounds(envType, env, index, "tmp", entryBlock), "", false, entryBlock);
+	}
+	Value *startVal = fields[0], *stepVal = fields[1], *trips = fields[2];
+
+	map<string, Value *> shared;
+	shared[name] = variables[name];
+	for(auto var: sharing.privates)
+		shared[var] = variables[var];
+	for(auto reduction: sharing.reductions)
+		shared[reduction.first] = variables[reduction.first];
+
+	set<string> registers = LoopIdiom::accumulators(forloop, symboltable);
+	map<string, Value *> identities;
+	for(auto reduction: sharing.reductions)
+	{
+		int64_t identity = 0;
+		if(reduction.second == productreduction)
+			identity = 1;
+		else if(reduction.second == minreduction)
+			identity = INT64_MAX;
+		else if(reduction.second == maxreduction)
+			identity = INT64_MIN;
+		identities[reduction.first] = ConstantInt::get(IntType(), identity, true);
+	}
+
+	for(auto var: shared)
+		if(!registers.count(var.first))
+			variables[var.first] = new AllocaInst(IntType(), var.first, entryBlock);
+	for(auto identity: identities)
+		if(!registers.count(identity.first))
+			new StoreInst(identity.second, variables[identity.first], false, entryBlock);
+	BranchInst::Create(bodyBlock, entryBlock);
+
+	PHINode *counter = PHINode::Create(IntType(), 2, "counter", bodyBlock);
+	counter->addIncoming(first, entryBlock);
+
+	map<string, Value *> outerAccumulators = accumulators;
+	accumulators.clear();
+	map<string, PHINode *> partials;
+	for(auto identity: identities)
+		if(registers.count(identity.first))
+		{
+			partials[identity.first] = PHINode::Create(IntType(), 2, identity.first, bodyBlock);
+			partials[identity.first]->addIncoming(identity.second, entryBlock);
+			accumulators[identity.first] = partials[identity.first];
+		}
+	Value *step = BinaryOperator::Create(Instruction::Mul, counter, stepVal, "tmp", bodyBlock);
+	Value *index = BinaryOperator::Create(Instruction::Add, startVal, step, name, bodyBlock);
+	new StoreInst(index, variables[name], false, bodyBlock);
+
+	ASTEffects effects;
+	forloop->statements->accept(&effects);
+
+	map<string, Value *> outer = inductions;
+	bool outerParallel = inParallel;
+	inductions.clear();
+	if(!effects.writes.count(name))
+		inductions[name] = index;
+	inParallel = true;
+
+	pushBlock(bodyBlock);
+	forloop->statements->codegen(this);
+	BasicBlock *latchBlock = currentBlock();
+	popBlock();
+
+	inductions = outer;
+	inParallel = outerParallel;
+
+	Value *next = BinaryOperator::Create(Instruction::Add, counter, ConstantInt::get(IntType(), 1, true), "next", latchBlock);
+	counter->addIncoming(next, latchBlock);
+	ICmpInst *comparison = new ICmpInst(*latchBlock, ICmpInst::ICMP_NE, next, last, "tmp");
+	BranchInst *latch = BranchInst::Create(bodyBlock, exitBlock, comparison, latchBlock);
+	if(!partials.empty())
+		vectorizeHint(latch);
+
+	for(auto partial: partials)
+		partial.second->addIncoming(accumulators[partial.first], latchBlock);
+
+	IRBuilder<> B(exitBlock);
+	for(auto reduction: sharing.reductions)
+	{
+		Value *global = shared[reduction.first];
+		Value *partial;
+		if(partials.count(reduction.first))
+			partial = accumulators[reduction.first];
+		else
+			partial = B.CreateLoad(IntType(), variables[reduction.first]);
+
+		if(reduction.second != productreduction)
+		{
+			AtomicRMWInst::BinOp combine = AtomicRMWInst::Add;
+			if(reduction.second == minreduction)
+				combine = AtomicRMWInst::Min;
+			else if(reduction.second == maxreduction)
+				combine = AtomicRMWInst::Max;
+			B.CreateAtomicRMW(combine, global, partial, AtomicOrdering::Monotonic);
+			continue;
+		}
+
+		// there is no atomic multiply, so retry a compare-and-swap until it succeeds
+		BasicBlock *fromBlock = B.GetInsertBlock();
+		BasicBlock *retryBlock = BasicBlock::Create(TheContext, "combine", worker);
+		BasicBlock *doneBlock = BasicBlock::Create(TheContext, "combined", worker);
+		B.CreateBr(retryBlock);
+
+		B.SetInsertPoint(retryBlock);
+		PHINode *expected = B.CreatePHI(IntType(), 2, "expected");
+		expected->addIncoming(ConstantInt::get(IntType(), 0, true), fromBlock);
+		Value *pair = B.CreateAtomicCmpXchg(global, expected, B.CreateMul(expected, partial), AtomicOrdering::Monotonic, AtomicOrdering::Monotonic);
+		expected->addIncoming(B.CreateExtractValue(pair, 0), retryBlock);
+		B.CreateCondBr(B.CreateExtractValue(pair, 1), doneBlock, retryBlock);
+
+		B.SetInsertPoint(doneBlock);
+	}
+
+	if(!sharing.privates.empty())
+	{
+		BasicBlock *copyBlock = BasicBlock::Create(TheContext, "lastprivate", worker);
+		BasicBlock *doneBlock = BasicBlock::Create(TheContext, "done", worker);
+		B.CreateCondBr(B.CreateICmpEQ(last, trips), copyBlock, doneBlock);
+
+		B.SetInsertPoint(copyBlock);
+		for(auto var: sharing.privates)
+			B.CreateStore(B.CreateLoad(IntType(), variables[var]), shared[var]);
+		B.CreateBr(doneBlock);
+
+		B.SetInsertPoint(doneBlock);
+	}
+	B.CreateRetVoid();
+
+	accumulators = outerAccumulators;
+	for(auto var: shared)
+		variables[var.first] = var.second;
+
+	if(DBuilder)
+		setDebugLocation(forloop->line, entryBlock, nullptr, entryBlock, enteredBlocks.size());
+
+	return worker;
+}
+
+// void __flatb_parallel_for(void (*body)(i64, i64, i8 *), i8 *env, i64 trips, i32 schedule)
+// from the runtime library
+Function* CodeGenVisitor::parallelForFunction()
+{
+	if(ParallelFor)
+		return ParallelFor;
+
+	Type *bodyArgs[] = { IntType(), IntType(), Type::getInt8PtrTy(TheContext) };
+	FunctionType *bodyType = FunctionType::get(Type::getVoidTy(TheContext), bodyArgs, false);
+	Type *argTypes[] = { PointerType::get(bodyType, 0), Type::getInt8PtrTy(TheContext), IntType(), Type::getInt32Ty(TheContext) };
+	FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), argTypes, false);
+	ParallelFor = dynamic_cast<Function *>(TheModule->getOrInsertFunction("__flatb_parallel_for", ftype));
+
+	return ParallelFor;
+}
+
+// int __flatb_printf(i8 *format, ...) from the runtime library
+Function* CodeGenVisitor::orderedPrintFunction()
+{
+	if(!OrderedPrint)
+		OrderedPrint = dynamic_cast<Function *>(TheModule->getOrInsertFunction("__flatb_printf", Print->getFunctionType()));
+	return OrderedPrint;
+}
+
+// __flatb_name from the runtime library, see runtime/flatbrt.h. Besides picking its
+// version on the first call, a kernel touches nothing but the elements it is passed,
+// and only reads them if readOnly.
+Function* CodeGenVisitor::kernelFunction(string name, Type *result, vector<Type *> argTypes, bool readOnly)
+{
+	FunctionType *ftype = FunctionType::get(result, argTypes, false);
+	Function *kernel = dynamic_cast<Function *>(TheModule->getOrInsertFunction("__flatb_" + name, ftype));
+	kernel->addFnAttr(Attribute::NoUnwind);
+	kernel->addFnAttr(Attribute::ArgMemOnly);
+	if(readOnly)
+		kernel->addFnAttr(Attribute::ReadOnly);
+
+	return kernel;
+}
+
 Value* CodeGenVisitor::visit(ASTWhileLoop *whileloop)
 {
 	// TO-DO
@@ -418,10 +1449,17 @@ Value* CodeGenVisitor::visit(ASTMathExpr *mathexpr)
 		case mult:
 			return BinaryOperator::Create(Instruction::Mul, lval, rval, "tmp", currentBlock());
 		case divd:
-			return BinaryOperator::Create(Instruction::SDiv, lval, rval, "tmp", currentBlock());
+		{
+			// INT64_MIN / -1 overflows sdiv; dividing by -1 negates instead, wrapping
+			// as the interpreter does
+			Value *minusOne = new ICmpInst(*currentBlock(), ICmpInst::ICMP_EQ, rval, ConstantInt::get(IntType(), -1, true), "tmp");
+			Value *divisor = SelectInst::Create(minusOne, ConstantInt::get(IntType(), 1), rval, "tmp", currentBlock());
+			Value *quotient = BinaryOperator::Create(Instruction::SDiv, lval, divisor, "tmp", currentBlock());
+			Value *negated = BinaryOperator::Create(Instruction::Sub, ConstantInt::get(IntType(), 0), lval, "tmp", currentBlock());
+			return SelectInst::Create(minusOne, negated, quotient, "tmp", currentBlock());
+		}
 		case usub:
-			lval = ConstantInt::get(IntType(), -1, true);
-			return BinaryOperator::Create(Instruction::SDiv, lval, rval, "tmp", currentBlock());
+			return BinaryOperator::Create(Instruction::Sub, ConstantInt::get(IntType(), 0), rval, "tmp", currentBlock());
 		case noop:
 			return rval;
 
@@ -435,6 +1473,14 @@ Value* CodeGenVisitor::visit(ASTInteger *integer)
 
 Value* CodeGenVisitor::visit(ASTTargetVar *var_location)
 {
+	// -x reads x and negates it
+	auto loaded = [&](Value *value) -> Value*
+	{
+		if(var_location->op != usub)
+			return value;
+		return BinaryOperator::Create(Instruction::Sub, ConstantInt::get(IntType(), 0), value, "tmp", currentBlock());
+	};
+
 	if(variables.find(var_location->var_name) != variables.end())
 	{
 		Value* location = nullptr;
@@ -448,11 +1494,15 @@ Value* CodeGenVisitor::visit(ASTTargetVar *var_location)
 				return nullptr;
 			}
 
-			vector<Value *> index;
-			index.push_back(ConstantInt::get(IntType(), 0, true));
-			index.push_back(var_location->rtree->codegen(this));
-			Value *val = variables[var_location->var_name];
-			location = GetElementPtrInst::CreateInBounds(val, index, "tmp", currentBlock());
+			if(symboltable[var_location->var_name]->isBit && !var_location->isTarget)
+			{
+				Value *offset;
+				Value *word = new LoadInst(bitWord(var_location, &offset), "", false, currentBlock());
+				Value *shifted = BinaryOperator::Create(Instruction::LShr, word, offset, "tmp", currentBlock());
+				return loaded(BinaryOperator::Create(Instruction::And, shifted, ConstantInt::get(IntType(), 1), "tmp", currentBlock()));
+			}
+
+			location = elementAddress(var_location->var_name, var_location->rtree->codegen(this));
 		}
 		else
 		{
@@ -463,10 +1513,15 @@ Value* CodeGenVisitor::visit(ASTTargetVar *var_location)
 				return nullptr;
 			}
 
+			if(!var_location->isTarget && inductions.count(var_location->var_name))
+				return loaded(inductions[var_location->var_name]);
+			if(!var_location->isTarget && accumulators.count(var_location->var_name))
+				return loaded(accumulators[var_location->var_name]);
+
 			location = variables[var_location->var_name];
 		}
 		if(!var_location->isTarget)
-			return new LoadInst(location, "", false, currentBlock());
+			return loaded(new LoadInst(location, "", false, currentBlock()));
 		else
 			return location;
 	}
@@ -484,11 +1539,23 @@ Value* CodeGenVisitor::visit(ASTAssignment *assignment)
 	{		
 		checkLabel(assignment);
 
+		SymbolTableEntry *entry = symboltable[assignment->target->var_name];
+		if(!assignment->target->array_type && accumulators.count(assignment->target->var_name))
+			return accumulators[assignment->target->var_name] = assignment->rexpr->codegen(this);
+
+		if(entry->isBit && entry->isArray && assignment->target->array_type)
+		{
+			Value* expr = assignment->rexpr->codegen(this);
+			return storeBit(assignment->target, expr);
+		}
+
 		Value* location = assignment->target->codegen(this);
 		Value* expr = assignment->rexpr->codegen(this);
 
 		if(location)
 		{
+			if(entry->isBit)
+				expr = new ZExtInst(new ICmpInst(*currentBlock(), ICmpInst::ICMP_NE, expr, ConstantInt::get(IntType(), 0, true), "tmp"), IntType(), "zext", currentBlock());
 			return new StoreInst(expr, location, false, currentBlock());
 		}
 		else
@@ -502,13 +1569,143 @@ Value* CodeGenVisitor::visit(ASTAssignment *assignment)
 	}
 }
 
+// fill and copy are calls to the runtime's kernels, except that a bool array is
+// filled by flatb.bitfill
+Value* CodeGenVisitor::visit(ASTBuiltinStatement *builtin)
+{
+	checkLabel(builtin);
+
+	Value *value = builtin->builtin == fillbuiltin ? builtin->args[0]->codegen(this) : nullptr;
+	Value *lo = builtin->args[1]->codegen(this);
+	Value *hi = builtin->args[2]->codegen(this);
+	Value *elements = elementAddress(builtin->array, ConstantInt::get(IntType(), 0, true));
+	Type *pointer = PointerType::get(IntType(), 0);
+
+	if(builtin->builtin == fillbuiltin)
+	{
+		Value *ArgsV[] = { elements, lo, hi, value };
+		if(symboltable[builtin->array]->isBit)
+			return CallInst::Create(bitFillFunction(), ArgsV, "", currentBlock());
+		Function *fill = kernelFunction("fill", Type::getVoidTy(TheContext), { pointer, IntType(), IntType(), IntType() }, false);
+		return CallInst::Create(fill, ArgsV, "", currentBlock());
+	}
+
+	Value *source = elementAddress(builtin->source, ConstantInt::get(IntType(), 0, true));
+	Value *ArgsV[] = { elements, source, lo, hi };
+	Function *copy = kernelFunction("copy", Type::getVoidTy(TheContext), { pointer, pointer, IntType(), IntType() }, false);
+	return CallInst::Create(copy, ArgsV, "", currentBlock());
+}
+
+Value* CodeGenVisitor::visit(ASTBuiltinExpr *builtin)
+{
+	vector<Value *> ArgsV = { elementAddress(builtin->array, ConstantInt::get(IntType(), 0, true)) };
+	for(auto arg: builtin->args)
+		ArgsV.push_back(arg->codegen(this));
+
+	// count(a, v, lo, hi) is __flatb_count(a, lo, hi, v)
+	if(builtin->builtin == countbuiltin)
+		rotate(ArgsV.begin() + 1, ArgsV.begin() + 2, ArgsV.end());
+
+	vector<Type *> argTypes(ArgsV.size(), IntType());
+	argTypes[0] = PointerType::get(IntType(), 0);
+	return CallInst::Create(kernelFunction(builtin->name, IntType(), argTypes, true), ArgsV, "tmp", currentBlock());
+}
+
 Value* CodeGenVisitor::visit(ASTCodeBlock *code_block)
 {
 	for(auto statement: code_block->statements)
+		generateStatement(statement);
+	return nullptr;
+}
+
+void CodeGenVisitor::generateStatement(ASTCodeStatement *statement)
+{
+	BasicBlock *startBlock = currentBlock();
+	BasicBlock *lastBlock = &startBlock->getParent()->back();
+	Instruction *before = startBlock->empty() ? nullptr : &startBlock->back();
+	size_t entered = enteredBlocks.size();
+
+	Value *V = statement->codegen(this);
+
+	if(DBuilder)
+		setDebugLocation(statement->line, startBlock, before, lastBlock, entered);
+	if(tracedStatements.count(statement))
+		traceStatement(statement, startBlock, before);
+}
+
+// A statement can be moved into another function if it holds no gotos and no labels
+// but its own, since a branch cannot leave the function it is in
+bool CodeGenVisitor::outlinable(ASTCodeStatement *statement)
+{
+	ASTEffects effects;
+	statement->accept(&effects);
+	effects.labels.erase(statement->label);
+	return effects.gotos.empty() && effects.labels.empty();
+}
+
+// With -foutline-loops, each run of outlinable top-level statements that holds a loop
+// or starts at a label becomes an internal function of its own, called from main.
+// The instruction selector and register allocator then see several small functions
+// instead of one large main, and the module can be split for code generation.
+void CodeGenVisitor::outlineRegions(ASTCodeBlock *code_block)
+{
+	vector<ASTCodeStatement *> &statements = code_block->statements;
+	size_t first = 0;
+	while(first < statements.size())
 	{
-		Value *V = statement->codegen(this);
+		size_t end = first;
+		bool loop = false;
+		while(end < statements.size() && (end == first || statements[end]->label.empty()) && outlinable(statements[end]))
+		{
+			if(dynamic_cast<ASTForLoop *>(statements[end]) || dynamic_cast<ASTWhileLoop *>(statements[end]))
+				loop = true;
+			end++;
+		}
+
+		if(end > first && (loop || !statements[first]->label.empty()))
+		{
+			outline(statements, first, end);
+			first = end;
+		}
+		else
+			generateStatement(statements[first++]);
 	}
-	return nullptr;
+}
+
+// Generates statements [first, end) as a function and calls it. The label of the
+// first statement, if any, stays in main in front of the call, where gotos can
+// reach it.
+void CodeGenVisitor::outline(vector<ASTCodeStatement *> &statements, size_t first, size_t end)
+{
+	int line = statements[first]->line;
+	BasicBlock *startBlock = currentBlock();
+	BasicBlock *lastBlock = &startBlock->getParent()->back();
+	Instruction *before = startBlock->empty() ? nullptr : &startBlock->back();
+	size_t entered = enteredBlocks.size();
+
+	checkLabel(statements[first]);
+
+	FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), false);
+	Function *region = Function::Create(ftype, GlobalValue::InternalLinkage, "main.region", TheModule.get());
+	region->addFnAttr(Attribute::NoInline);
+	if(DBuilder)
+	{
+		DISubroutineType *regionType = DBuilder->createSubroutineType(DBuilder->getOrCreateTypeArray(None));
+		region->setSubprogram(DBuilder->createFunction(sourceFile, region->getName(), region->getName(), sourceFile, line, regionType, true, true, line));
+	}
+	CallInst::Create(region, "", currentBlock());
+
+	string label = statements[first]->label;
+	statements[first]->label = "";
+	pushBlock(BasicBlock::Create(TheContext, "entry", region));
+	for(size_t i = first; i < end; i++)
+		generateStatement(statements[i]);
+	ReturnInst::Create(TheContext, currentBlock());
+	popBlock();
+	statements[first]->label = label;
+
+	if(DBuilder)
+		setDebugLocation(line, startBlock, before, lastBlock, entered);
 }
 
 Value* CodeGenVisitor::visit(ASTVariable *variable)
@@ -533,17 +1730,27 @@ Value* CodeGenVisitor::visit(ASTVariable *variable)
 			return nullptr;
 		}
 
-		ArrayType* arrayType = ArrayType::get(IntType(), variable->length);
+		// bool arrays are packed 64 elements to a word
+		unsigned int length = variable->length;
+		if(variable->isBitType())
+			length = (length + 63) / 64;
+
+		ArrayType* arrayType = ArrayType::get(IntType(), length);
 
-		globalVar = new GlobalVariable(*TheModule, arrayType, false, GlobalValue::CommonLinkage, NULL, variable->var_name);
+		// arrays start on a cache line so vectorised loops see aligned accesses
+		globalVar = new GlobalVariable(*TheModule, arrayType, false, GlobalValue::InternalLinkage, NULL, variable->var_name);
 		globalVar->setInitializer(ConstantAggregateZero::get(arrayType));
+		globalVar->setAlignment(64);
 	}
 	else
 	{
-		globalVar = new GlobalVariable(*TheModule, IntType(), false, GlobalValue::CommonLinkage, NULL, variable->var_name);
+		globalVar = new GlobalVariable(*TheModule, IntType(), false, GlobalValue::InternalLinkage, NULL, variable->var_name);
 		globalVar->setInitializer(ConstantInt::get(Type::getInt64Ty(TheContext), 0, true));
 	}
 
+	if(DBuilder)
+		DBuilder->createGlobalVariable(compileUnit, variable->var_name, variable->var_name, sourceFile, variable->line, debugType(variable), true, globalVar);
+
 	this->variables[variable->var_name] = globalVar;
 	return globalVar;
 }
@@ -582,7 +1789,12 @@ Value* CodeGenVisitor::visit(ASTProgram *program)
 		Value *V = program->decl_block->codegen(this);
 	}
 
-	if(program->code_block)
+	if(program->code_block && !tracePath.empty())
+		tracedStatements.insert(program->code_block->statements.begin(), program->code_block->statements.end());
+
+	if(program->code_block && outlining)
+		outlineRegions(program->code_block);
+	else if(program->code_block)
 	{
 		Value *V = program->code_block->codegen(this);
 	}
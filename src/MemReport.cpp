@@ -0,0 +1,502 @@
+// bcc --mem-report prints, when bcc exits, how many bytes each part of bcc held and
+// the most the heap held during each phase:
+//
+//	memory                                   count       bytes
+//	lexer strings                             2310       55440
+//	AST nodes                                 9120      671264
+//	  ASTMathExpr                             2450      137200
+//	...
+//	phase                                  live KB   peak KB
+//	parse                                      912       912
+//	...
+//
+// Lexer strings are the names and literals the scanner copies for the parser, which
+// are never freed. AST nodes are counted by kind as parsed, each with the block malloc
+// gave it and the strings and vectors it owns. Every copy of the symbol table is
+// counted apart, while the entries and the storage they hold for the interpreter are
+// shared by all copies. The LLVM module is counted as written: its functions, blocks,
+// instructions and globals, and the size of its IR text and of its bitcode.
+//
+// Phases are those of --time-report. Live is what operator new had handed out since
+// bcc read its options and not yet taken back at the end of the phase, peak the
+// most at any one time during it; they cover the AST, the symbol tables and most of
+// LLVM, but not what is taken with malloc directly, such as the lexer strings,
+// which the peak RSS includes.
+// --mem-report=json prints the same as JSON.
+#include "ASTDefinition.h"
+#include "parser.tab.h"
+#include <atomic>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <sys/resource.h>
+
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace std;
+using namespace llvm;
+
+extern union NODE yylval;
+
+struct Tally
+{
+	uint64_t count, bytes;
+	Tally(): count(0), bytes(0) {}
+	void add(uint64_t bytes) { count++; this->bytes += bytes; }
+};
+
+struct MemoryPhase
+{
+	string name;
+	int depth;
+	int64_t live, peak;				// bytes
+	int64_t outerPeak;				// the peak of the phases around it so far
+};
+
+static bool reporting = false, json = false;
+static atomic<bool> counting(false);
+static atomic<int64_t> live(0), peak(0);
+
+static Tally lexemes;
+static map<string, Tally> nodeKinds;
+static Tally entries;
+static set<SymbolTableEntry *> entriesSeen;
+static vector<pair<string, Tally>> tables;
+static map<string, uint64_t> moduleCounts;	// LLVM counts and sizes, named by moduleItems
+static vector<MemoryPhase> phases;		// in the order they began
+static vector<size_t> opened;			// indices of the phases open now
+
+static const char *moduleItems[] = { "functions", "basic blocks", "instructions", "globals", "IR text bytes", "bitcode bytes" };
+
+/*************************** The heap ****************************************/
+
+static void allocated(void *block)
+{
+	if(!block || !counting.load(memory_order_relaxed))
+		return;
+	int64_t size = malloc_usable_size(block);
+	int64_t now = live.fetch_add(size, memory_order_relaxed) + size;
+	int64_t highest = peak.load(memory_order_relaxed);
+	while(now > highest && !peak.compare_exchange_weak(highest, now, memory_order_relaxed))
+		;
+}
+
+static void freed(void *block)
+{
+	if(block && counting.load(memory_order_relaxed))
+		live.fetch_sub(malloc_usable_size(block), memory_order_relaxed);
+}
+
+void* operator new(size_t size)
+{
+	void *block = malloc(size ? size : 1);
+	if(!block)
+		throw bad_alloc();
+	allocated(block);
+	return block;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t &) noexcept
+{
+	void *block = malloc(size ? size : 1);
+	allocated(block);
+	return block;
+}
+
+void* operator new[](size_t size, const nothrow_t &) noexcept
+{
+	return operator new(size, nothrow);
+}
+
+void operator delete(void *block) noexcept
+{
+	freed(block);
+	free(block);
+}
+
+void operator delete[](void *block) noexcept
+{
+	operator delete(block);
+}
+
+void operator delete(void *block, const nothrow_t &) noexcept
+{
+	operator delete(block);
+}
+
+void operator delete[](void *block, const nothrow_t &) noexcept
+{
+	operator delete(block);
+}
+
+/*************************** Subsystems **************************************/
+
+// What a string or vector holds on the heap beyond the object itself
+static uint64_t heapBytes(const string &text)
+{
+	// libstdc++ keeps up to 15 characters in the string itself
+	return text.capacity() > 15 ? text.capacity() + 1 : 0;
+}
+
+template<class T> static uint64_t heapBytes(const vector<T> &items)
+{
+	return items.capacity() * sizeof(T);
+}
+
+// Called by the parser for every token; names and literals come as copies
+void countLexeme(int token)
+{
+	if(reporting && (token == IDENTIFIER || token == STRINGID || token == TYPE) && yylval.string)
+		lexemes.add(malloc_usable_size(yylval.string));
+}
+
+void countAST(ASTProgram *program)
+{
+	if(!reporting || !program)
+		return;
+	ASTMemory memory;
+	memory.visit(program);
+}
+
+void countSymbolTable(const char *owner, const map<string, SymbolTableEntry *> &table)
+{
+	if(reporting)
+		ASTMemory::symbolTable(owner, table);
+}
+
+// Counts what is written to it and writes nothing
+class CountingStream: public raw_ostream
+{
+	private:
+		uint64_t written;
+		void write_impl(const char *, size_t size) override { written += size; }
+		uint64_t current_pos() const override { return written; }
+
+	public:
+		CountingStream(): written(0) {}
+		uint64_t bytes() { flush(); return written; }
+};
+
+void countModule(Module &code)
+{
+	if(!reporting)
+		return;
+	moduleCounts.clear();
+	for(Function &function: code)
+	{
+		if(function.isDeclaration())
+			continue;
+		moduleCounts["functions"]++;
+		for(BasicBlock &block: function)
+		{
+			moduleCounts["basic blocks"]++;
+			moduleCounts["instructions"] += block.size();
+		}
+	}
+	moduleCounts["globals"] = code.getGlobalList().size();
+
+	CountingStream text;
+	code.print(text, nullptr);
+	moduleCounts["IR text bytes"] = text.bytes();
+	CountingStream bitcode;
+	WriteBitcodeToFile(&code, bitcode);
+	moduleCounts["bitcode bytes"] = bitcode.bytes();
+}
+
+/*************************** ASTMemory ***************************************/
+
+// Each node counts under its own kind, with the heap it owns
+static void countNode(const char *kind, ASTNode *node, uint64_t owned = 0)
+{
+	nodeKinds[kind].add(malloc_usable_size(node) + owned);
+}
+
+ASTMemory::ASTMemory()
+{
+}
+
+void ASTMemory::symbolTable(const char *owner, const map<string, SymbolTableEntry *> &table)
+{
+	Tally copy;
+	for(auto &symbol: table)
+	{
+		// a red-black tree node: colour and three links, then the name and the entry
+		copy.add(32 + sizeof(symbol) + heapBytes(symbol.first));
+		SymbolTableEntry *entry = symbol.second;
+		if(!entry || !entriesSeen.insert(entry).second)
+			continue;
+		uint64_t storage = entry->value ? malloc_usable_size(entry->value) : 0;
+		storage += entry->bits ? malloc_usable_size(entry->bits) : 0;
+		entries.add(malloc_usable_size(entry) + heapBytes(entry->identifier) + storage);
+	}
+	tables.push_back(make_pair(owner, copy));
+}
+
+void ASTMemory::visit(ASTIOBlock *ioblock)
+{
+	countNode("ASTIOBlock", ioblock, heapBytes(ioblock->label) + heapBytes(ioblock->output));
+	if(ioblock->expr)
+		ioblock->expr->accept(this);
+}
+
+void ASTMemory::visit(ASTGotoBlock *gotoblock)
+{
+	countNode("ASTGotoBlock", gotoblock, heapBytes(gotoblock->label) + heapBytes(gotoblock->targetlabel));
+	if(gotoblock->condition)
+		gotoblock->condition->accept(this);
+}
+
+void ASTMemory::visit(ASTIfElse *ifelse)
+{
+	countNode("ASTIfElse", ifelse, heapBytes(ifelse->label));
+	ifelse->condition->accept(this);
+	ifelse->iftrue->accept(this);
+	if(ifelse->iffalse)
+		ifelse->iffalse->accept(this);
+}
+
+void ASTMemory::visit(ASTCondExpr *condition)
+{
+	countNode("ASTCondExpr", condition);
+	condition->ltree->accept(this);
+	condition->rtree->accept(this);
+}
+
+void ASTMemory::visit(ASTForLoop *forloop)
+{
+	countNode("ASTForLoop", forloop, heapBytes(forloop->label));
+	forloop->assignment->accept(this);
+	forloop->ulimit->accept(this);
+	if(forloop->increment)
+		forloop->increment->accept(this);
+	forloop->statements->accept(this);
+}
+
+void ASTMemory::visit(ASTWhileLoop *whileloop)
+{
+	countNode("ASTWhileLoop", whileloop, heapBytes(whileloop->label));
+	whileloop->condition->accept(this);
+	whileloop->statements->accept(this);
+}
+
+void ASTMemory::visit(ASTMathExpr *mathexpr)
+{
+	countNode("ASTMathExpr", mathexpr);
+	if(mathexpr->ltree)
+		mathexpr->ltree->accept(this);
+	if(mathexpr->rtree)
+		mathexpr->rtree->accept(this);
+}
+
+void ASTMemory::visit(ASTInteger *integer)
+{
+	countNode("ASTInteger", integer);
+}
+
+void ASTMemory::visit(ASTTargetVar *target)
+{
+	countNode("ASTTargetVar", target, heapBytes(target->var_name));
+	if(target->array_type)
+		target->rtree->accept(this);
+}
+
+void ASTMemory::visit(ASTAssignment *assignment)
+{
+	countNode("ASTAssignment", assignment, heapBytes(assignment->label));
+	assignment->target->accept(this);
+	assignment->rexpr->accept(this);
+}
+
+void ASTMemory::visit(ASTBuiltinStatement *builtin)
+{
+	countNode("ASTBuiltinStatement", builtin, heapBytes(builtin->label) + heapBytes(builtin->name) + heapBytes(builtin->array)
+		+ heapBytes(builtin->args) + heapBytes(builtin->source));
+	for(auto arg: builtin->args)
+		arg->accept(this);
+}
+
+void ASTMemory::visit(ASTBuiltinExpr *builtin)
+{
+	countNode("ASTBuiltinExpr", builtin, heapBytes(builtin->name) + heapBytes(builtin->array) + heapBytes(builtin->args));
+	for(auto arg: builtin->args)
+		arg->accept(this);
+}
+
+void ASTMemory::visit(ASTCodeBlock *codeblock)
+{
+	countNode("ASTCodeBlock", codeblock, heapBytes(codeblock->statements));
+	for(auto statement: codeblock->statements)
+		statement->accept(this);
+}
+
+void ASTMemory::visit(ASTVariable *variable)
+{
+	countNode("ASTVariable", variable, heapBytes(variable->var_name) + heapBytes(variable->data_type));
+}
+
+void ASTMemory::visit(ASTVariableSet *variableset)
+{
+	countNode("ASTVariableSet", variableset, heapBytes(variableset->variables));
+	for(auto variable: variableset->variables)
+		variable->accept(this);
+}
+
+void ASTMemory::visit(ASTDeclStatement *declaration)
+{
+	countNode("ASTDeclStatement", declaration, heapBytes(declaration->variables));
+	for(auto variable: declaration->variables)
+		variable->accept(this);
+}
+
+void ASTMemory::visit(ASTDeclBlock *declblock)
+{
+	countNode("ASTDeclBlock", declblock, heapBytes(declblock->statements));
+	for(auto statement: declblock->statements)
+		statement->accept(this);
+}
+
+void ASTMemory::visit(ASTProgram *program)
+{
+	countNode("ASTProgram", program);
+	if(program->decl_block)
+		program->decl_block->accept(this);
+	if(program->code_block)
+		program->code_block->accept(this);
+}
+
+/*************************** Phases and the report ***************************/
+
+void memoryPhaseBegin(const char *name)
+{
+	int64_t now = live.load(memory_order_relaxed);
+	opened.push_back(phases.size());
+	phases.push_back(MemoryPhase{name, (int) opened.size() - 1, 0, 0, peak.exchange(now, memory_order_relaxed)});
+}
+
+void memoryPhaseEnd()
+{
+	MemoryPhase &phase = phases[opened.back()];
+	opened.pop_back();
+	phase.live = live.load(memory_order_relaxed);
+	phase.peak = peak.load(memory_order_relaxed);
+	// the phases around it have seen this peak too
+	peak.store(max(phase.peak, phase.outerPeak), memory_order_relaxed);
+}
+
+static void printLine(string name, int depth, uint64_t count, uint64_t bytes)
+{
+	name = string(2 * depth, ' ') + name;
+	if(name.size() < 36)
+		name.resize(36, ' ');
+	fprintf(stderr, "%s %9llu %11llu\n", name.c_str(), (unsigned long long) count, (unsigned long long) bytes);
+}
+
+static Tally total(map<string, Tally> &tallies)
+{
+	Tally sum;
+	for(auto &tally: tallies)
+	{
+		sum.count += tally.second.count;
+		sum.bytes += tally.second.bytes;
+	}
+	return sum;
+}
+
+static void printTable(int64_t peakRSS)
+{
+	fprintf(stderr, "%-36s %9s %11s\n", "memory", "count", "bytes");
+	printLine("lexer strings", 0, lexemes.count, lexemes.bytes);
+	Tally ast = total(nodeKinds);
+	printLine("AST nodes", 0, ast.count, ast.bytes);
+	for(auto &kind: nodeKinds)
+		printLine(kind.first, 1, kind.second.count, kind.second.bytes);
+	if(!tables.empty())
+	{
+		fprintf(stderr, "symbol tables\n");
+		printLine("entries and storage", 1, entries.count, entries.bytes);
+		for(auto &table: tables)
+			printLine(table.first + " copy", 1, table.second.count, table.second.bytes);
+	}
+	if(!moduleCounts.empty())
+	{
+		fprintf(stderr, "LLVM module\n");
+		for(auto item: moduleItems)
+		{
+			string name = item;
+			if(name.size() > 6 && name.compare(name.size() - 6, 6, " bytes") == 0)
+				fprintf(stderr, "  %-34s %9s %11llu\n", name.substr(0, name.size() - 6).c_str(), "", (unsigned long long) moduleCounts[item]);
+			else
+				fprintf(stderr, "  %-34s %9llu\n", item, (unsigned long long) moduleCounts[item]);
+		}
+	}
+
+	fprintf(stderr, "\n%-36s %9s %9s\n", "phase", "live KB", "peak KB");
+	for(auto &phase: phases)
+	{
+		string name = string(2 * phase.depth, ' ') + phase.name;
+		fprintf(stderr, "%-36s %9lld %9lld\n", name.c_str(), (long long) phase.live / 1024, (long long) phase.peak / 1024);
+	}
+	fprintf(stderr, "%-36s %19lld\n", "peak heap KB", (long long) peak.load() / 1024);
+	fprintf(stderr, "%-36s %19lld\n", "peak RSS KB", (long long) peakRSS / 1024);
+}
+
+static void printJSON(int64_t peakRSS)
+{
+	auto tally = [](Tally &tally) { return "{\"count\": " + to_string(tally.count) + ", \"bytes\": " + to_string(tally.bytes) + "}"; };
+	fprintf(stderr, "{\"lexer_strings\": %s,\n", tally(lexemes).c_str());
+	Tally ast = total(nodeKinds);
+	fprintf(stderr, "\"ast\": {\"count\": %llu, \"bytes\": %llu, \"kinds\": {", (unsigned long long) ast.count, (unsigned long long) ast.bytes);
+	for(auto kind = nodeKinds.begin(); kind != nodeKinds.end(); kind++)
+		fprintf(stderr, "%s\n\t\"%s\": %s", kind == nodeKinds.begin() ? "" : ",", kind->first.c_str(), tally(kind->second).c_str());
+	fprintf(stderr, "}},\n\"symbol_tables\": {\"entries\": %s", tally(entries).c_str());
+	for(auto &table: tables)
+		fprintf(stderr, ",\n\t\"%s\": %s", table.first.c_str(), tally(table.second).c_str());
+	fprintf(stderr, "},\n\"llvm\": {");
+	for(size_t i = 0; !moduleCounts.empty() && i < sizeof(moduleItems) / sizeof(*moduleItems); i++)
+	{
+		string name = moduleItems[i];
+		for(char &c: name)
+			c = c == ' ' ? '_' : c;
+		fprintf(stderr, "%s\"%s\": %llu", i ? ", " : "", name.c_str(), (unsigned long long) moduleCounts[moduleItems[i]]);
+	}
+	fprintf(stderr, "},\n\"phases\": [");
+	for(size_t i = 0; i < phases.size(); i++)
+		fprintf(stderr, "%s\n\t{\"name\": \"%s\", \"depth\": %d, \"live_bytes\": %lld, \"peak_bytes\": %lld}", i ? "," : "",
+			phases[i].name.c_str(), phases[i].depth, (long long) phases[i].live, (long long) phases[i].peak);
+	fprintf(stderr, "\n],\n\"peak_heap_bytes\": %lld, \"peak_rss_bytes\": %lld}\n", (long long) peak.load(), (long long) peakRSS);
+}
+
+// Runs at exit, which may come from inside a phase when bcc stops on an error
+static void printReport()
+{
+	while(!opened.empty())
+		memoryPhaseEnd();
+	counting = false;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	int64_t peakRSS = (int64_t) usage.ru_maxrss * 1024;
+	if(json)
+		printJSON(peakRSS);
+	else
+		printTable(peakRSS);
+}
+
+void enableMemReport(bool asJSON)
+{
+	reporting = true;
+	json = asJSON;
+	counting = true;
+	atexit(printReport);
+}
+
+bool memReportEnabled()
+{
+	return reporting;
+}
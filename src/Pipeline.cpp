@@ -0,0 +1,193 @@
+// bcc with several files compiles them as a pipeline. Parsing, checking, code
+// generation, optimization and emission each run on a thread of their own, so file
+// N + 1 is parsed while file N is in code generation and file N - 1 is optimized.
+// Consecutive stages are joined by bounded queues: a stage that gets ahead waits
+// for the next one, which bounds the number of files in memory at once.
+#include "ASTDefinition.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+// A queue of at most capacity items. close() marks the end of the items; pop then
+// returns false once the queue is empty.
+template<typename T> class BoundedQueue
+{
+	private:
+		deque<T> items;
+		size_t capacity;
+		bool closed;
+		mutex lock;
+		condition_variable notFull, notEmpty;
+
+	public:
+		BoundedQueue(size_t capacity): capacity(capacity), closed(false) {}
+
+		void push(T item)
+		{
+			unique_lock<mutex> hold(lock);
+			notFull.wait(hold, [this]() { return items.size() < capacity; });
+			items.push_back(item);
+			notEmpty.notify_one();
+		}
+
+		bool pop(T &item)
+		{
+			unique_lock<mutex> hold(lock);
+			notEmpty.wait(hold, [this]() { return !items.empty() || closed; });
+			if(items.empty())
+				return false;
+			item = items.front();
+			items.pop_front();
+			notFull.notify_one();
+			return true;
+		}
+
+		void close()
+		{
+			lock_guard<mutex> hold(lock);
+			closed = true;
+			notEmpty.notify_all();
+		}
+};
+
+// A file on its way through the pipeline
+struct Unit
+{
+	string filename;
+	ASTProgram *program;
+	map<string, SymbolTableEntry *> symboltable;
+	unique_ptr<CodeGenVisitor> cgv;
+
+	~Unit()
+	{
+		cgv.reset();
+		for(auto &entry: symboltable)
+			delete entry.second;
+	}
+};
+
+typedef BoundedQueue<Unit *> Queue;
+
+static const size_t queueCapacity = 2;
+static mutex errorLock;
+
+static void report(Unit *unit, string error)
+{
+	lock_guard<mutex> hold(errorLock);
+	cerr << "[ERROR] " << unit->filename << ": " << error << endl;
+}
+
+// Runs work on every unit from in, passing the ones it succeeds on to out. A unit
+// that fails, or that reaches the last stage, is deleted.
+static thread stage(Queue &in, Queue *out, function<bool(Unit *)> work, bool &failed)
+{
+	return thread([&in, out, work, &failed]()
+	{
+		Unit *unit;
+		while(in.pop(unit))
+		{
+			bool passed = work(unit);
+			if(!passed)
+				failed = true;
+			if(passed && out)
+				out->push(unit);
+			else
+				delete unit;
+		}
+		if(out)
+			out->close();
+	});
+}
+
+int compileBatch(vector<string> filenames, bool debugInfo, bool autoParallel, bool optimize, bool objects, bool outline)
+{
+	Queue parsed(queueCapacity), checked(queueCapacity), generated(queueCapacity), optimized(queueCapacity);
+	bool failed[4] = {false, false, false, false};
+	bool unreadable = false;
+
+	vector<thread> stages;
+	stages.push_back(stage(parsed, &checked, [autoParallel](Unit *unit)
+	{
+		ASTVisitor v(nullptr);
+		try
+		{
+			v.visit(unit->program);
+		}
+		catch(SemanticError &e)
+		{
+			for(auto error: e.errors)
+				report(unit, error);
+			return false;
+		}
+		unit->symboltable = v.getSymbolTable();
+
+		ASTConstantFolder cf(unit->symboltable);
+		cf.visit(unit->program);
+		if(autoParallel)
+		{
+			ASTAutoParallel ap(unit->symboltable);
+			ap.visit(unit->program);
+		}
+		return true;
+	}, failed[0]));
+
+	stages.push_back(stage(checked, &generated, [debugInfo, optimize, objects, outline](Unit *unit)
+	{
+		unit->cgv.reset(new CodeGenVisitor(unit->symboltable));
+		if(debugInfo)
+			unit->cgv->enableDebugInfo();
+		if(optimize)
+			unit->cgv->enableOptimization();
+		if(objects)
+			unit->cgv->enableObjectOutput();
+		if(outline)
+			unit->cgv->enableOutlining();
+		return unit->cgv->buildModule(unit->program, unit->filename);
+	}, failed[1]));
+
+	stages.push_back(stage(generated, &optimized, [optimize](Unit *unit)
+	{
+		if(optimize)
+			unit->cgv->optimize();
+		return true;
+	}, failed[2]));
+
+	stages.push_back(stage(optimized, nullptr, [](Unit *unit)
+	{
+		return unit->cgv->emit(unit->filename);
+	}, failed[3]));
+
+	// Parsing runs on this thread
+	for(auto filename: filenames)
+	{
+		Unit *unit = new Unit();
+		unit->filename = filename;
+
+		FILE *file = fopen(filename.c_str(), "r");
+		if(!file)
+		{
+			report(unit, "cannot open");
+			unreadable = true;
+			delete unit;
+			continue;
+		}
+		bool ok = parseProgram(file, unit->program);
+		fclose(file);
+
+		if(!ok)
+			unreadable = true;
+		if(ok && unit->program)
+			parsed.push(unit);
+		else
+			delete unit;
+	}
+	parsed.close();
+
+	for(auto &t: stages)
+		t.join();
+	return unreadable || failed[0] || failed[1] || failed[2] || failed[3] ? 1 : 0;
+}
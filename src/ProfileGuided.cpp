@@ -0,0 +1,255 @@
+// Profile-guided optimization of compiled programs.
+//
+// bcc --instrument file.b adds a counter to every basic block of the module, and to
+// every conditional branch one that counts how often it was taken. Running the
+// program adds its counts to file.b.counts (see runtime/Profile.cpp).
+//
+// bcc --use-profile file.b compiles the same program again and reads the counts back:
+// branches get weights, functions entry counts, and loops hints from their average
+// trip count, so that LLVM lays out, unrolls and vectorises for the runs it has seen.
+// The counters are matched to the blocks by position, so the profile only applies to
+// a module of the same shape: the same program compiled with the same options.
+#include "ASTDefinition.h"
+#include <fstream>
+#include <sstream>
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/MDBuilder.h"
+
+using namespace std;
+using namespace llvm;
+
+// Loops that run fewer iterations than this on average are not worth vectorising
+static const uint64_t shortTrips = 16;
+
+// The blocks of the module in the order their counters are laid out
+static vector<BasicBlock *> moduleBlocks(Module &module)
+{
+	vector<BasicBlock *> blocks;
+	for(Function &function: module)
+		for(BasicBlock &block: function)
+			blocks.push_back(&block);
+	return blocks;
+}
+
+static BranchInst* conditionalBranch(BasicBlock *block)
+{
+	BranchInst *branch = dyn_cast_or_null<BranchInst>(block->getTerminator());
+	return branch && branch->isConditional() ? branch : nullptr;
+}
+
+// A hash of the function and block names and of which blocks end in a conditional branch
+static string moduleShape(vector<BasicBlock *> &blocks)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	auto mix = [&hash](StringRef text)
+	{
+		for(char c: text)
+			hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+		hash = (hash ^ 0xff) * 1099511628211ULL;
+	};
+	for(auto block: blocks)
+	{
+		mix(block->getParent()->getName());
+		mix(block->getName());
+		mix(conditionalBranch(block) ? "?" : ".");
+	}
+	char text[17];
+	snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+	return text;
+}
+
+// Only main and the regions outlined from it run on the main thread alone
+static bool sharedFunction(Function *function)
+{
+	StringRef name = function->getName();
+	return name != "main" && !name.startswith("main.region");
+}
+
+// Adds amount to counter index before the given instruction
+static void increment(GlobalVariable *counters, size_t index, Value *amount, Instruction *before, bool shared)
+{
+	LLVMContext &context = before->getContext();
+	Type *countersType = counters->getValueType();
+	Value *indices[] = { ConstantInt::get(Type::getInt64Ty(context), 0), ConstantInt::get(Type::getInt64Ty(context), index) };
+	Value *counter = GetElementPtrInst::CreateInBounds(countersType, counters, indices, "counter", before);
+	if(shared)
+	{
+		IRBuilder<> B(before);
+		B.CreateAtomicRMW(AtomicRMWInst::Add, counter, amount, AtomicOrdering::Monotonic);
+		return;
+	}
+	Value *count = new LoadInst(counter, "count", false, before);
+	count = BinaryOperator::Create(Instruction::Add, count, amount, "count", before);
+	new StoreInst(count, counter, false, before);
+}
+
+void CodeGenVisitor::enableInstrumentation(string path)
+{
+	profilePath = path;
+	instrumenting = true;
+}
+
+// Reads a profile written by an instrumented build; returns false if there is none
+bool CodeGenVisitor::useProfile(string path)
+{
+	ifstream file(path);
+	string header;
+	if(!getline(file, header))
+		return false;
+	istringstream fields(header);
+	string hash, flatb, kind;
+	size_t n = 0;
+	fields >> hash >> flatb >> kind >> profileShape >> n;
+	if(hash != "#" || flatb != "flatb" || kind != "profile" || !fields)
+		return false;
+
+	profileCounts.clear();
+	string line;
+	while(profileCounts.size() < n && getline(file, line))
+		profileCounts.push_back(strtoull(line.c_str(), nullptr, 10));
+	profilePath = path;
+	return profileCounts.size() == n;
+}
+
+void CodeGenVisitor::instrument()
+{
+	vector<BasicBlock *> blocks = moduleBlocks(*TheModule);
+	string shape = moduleShape(blocks), names;
+	vector<BranchInst *> branches;
+	for(auto block: blocks)
+	{
+		names += (block->getParent()->getName() + ":" + block->getName() + "\n").str();
+		if(BranchInst *branch = conditionalBranch(block))
+			branches.push_back(branch);
+	}
+	for(auto branch: branches)
+		names += (branch->getParent()->getParent()->getName() + ":" + branch->getParent()->getName() + " taken\n").str();
+
+	size_t n = blocks.size() + branches.size();
+	ArrayType *countersType = ArrayType::get(IntType(), n);
+	GlobalVariable *counters = new GlobalVariable(*TheModule, countersType, false, GlobalValue::InternalLinkage,
+									ConstantAggregateZero::get(countersType), "flatb.counters");
+
+	for(size_t i = 0; i < blocks.size(); i++)
+		increment(counters, i, ConstantInt::get(IntType(), 1), &*blocks[i]->getFirstInsertionPt(), sharedFunction(blocks[i]->getParent()));
+	for(size_t i = 0; i < branches.size(); i++)
+	{
+		BranchInst *branch = branches[i];
+		Value *taken = new ZExtInst(branch->getCondition(), IntType(), "taken", branch);
+		increment(counters, blocks.size() + i, taken, branch, sharedFunction(branch->getParent()->getParent()));
+	}
+
+	// main hands the counters to the runtime as it returns
+	Type *text = PointerType::get(Type::getInt8Ty(TheContext), 0);
+	Type *params[] = { text, text, text, PointerType::get(IntType(), 0), IntType() };
+	FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), params, false);
+	Function *dump = dynamic_cast<Function *>(TheModule->getOrInsertFunction("__flatb_profile", ftype));
+	Value *zero = ConstantInt::get(IntType(), 0);
+	Value *first[] = { zero, zero };
+	Instruction *end = nullptr;
+	for(BasicBlock &block: *mainFunction)
+		if(isa<ReturnInst>(block.getTerminator()))
+			end = block.getTerminator();
+	Value *args[] = { stringConstant(profilePath), stringConstant(shape), stringConstant(names),
+						GetElementPtrInst::CreateInBounds(countersType, counters, first, "counters", end),
+						ConstantInt::get(IntType(), n) };
+	CallInst::Create(dump, args, "", end);
+}
+
+// Weights are 32 bits; both are scaled down alike and kept above zero
+static MDNode* branchWeights(LLVMContext &context, uint64_t taken, uint64_t notTaken)
+{
+	uint64_t scale = max(taken, notTaken) / UINT32_MAX + 1;
+	return MDBuilder(context).createBranchWeights(taken / scale + 1, notTaken / scale + 1);
+}
+
+// Adds hints to the loop's metadata, keeping those it has already
+static void loopHints(BranchInst *latch, vector<Metadata *> hints)
+{
+	LLVMContext &context = latch->getContext();
+	vector<Metadata *> operands = { nullptr };
+	if(MDNode *loopID = latch->getMetadata(LLVMContext::MD_loop))
+		for(unsigned i = 1; i < loopID->getNumOperands(); i++)
+		{
+			MDNode *hint = dyn_cast<MDNode>(loopID->getOperand(i));
+			MDString *name = hint ? dyn_cast<MDString>(hint->getOperand(0)) : nullptr;
+			bool replaced = false;
+			for(auto added: hints)
+				replaced |= name && cast<MDString>(cast<MDNode>(added)->getOperand(0)) == name;
+			if(!replaced)
+				operands.push_back(loopID->getOperand(i));
+		}
+	operands.insert(operands.end(), hints.begin(), hints.end());
+	MDNode *loopID = MDNode::getDistinct(context, operands);
+	loopID->replaceOperandWith(0, loopID);
+	latch->setMetadata(LLVMContext::MD_loop, loopID);
+}
+
+static Metadata* loopHint(LLVMContext &context, const char *name, bool value)
+{
+	Metadata *hint[] = { MDString::get(context, name), ConstantAsMetadata::get(ConstantInt::get(Type::getInt1Ty(context), value)) };
+	return MDNode::get(context, hint);
+}
+
+// A loop that never ran is kept small; one that runs few iterations a time is not vectorised
+static void profileLoop(Loop *loop, map<BasicBlock *, uint64_t> &blockCounts, map<BranchInst *, uint64_t> &takenCounts)
+{
+	for(auto inner: loop->getSubLoops())
+		profileLoop(inner, blockCounts, takenCounts);
+
+	BasicBlock *latchBlock = loop->getLoopLatch();
+	BranchInst *latch = latchBlock ? dyn_cast<BranchInst>(latchBlock->getTerminator()) : nullptr;
+	if(!latch)
+		return;
+	uint64_t headers = blockCounts[loop->getHeader()], backedges = blockCounts[latchBlock];
+	if(latch->isConditional())
+	{
+		uint64_t taken = takenCounts[latch];
+		backedges = latch->getSuccessor(0) == loop->getHeader() ? taken : backedges - min(taken, backedges);
+	}
+
+	LLVMContext &context = latch->getContext();
+	if(headers == 0)
+		loopHints(latch, { loopHint(context, "llvm.loop.unroll.disable", true), loopHint(context, "llvm.loop.vectorize.enable", false) });
+	else if(headers > backedges && headers / (headers - backedges) < shortTrips)
+		loopHints(latch, { loopHint(context, "llvm.loop.vectorize.enable", false) });
+}
+
+void CodeGenVisitor::applyProfile()
+{
+	vector<BasicBlock *> blocks = moduleBlocks(*TheModule);
+	vector<BranchInst *> branches;
+	for(auto block: blocks)
+		if(BranchInst *branch = conditionalBranch(block))
+			branches.push_back(branch);
+	if(moduleShape(blocks) != profileShape || profileCounts.size() != blocks.size() + branches.size())
+	{
+		cerr << "[WARNING] " << profilePath << " was recorded for a different program or options, ignoring it" << endl;
+		return;
+	}
+
+	map<BasicBlock *, uint64_t> blockCounts;
+	map<BranchInst *, uint64_t> takenCounts;
+	for(size_t i = 0; i < blocks.size(); i++)
+		blockCounts[blocks[i]] = profileCounts[i];
+	for(size_t i = 0; i < branches.size(); i++)
+	{
+		BranchInst *branch = branches[i];
+		uint64_t runs = blockCounts[branch->getParent()], taken = min(profileCounts[blocks.size() + i], runs);
+		takenCounts[branch] = taken;
+		branch->setMetadata(LLVMContext::MD_prof, branchWeights(TheContext, taken, runs - taken));
+	}
+
+	for(Function &function: *TheModule)
+	{
+		if(function.isDeclaration())
+			continue;
+		function.setEntryCount(blockCounts[&function.getEntryBlock()]);
+		DominatorTree tree(function);
+		LoopInfo loops(tree);
+		for(auto loop: loops)
+			profileLoop(loop, blockCounts, takenCounts);
+	}
+}
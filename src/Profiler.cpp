@@ -0,0 +1,342 @@
+// bcc --profile file.b runs the program with ASTProfiler. When it finishes, bcc prints
+// a hot-spot report to stderr and writes file.b.profile, a copy of the source with
+// the executions and the time spent on every line in the margin:
+//
+//	   count   self ms |
+//	       1     0.004 | 	n = 1000;
+//	       1     2.310 | 	for i = 1, n {
+//	    1000     1.892 | 		sum = sum + a[i];
+//
+// Time is measured per statement, condition and loop. A node's self time leaves out
+// the profiled nodes inside it, so the self times of all lines add up to the run.
+// Nodes without a line of their own, such as conditions and the first assignment of
+// a for loop, count towards the line of the statement they belong to. A parallel
+// for is measured as a whole: its iterations run on plain interpreters.
+#include "ASTDefinition.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+// The kinds of node visits are counted by
+enum VisitKind {ioblockvisit, gotovisit, ifelsevisit, condvisit, forvisit, whilevisit, mathexprvisit,
+				integervisit, targetvarvisit, assignmentvisit, builtinstatementvisit, builtinexprvisit,
+				codeblockvisit, declvisit, programvisit, visitkinds};
+
+static const char *kindNames[visitkinds] = {"ASTIOBlock", "ASTGotoBlock", "ASTIfElse", "ASTCondExpr",
+	"ASTForLoop", "ASTWhileLoop", "ASTMathExpr", "ASTInteger", "ASTTargetVar", "ASTAssignment",
+	"ASTBuiltinStatement", "ASTBuiltinExpr", "ASTCodeBlock", "declarations", "ASTProgram"};
+
+// How many statements the hot-spot report lists
+static const size_t hotSpots = 10;
+
+ASTProfiler::ASTProfiler(map<string, SymbolTableEntry *> symboltable, string filename):
+	ASTInterpreter(symboltable), filename(filename), visits(visitkinds, 0)
+{
+}
+
+// Starts timing node. Nodes without a line take the line of the node around them.
+ASTProfiler::Stats& ASTProfiler::enter(ASTNode *node, const char *kind)
+{
+	auto found = stats.find(node);
+	if(found == stats.end())
+	{
+		int line = node->getLine();
+		if(!line && !frames.empty())
+			line = frames.back().stats->line;
+		found = stats.insert({node, Stats{kind, line, 0, 0, 0, 0}}).first;
+	}
+	Stats &entry = found->second;
+	entry.count++;
+	frames.push_back(Frame{&entry, chrono::steady_clock::now(), 0});
+	return entry;
+}
+
+void ASTProfiler::leave()
+{
+	Frame frame = frames.back();
+	frames.pop_back();
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - frame.started).count();
+	frame.stats->total += elapsed;
+	frame.stats->self += elapsed - frame.inner;
+	if(!frames.empty())
+		frames.back().inner += elapsed;
+}
+
+void ASTProfiler::visit(ASTIOBlock *ioblock)
+{
+	visits[ioblockvisit]++;
+	enter(ioblock, "print");
+	Scope scope{this};
+	ASTInterpreter::visit(ioblock);
+}
+
+void ASTProfiler::visit(ASTGotoBlock *gotoblock)
+{
+	visits[gotovisit]++;
+	enter(gotoblock, "goto");
+	Scope scope{this};
+	ASTInterpreter::visit(gotoblock);
+}
+
+void ASTProfiler::visit(ASTIfElse *ifelse)
+{
+	visits[ifelsevisit]++;
+	enter(ifelse, "if");
+	Scope scope{this};
+	ASTInterpreter::visit(ifelse);
+}
+
+void ASTProfiler::visit(ASTCondExpr *condition)
+{
+	visits[condvisit]++;
+	ASTInterpreter::visit(condition);
+}
+
+bool ASTProfiler::visit_value(ASTCondExpr *condition)
+{
+	visits[condvisit]++;
+	Stats &entry = enter(condition, "condition");
+	Scope scope{this};
+	bool outcome = ASTInterpreter::visit_value(condition);
+	if(outcome)
+		entry.iterations++;
+	return outcome;
+}
+
+void ASTProfiler::visit(ASTForLoop *forloop)
+{
+	visits[forvisit]++;
+	enter(forloop, "for");
+	Scope scope{this};
+	ASTInterpreter::visit(forloop);
+}
+
+void ASTProfiler::visit(ASTWhileLoop *whileloop)
+{
+	visits[whilevisit]++;
+	enter(whileloop, "while");
+	Scope scope{this};
+	ASTInterpreter::visit(whileloop);
+}
+
+void ASTProfiler::visit(ASTAssignment *assignment)
+{
+	visits[assignmentvisit]++;
+	enter(assignment, "assignment");
+	Scope scope{this};
+	ASTInterpreter::visit(assignment);
+}
+
+void ASTProfiler::visit(ASTBuiltinStatement *builtin)
+{
+	visits[builtinstatementvisit]++;
+	enter(builtin, "builtin");
+	Scope scope{this};
+	ASTInterpreter::visit(builtin);
+}
+
+// A block run straight from a loop is an iteration of it
+void ASTProfiler::visit(ASTCodeBlock *code_block)
+{
+	visits[codeblockvisit]++;
+	if(!frames.empty())
+	{
+		Stats *owner = frames.back().stats;
+		if(!strcmp(owner->kind, "for") || !strcmp(owner->kind, "while"))
+			owner->iterations++;
+	}
+	ASTInterpreter::visit(code_block);
+}
+
+void ASTProfiler::visit(ASTMathExpr *mathexpr)
+{
+	visits[mathexprvisit]++;
+	ASTInterpreter::visit(mathexpr);
+}
+
+int64_t ASTProfiler::visit_value(ASTMathExpr *mathexpr)
+{
+	visits[mathexprvisit]++;
+	return ASTInterpreter::visit_value(mathexpr);
+}
+
+void ASTProfiler::visit(ASTInteger *integer)
+{
+	visits[integervisit]++;
+	ASTInterpreter::visit(integer);
+}
+
+int64_t ASTProfiler::visit_value(ASTInteger *integer)
+{
+	visits[integervisit]++;
+	return ASTInterpreter::visit_value(integer);
+}
+
+void ASTProfiler::visit(ASTTargetVar *var_location)
+{
+	visits[targetvarvisit]++;
+	ASTInterpreter::visit(var_location);
+}
+
+int64_t ASTProfiler::visit_value(ASTTargetVar *var_location)
+{
+	visits[targetvarvisit]++;
+	return ASTInterpreter::visit_value(var_location);
+}
+
+void ASTProfiler::visit_value(ASTTargetVar *var_location, int64_t value)
+{
+	visits[targetvarvisit]++;
+	ASTInterpreter::visit_value(var_location, value);
+}
+
+void ASTProfiler::visit(ASTBuiltinExpr *builtin)
+{
+	visits[builtinexprvisit]++;
+	ASTInterpreter::visit(builtin);
+}
+
+int64_t ASTProfiler::visit_value(ASTBuiltinExpr *builtin)
+{
+	visits[builtinexprvisit]++;
+	return ASTInterpreter::visit_value(builtin);
+}
+
+void ASTProfiler::visit(ASTVariable *variable)
+{
+	visits[declvisit]++;
+	ASTInterpreter::visit(variable);
+}
+
+void ASTProfiler::visit(ASTVariableSet *variableSet)
+{
+	visits[declvisit]++;
+	ASTInterpreter::visit(variableSet);
+}
+
+void ASTProfiler::visit(ASTDeclStatement *decl_line)
+{
+	visits[declvisit]++;
+	ASTInterpreter::visit(decl_line);
+}
+
+void ASTProfiler::visit(ASTDeclBlock *decl_block)
+{
+	visits[declvisit]++;
+	ASTInterpreter::visit(decl_block);
+}
+
+void ASTProfiler::visit(ASTProgram *program)
+{
+	visits[programvisit]++;
+	ASTInterpreter::visit(program);
+	report();
+	annotate();
+}
+
+static string milliseconds(double seconds)
+{
+	ostringstream text;
+	text << fixed << setprecision(3) << seconds * 1000;
+	return text.str();
+}
+
+void ASTProfiler::report()
+{
+	vector<Stats *> statements, loops, conditions;
+	double run = 0;
+	for(auto &entry: stats)
+	{
+		Stats *s = &entry.second;
+		run += s->self;
+		if(!strcmp(s->kind, "condition"))
+			conditions.push_back(s);
+		else
+			statements.push_back(s);
+		if(!strcmp(s->kind, "for") || !strcmp(s->kind, "while"))
+			loops.push_back(s);
+	}
+	auto byLine = [](Stats *a, Stats *b) { return a->line < b->line; };
+	std::stable_sort(statements.begin(), statements.end(), byLine);
+	std::stable_sort(statements.begin(), statements.end(), [](Stats *a, Stats *b) { return a->self > b->self; });
+	std::stable_sort(loops.begin(), loops.end(), byLine);
+	std::stable_sort(conditions.begin(), conditions.end(), byLine);
+
+	cerr << "Profile of " << filename << ": " << milliseconds(run) << " ms in profiled statements" << endl;
+
+	cerr << endl << "Hot spots, by self time:" << endl;
+	cerr << setw(6) << "line" << "  " << left << setw(12) << "statement" << right << setw(12) << "count"
+		<< setw(12) << "self ms" << setw(12) << "total ms" << setw(8) << "self %" << endl;
+	for(size_t i = 0; i < statements.size() && i < hotSpots; i++)
+	{
+		Stats *s = statements[i];
+		cerr << setw(6) << s->line << "  " << left << setw(12) << s->kind << right << setw(12) << s->count
+			<< setw(12) << milliseconds(s->self) << setw(12) << milliseconds(s->total)
+			<< setw(8) << fixed << setprecision(1) << (run > 0 ? 100 * s->self / run : 0) << endl;
+	}
+
+	if(!loops.empty())
+	{
+		cerr << endl << "Loops:" << endl;
+		cerr << setw(6) << "line" << "  " << left << setw(12) << "loop" << right << setw(12) << "runs"
+			<< setw(12) << "iterations" << setw(12) << "total ms" << endl;
+		for(auto s: loops)
+			cerr << setw(6) << s->line << "  " << left << setw(12) << s->kind << right << setw(12) << s->count
+				<< setw(12) << s->iterations << setw(12) << milliseconds(s->total) << endl;
+	}
+
+	if(!conditions.empty())
+	{
+		cerr << endl << "Conditions:" << endl;
+		cerr << setw(6) << "line" << setw(14) << "evaluations" << setw(12) << "true" << setw(12) << "ms" << endl;
+		for(auto s: conditions)
+			cerr << setw(6) << s->line << setw(14) << s->count << setw(12) << s->iterations
+				<< setw(12) << milliseconds(s->total) << endl;
+	}
+
+	cerr << endl << "Visits by node kind:" << endl;
+	vector<int> kinds;
+	for(int kind = 0; kind < visitkinds; kind++)
+		if(visits[kind])
+			kinds.push_back(kind);
+	std::stable_sort(kinds.begin(), kinds.end(), [this](int a, int b) { return visits[a] > visits[b]; });
+	for(auto kind: kinds)
+		cerr << "  " << left << setw(22) << kindNames[kind] << right << setw(14) << visits[kind] << endl;
+}
+
+// Writes filename.profile. The count of a line is the most executions of a statement
+// on it; the time is the self time of everything on it.
+void ASTProfiler::annotate()
+{
+	ifstream source(filename);
+	ofstream annotated(filename + ".profile");
+	if(!source || !annotated)
+	{
+		cerr << "[ERROR] Cannot write " << filename << ".profile" << endl;
+		return;
+	}
+
+	map<int, uint64_t> counts;
+	map<int, double> times;
+	for(auto &entry: stats)
+	{
+		Stats &s = entry.second;
+		if(strcmp(s.kind, "condition"))
+			counts[s.line] = max(counts[s.line], s.count);
+		times[s.line] += s.self;
+	}
+
+	annotated << setw(8) << "count" << setw(10) << "self ms" << " |" << endl;
+	string text;
+	for(int line = 1; getline(source, text); line++)
+	{
+		if(times.count(line))
+			annotated << setw(8) << counts[line] << setw(10) << milliseconds(times[line]);
+		else
+			annotated << setw(18) << "";
+		annotated << " | " << text << endl;
+	}
+}
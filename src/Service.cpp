@@ -0,0 +1,230 @@
+// bcc --service jobfile compiles and runs many programs in one process. Every line of
+// the job file names a program and, optionally, a file to use as its input:
+//
+//	sum.b
+//	read_print.b read_print.in
+//
+// Each job is compiled into a module of its own, with its own globals, and run by
+// MCJIT; the jobs run at the same time on the thread pool. Their printf and scanf
+// are bound to a buffer and an input file of the job's own, and once every job has
+// finished the outputs are printed in the order of the job file. A parallel loop
+// inside a job runs on the job's thread, since the pool is busy with the jobs, and
+// its ordered prints go to the job's buffer too.
+#include "ASTDefinition.h"
+#include <cstdarg>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Support/TargetSelect.h"
+#include "runtime/Output.h"
+#include "runtime/ThreadPool.h"
+#include "runtime/flatbrt.h"
+
+using namespace std;
+using namespace llvm;
+
+struct Job
+{
+	string source, input;
+	string output;				// what the program printed
+	vector<string> errors;		// why it could not be run
+	int status;
+};
+
+// The standard streams of the job running on this thread
+struct JobStreams
+{
+	FILE *in, *out;
+};
+
+static thread_local JobStreams *streams = nullptr;
+
+static int jobPrintf(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int written = vfprintf(streams->out, format, args);
+	va_end(args);
+	return written;
+}
+
+static int jobScanf(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int read = vfscanf(streams->in, format, args);
+	va_end(args);
+	return read;
+}
+
+// Binds the symbols that compiled programs import to the job's streams and to the
+// runtime linked into bcc; everything else is looked up in the process
+class JobMemoryManager: public SectionMemoryManager
+{
+	public:
+		uint64_t getSymbolAddress(const string &name) override
+		{
+			static const map<string, uint64_t> runtime = {
+				{"__flatb_parallel_for", (uint64_t) &__flatb_parallel_for},
+				{"__flatb_printf", (uint64_t) &__flatb_printf},
+				{"__flatb_fill", (uint64_t) &__flatb_fill},
+				{"__flatb_copy", (uint64_t) &__flatb_copy},
+				{"__flatb_sum", (uint64_t) &__flatb_sum},
+				{"__flatb_min", (uint64_t) &__flatb_min},
+				{"__flatb_max", (uint64_t) &__flatb_max},
+				{"__flatb_count", (uint64_t) &__flatb_count},
+			};
+
+			if(name == "printf")
+				return (uint64_t) &jobPrintf;
+			if(name == "scanf")
+				return (uint64_t) &jobScanf;
+			auto function = runtime.find(name);
+			if(function != runtime.end())
+				return function->second;
+			return SectionMemoryManager::getSymbolAddress(name);
+		}
+};
+
+static void execute(Job &job, CodeGenVisitor &cgv)
+{
+	string error;
+	unique_ptr<ExecutionEngine> engine(EngineBuilder(cgv.takeModule())
+		.setEngineKind(EngineKind::JIT)
+		.setMCJITMemoryManager(unique_ptr<RTDyldMemoryManager>(new JobMemoryManager))
+		.setErrorStr(&error)
+		.create());
+	if(!engine)
+	{
+		job.errors.push_back(error);
+		return;
+	}
+	engine->finalizeObject();
+	int (*main)() = (int (*)()) engine->getFunctionAddress("main");
+
+	FILE *in = fopen(job.input.empty() ? "/dev/null" : job.input.c_str(), "r");
+	if(!in)
+	{
+		job.errors.push_back("Cannot open " + job.input);
+		return;
+	}
+	char *buffer = nullptr;
+	size_t size = 0;
+	JobStreams jobStreams = {in, open_memstream(&buffer, &size)};
+
+	streams = &jobStreams;
+	flatb::setOutput(jobStreams.out);
+	job.status = main();
+	flatb::setOutput(nullptr);
+	streams = nullptr;
+
+	fclose(jobStreams.out);
+	fclose(in);
+	job.output.assign(buffer, size);
+	free(buffer);
+}
+
+static void run(Job &job, bool autoParallel)
+{
+	FILE *file = fopen(job.source.c_str(), "r");
+	if(!file)
+	{
+		job.errors.push_back("Cannot open " + job.source);
+		return;
+	}
+	ASTProgram *program;
+	bool parsed = parseProgram(file, program);
+	fclose(file);
+	if(!parsed)
+	{
+		job.errors.push_back("Syntax error");
+		return;
+	}
+	if(!program)
+	{
+		job.status = 0;
+		return;
+	}
+
+	ASTVisitor v(nullptr);
+	try
+	{
+		v.visit(program);
+	}
+	catch(SemanticError &e)
+	{
+		job.errors = e.errors;
+		return;
+	}
+	map<string, SymbolTableEntry *> symboltable = v.getSymbolTable();
+
+	ASTConstantFolder cf(symboltable);
+	cf.visit(program);
+	if(autoParallel)
+	{
+		ASTAutoParallel ap(symboltable);
+		ap.visit(program);
+	}
+
+	CodeGenVisitor cgv(symboltable);
+	if(cgv.buildModule(program, job.source))
+		execute(job, cgv);
+	else
+		job.errors.push_back("Code generation failed");
+
+	for(auto &entry: symboltable)
+		delete entry.second;
+}
+
+int runService(const char *jobfile, bool autoParallel)
+{
+	ifstream list(jobfile);
+	if(!list)
+	{
+		cerr << "Cannot open " << jobfile << endl;
+		return 1;
+	}
+
+	vector<Job> jobs;
+	string line;
+	while(getline(list, line))
+	{
+		Job job;
+		istringstream words(line);
+		if(!(words >> job.source))
+			continue;
+		words >> job.input;
+		job.status = -1;
+		jobs.push_back(job);
+	}
+
+	InitializeNativeTarget();
+	InitializeNativeTargetAsmPrinter();
+
+	flatb::ThreadPool::instance().parallelFor(jobs.size(), flatb::dynamicchunking,
+		[&](int64_t first, int64_t last)
+		{
+			for(int64_t i = first; i < last; i++)
+				run(jobs[i], autoParallel);
+		});
+
+	int failed = 0;
+	for(auto &job: jobs)
+	{
+		cout << "==> " << job.source << " <==" << endl;
+		cout << job.output;
+		if(!job.output.empty() && job.output.back() != '\n')
+			cout << endl;
+		for(auto error: job.errors)
+			cout << "[ERROR] " << error << endl;
+		if(!job.errors.empty() || job.status != 0)
+			failed++;
+		if(job.errors.empty() && job.status != 0)
+			cout << "[exit " << job.status << "]" << endl;
+	}
+	return failed ? 1 : 0;
+}
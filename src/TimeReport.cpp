@@ -0,0 +1,268 @@
+// bcc --time-report prints, when bcc exits, how long each phase of the run took and
+// how memory grew meanwhile:
+//
+//	phase                          wall ms    cpu ms   heap KB    RSS KB
+//	parse                            0.412     0.410       +38      4120
+//	...
+//
+// wall and cpu are the phase's elapsed and process CPU time, heap is the change in
+// bytes malloc has handed out, RSS the resident set at the end of the phase. Phases
+// opened inside another are indented beneath it, and so are the LLVM passes that
+// ran during a phase, taken from LLVM's own pass timers. --time-report=json prints
+// the same tree as JSON.
+#include "ASTDefinition.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <malloc.h>
+#include <sstream>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "runtime/flatbrt.h"
+
+#include "llvm/Pass.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace std;
+using namespace llvm;
+
+struct PhaseRow
+{
+	string name;
+	bool llvm;					// an LLVM pass, which only has a wall time
+	double wall, cpu;			// milliseconds
+	int64_t heap, rss;			// bytes
+	vector<PhaseRow *> children;
+
+	// at the start of the phase
+	chrono::steady_clock::time_point started;
+	clock_t cpuStarted;
+	int64_t heapStarted;
+
+	PhaseRow(string name, bool llvm = false): name(name), llvm(llvm), wall(0), cpu(0), heap(0), rss(0) {}
+};
+
+static bool reporting = false, json = false;
+static PhaseRow *total;
+static int64_t peak = 0;				// the largest resident set, in bytes
+static vector<PhaseRow *> running;		// the phases open now, outermost first
+
+// Only a few passes are listed by name under a phase; the rest share a line
+static const size_t passesShown = 8;
+
+static int64_t heapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	struct mallinfo2 info = mallinfo2();
+#else
+	struct mallinfo info = mallinfo();
+#endif
+	return (int64_t) info.uordblks + info.hblkhd;
+}
+
+static int64_t residentSet()
+{
+	long pages = 0, resident = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if(statm)
+	{
+		if(fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		fclose(statm);
+	}
+	return (int64_t) resident * sysconf(_SC_PAGESIZE);
+}
+
+static void begin(PhaseRow *row)
+{
+	row->started = chrono::steady_clock::now();
+	row->cpuStarted = clock();
+	row->heapStarted = heapInUse();
+}
+
+static void end(PhaseRow *row)
+{
+	row->wall = chrono::duration<double, milli>(chrono::steady_clock::now() - row->started).count();
+	row->cpu = 1000.0 * (clock() - row->cpuStarted) / CLOCKS_PER_SEC;
+	row->heap = heapInUse() - row->heapStarted;
+	row->rss = residentSet();
+	peak = max(peak, row->rss);
+}
+
+// Moves what LLVM's pass timers have recorded since they were last read into rows
+// under parent, if the report is on, and into the trace. The timers print themselves
+// as lines ending in the wall time and the pass name, "   0.0012 ( 40.0%)  Loop
+// Vectorization", and are reset by printing.
+static void collectPasses(PhaseRow *parent)
+{
+	string text;
+	raw_string_ostream stream(text);
+	TimerGroup::printAll(stream);
+	stream.flush();
+
+	map<string, double> passes;
+	istringstream lines(text);
+	string line;
+	while(getline(lines, line))
+	{
+		size_t percent = line.rfind("%)");
+		size_t paren = line.rfind('(', percent);
+		if(percent == string::npos || paren == string::npos)
+			continue;
+		string name = line.substr(percent + 2);
+		name.erase(0, name.find_first_not_of(' '));
+		// a pass that runs several times in the pipeline may be numbered, "#2"
+		size_t hash = name.rfind(" #");
+		if(hash != string::npos && name.find_first_not_of("0123456789", hash + 2) == string::npos)
+			name.erase(hash);
+		if(name.empty() || name == "Total")
+			continue;
+		size_t number = line.find_last_not_of(' ', paren - 1);
+		number = line.find_last_of(' ', number);
+		passes[name] += 1000 * atof(line.c_str() + number + 1);
+	}
+
+	vector<pair<string, double>> sorted(passes.begin(), passes.end());
+	std::sort(sorted.begin(), sorted.end(), [](const pair<string, double> &a, const pair<string, double> &b) { return a.second > b.second; });
+	if(traceEnabled())
+		tracePasses(sorted);
+	if(!parent)
+		return;
+
+	vector<PhaseRow *> rows;
+	for(auto pass: sorted)
+	{
+		PhaseRow *row = new PhaseRow(pass.first, true);
+		row->wall = pass.second;
+		rows.push_back(row);
+	}
+
+	if(rows.size() > passesShown)
+	{
+		PhaseRow *rest = new PhaseRow(to_string(rows.size() - passesShown) + " other passes", true);
+		for(size_t i = passesShown; i < rows.size(); i++)
+		{
+			rest->wall += rows[i]->wall;
+			delete rows[i];
+		}
+		rows.resize(passesShown);
+		rows.push_back(rest);
+	}
+	parent->children.insert(parent->children.end(), rows.begin(), rows.end());
+}
+
+static void printTable(PhaseRow *row, int depth)
+{
+	string name = string(2 * depth, ' ') + row->name;
+	if(name.size() < 36)
+		name.resize(36, ' ');
+	if(row->llvm)
+		fprintf(stderr, "%s %9.3f\n", name.c_str(), row->wall);
+	else
+		fprintf(stderr, "%s %9.3f %9.3f %+9lld %9lld\n", name.c_str(), row->wall, row->cpu,
+			(long long) row->heap / 1024, (long long) row->rss / 1024);
+	for(auto child: row->children)
+		printTable(child, depth + 1);
+}
+
+static void printJSON(PhaseRow *row, int depth)
+{
+	string indent(depth, '\t');
+	fprintf(stderr, "%s{\"name\": %s, \"wall_ms\": %.3f", indent.c_str(), flatb::quoted(row->name).c_str(), row->wall);
+	if(row->llvm)
+		fprintf(stderr, ", \"llvm_pass\": true");
+	else
+		fprintf(stderr, ", \"cpu_ms\": %.3f, \"heap_kb\": %lld, \"rss_kb\": %lld", row->cpu,
+			(long long) row->heap / 1024, (long long) row->rss / 1024);
+	if(row == total)
+		fprintf(stderr, ", \"peak_rss_kb\": %lld", (long long) peak / 1024);
+
+	if(!row->children.empty())
+	{
+		fprintf(stderr, ", \"phases\": [\n");
+		for(size_t i = 0; i < row->children.size(); i++)
+		{
+			printJSON(row->children[i], depth + 1);
+			fprintf(stderr, i + 1 < row->children.size() ? ",\n" : "\n");
+		}
+		fprintf(stderr, "%s]", indent.c_str());
+	}
+	fprintf(stderr, "}");
+}
+
+// Runs at exit, which may come from inside a phase when bcc stops on an error
+static void printReport()
+{
+	while(!running.empty())
+	{
+		collectPasses(running.back());
+		end(running.back());
+		running.pop_back();
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	peak = max(peak, (int64_t) usage.ru_maxrss * 1024);
+
+	if(json)
+	{
+		printJSON(total, 0);
+		fprintf(stderr, "\n");
+		return;
+	}
+	fprintf(stderr, "%-36s %9s %9s %9s %9s\n", "phase", "wall ms", "cpu ms", "heap KB", "RSS KB");
+	for(auto child: total->children)
+		printTable(child, 0);
+	fprintf(stderr, "%-36s %9.3f %9.3f %+9lld %9lld\n", "total", total->wall, total->cpu,
+		(long long) total->heap / 1024, (long long) total->rss / 1024);
+	fprintf(stderr, "%-36s %49lld\n", "peak RSS KB", (long long) peak / 1024);
+}
+
+void enableTimeReport(bool asJSON)
+{
+	reporting = true;
+	json = asJSON;
+	TimePassesIsEnabled = true;
+
+	total = new PhaseRow("total");
+	begin(total);
+	running.push_back(total);
+	atexit(printReport);
+}
+
+TimedPhase::TimedPhase(const char *name): row(nullptr), traced(traceEnabled()), measured(memReportEnabled())
+{
+	if(measured)
+		memoryPhaseBegin(name);
+	if(!reporting && !traced)
+		return;
+	// passes that ran before this phase belong to the one around it
+	collectPasses(reporting ? running.back() : nullptr);
+	if(traced)
+		traceBegin(name, "compile", "");
+	if(!reporting)
+		return;
+
+	row = new PhaseRow(name);
+	running.back()->children.push_back(row);
+	running.push_back(row);
+	begin(row);
+}
+
+TimedPhase::~TimedPhase()
+{
+	if(row && !running.empty() && running.back() == row)
+	{
+		end(row);
+		collectPasses(row);
+		running.pop_back();
+	}
+	else if(traced)
+		collectPasses(nullptr);
+	if(traced)
+		traceEnd();
+	if(measured)
+		memoryPhaseEnd();
+}
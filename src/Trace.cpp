@@ -0,0 +1,264 @@
+// bcc --trace=out.json writes the run as Chrome trace events, which chrome://tracing,
+// Perfetto and speedscope show as a timeline. The compile phases are the phases of
+// --time-report; under them are the time spent in the scanner and the LLVM passes
+// that ran, each summed over its calls and laid end to end at the close of the phase
+// it ran in. With --interpret, the run shows every top-level statement and every loop
+// the interpreter executes.
+//
+// A program compiled with --trace marks each top-level statement it runs, and adds
+// those to the same file when main returns (see runtime/Trace.cpp), on a clock
+// shared with bcc, so one timeline holds the compile and later runs.
+#include "ASTDefinition.h"
+#include <cstring>
+#include <unistd.h>
+#include "runtime/flatbrt.h"
+
+#include "llvm/Pass.h"
+
+using namespace std;
+
+// Trace slices are complete ("X") events; open ones have no duration yet
+struct TraceEvent
+{
+	string name;
+	const char *category;
+	int thread;
+	int64_t start, duration;		// microseconds
+	string args;					// JSON members, or nothing
+};
+
+static bool tracing = false;
+static string tracePath, traceProcess;
+static vector<TraceEvent> traceEvents;
+static vector<size_t> openEvents;
+static int64_t scanTime = 0, tokens = 0;
+static uint64_t dropped = 0;
+
+// Stops recording statements and loops past this many events, so long runs stay viewable
+static const size_t eventLimit = 200000;
+
+// Threads of the trace: bcc's phases, and the interpreter's statements
+enum TraceThread {compileThread = 1, runThread = 2};
+
+static int64_t microseconds()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void writeTrace()
+{
+	while(!openEvents.empty())
+		traceEnd();
+	FILE *file = fopen(tracePath.c_str(), "w");
+	if(!file)
+	{
+		fprintf(stderr, "[ERROR] Cannot write the trace %s\n", tracePath.c_str());
+		return;
+	}
+	int pid = getpid();
+	fprintf(file, "[\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": %s}}", pid, flatb::quoted(traceProcess).c_str());
+	fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"compile\"}}", pid, compileThread);
+	fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"interpreter\"}}", pid, runThread);
+	for(auto &event: traceEvents)
+	{
+		fprintf(file, ",\n{\"name\": %s, \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %lld, \"dur\": %lld",
+			flatb::quoted(event.name).c_str(), event.category, pid, event.thread, (long long)event.start, (long long)event.duration);
+		if(!event.args.empty())
+			fprintf(file, ", \"args\": {%s}", event.args.c_str());
+		fprintf(file, "}");
+	}
+	if(dropped)
+		fprintf(file, ",\n{\"name\": \"dropped events\", \"ph\": \"i\", \"s\": \"p\", \"pid\": %d, \"tid\": %d, \"ts\": %lld, \"args\": {\"count\": %llu}}",
+			pid, runThread, (long long)microseconds(), (unsigned long long)dropped);
+	fprintf(file, "\n]\n");
+	fclose(file);
+}
+
+void enableTrace(string path, string program)
+{
+	tracing = true;
+	tracePath = path;
+	traceProcess = "bcc " + program;
+	TimePassesIsEnabled = true;
+	atexit(writeTrace);
+}
+
+bool traceEnabled()
+{
+	return tracing;
+}
+
+void traceBegin(string name, const char *category, string args)
+{
+	bool run = strcmp(category, "compile") != 0;
+	if(run && traceEvents.size() >= eventLimit)
+	{
+		dropped++;
+		openEvents.push_back(SIZE_MAX);
+		return;
+	}
+	openEvents.push_back(traceEvents.size());
+	traceEvents.push_back(TraceEvent{name, category, run ? runThread : compileThread, microseconds(), 0, args});
+}
+
+// Time the scanner spent inside the slice goes into one slice at its end
+void traceEnd()
+{
+	size_t index = openEvents.back();
+	openEvents.pop_back();
+	if(index == SIZE_MAX)
+		return;
+	int64_t now = microseconds();
+	if(tokens)
+	{
+		traceEvents.push_back(TraceEvent{"scan", "compile", compileThread, now - scanTime, scanTime, "\"tokens\": " + to_string(tokens)});
+		scanTime = tokens = 0;
+	}
+	traceEvents[index].duration = now - traceEvents[index].start;
+}
+
+void tracePasses(vector<pair<string, double>> &passes)
+{
+	int64_t end = microseconds();
+	for(auto &pass: passes)
+	{
+		int64_t duration = pass.second * 1000;
+		traceEvents.push_back(TraceEvent{pass.first, "llvm", compileThread, end - duration, duration, ""});
+		end -= duration;
+	}
+}
+
+// Called by the parser in place of yylex; --mem-report counts the tokens here too
+int tracedLex()
+{
+	extern int yylex();
+	if(!tracing)
+	{
+		int token = yylex();
+		countLexeme(token);
+		return token;
+	}
+	int64_t started = microseconds();
+	int token = yylex();
+	scanTime += microseconds() - started;
+	tokens++;
+	countLexeme(token);
+	return token;
+}
+
+/*************************** ASTTracer ***************************************/
+
+ASTTracer::ASTTracer(map<string, SymbolTableEntry *> symboltable): ASTInterpreter(symboltable)
+{
+}
+
+// Opens a slice for a top-level statement or a loop; the scope closes it
+bool ASTTracer::enter(ASTCodeStatement *statement, const char *kind)
+{
+	bool loop = !strcmp(kind, "for") || !strcmp(kind, "while");
+	if(!loop && !topLevel.count(statement))
+		return false;
+	int line = statement->getLine();
+	traceBegin(string(kind) + " (line " + to_string(line) + ")", "run", "\"line\": " + to_string(line));
+	return true;
+}
+
+void ASTTracer::visit(ASTIOBlock *ioblock)
+{
+	Scope scope{enter(ioblock, "print")};
+	ASTInterpreter::visit(ioblock);
+}
+
+void ASTTracer::visit(ASTGotoBlock *gotoblock)
+{
+	Scope scope{enter(gotoblock, "goto")};
+	ASTInterpreter::visit(gotoblock);
+}
+
+void ASTTracer::visit(ASTIfElse *ifelse)
+{
+	Scope scope{enter(ifelse, "if")};
+	ASTInterpreter::visit(ifelse);
+}
+
+void ASTTracer::visit(ASTForLoop *forloop)
+{
+	Scope scope{enter(forloop, "for")};
+	ASTInterpreter::visit(forloop);
+}
+
+void ASTTracer::visit(ASTWhileLoop *whileloop)
+{
+	Scope scope{enter(whileloop, "while")};
+	ASTInterpreter::visit(whileloop);
+}
+
+void ASTTracer::visit(ASTAssignment *assignment)
+{
+	Scope scope{enter(assignment, "assignment")};
+	ASTInterpreter::visit(assignment);
+}
+
+void ASTTracer::visit(ASTBuiltinStatement *builtin)
+{
+	Scope scope{enter(builtin, "builtin")};
+	ASTInterpreter::visit(builtin);
+}
+
+void ASTTracer::visit(ASTProgram *program)
+{
+	if(program->code_block)
+		topLevel.insert(program->code_block->statements.begin(), program->code_block->statements.end());
+	ASTInterpreter::visit(program);
+}
+
+/*************************** Compiled programs *******************************/
+
+void CodeGenVisitor::enableTracing(string path)
+{
+	tracePath = path;
+}
+
+// Marks the start of a top-level statement: where its code begins in startBlock after
+// the instruction before, or at its label, which gotos to it enter by
+void CodeGenVisitor::traceStatement(ASTCodeStatement *statement, BasicBlock *startBlock, Instruction *before)
+{
+	Instruction *at;
+	if(!statement->label.empty())
+		at = &*labels[statement->label]->getFirstInsertionPt();
+	else if(!before)
+		at = startBlock->empty() ? nullptr : &startBlock->front();
+	else if(!before->isTerminator())
+		at = before->getNextNode();
+	else
+		return;				// no way in but by a label
+	if(!at)
+		return;
+
+	if(!TraceStatement)
+	{
+		Type *text = PointerType::get(Type::getInt8Ty(TheContext), 0);
+		FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), text, false);
+		TraceStatement = dynamic_cast<Function *>(TheModule->getOrInsertFunction("__flatb_trace_statement", ftype));
+	}
+	string kind = dynamic_cast<ASTForLoop *>(statement) ? "for" : dynamic_cast<ASTWhileLoop *>(statement) ? "while"
+		: dynamic_cast<ASTIfElse *>(statement) ? "if" : dynamic_cast<ASTGotoBlock *>(statement) ? "goto"
+		: dynamic_cast<ASTIOBlock *>(statement) ? "print" : dynamic_cast<ASTAssignment *>(statement) ? "assignment" : "builtin";
+	Value *name = stringConstant(kind + " (line " + to_string(statement->getLine()) + ")");
+	CallInst::Create(TraceStatement, name, "", at);
+}
+
+// main hands the slices to the runtime as it returns
+void CodeGenVisitor::traceWrite(string filename)
+{
+	Type *text = PointerType::get(Type::getInt8Ty(TheContext), 0);
+	Type *params[] = { text, text };
+	FunctionType *ftype = FunctionType::get(Type::getVoidTy(TheContext), params, false);
+	Function *write = dynamic_cast<Function *>(TheModule->getOrInsertFunction("__flatb_trace_write", ftype));
+	for(BasicBlock &block: *mainFunction)
+		if(isa<ReturnInst>(block.getTerminator()))
+		{
+			Value *args[] = { stringConstant(tracePath), stringConstant(filename) };
+			CallInst::Create(write, args, "", block.getTerminator());
+		}
+}
@@ -2,12 +2,20 @@
   #include "ASTDefinition.h"
   #include <stdio.h>
   #include <stdlib.h>
+  #include <string.h>
+  #include <limits.h>
+  #include <mutex>
   
   #define YYDEBUG 1
+  // Deeply nested loops and conditions need a deep stack
+  #define YYMAXDEPTH 10000000
 
   int yylex (void);
+  int tracedLex (void);
+  #define yylex tracedLex
   void yyerror (char const *s);
   ASTProgram *start = nullptr;
+  bool quiet = false;
 %}
 
 %type <program> program
@@ -18,6 +26,8 @@
 %type <code_block> statements
 %type <code_statement> statement_line
 %type <assignment> assignment
+%type <builtin> builtin
+%type <builtin_expr> builtin_expr
 %type <var_location> identifier
 %type <mathexpr> mathexp
 %type <forloop> forloop
@@ -31,6 +41,8 @@
 %token CODEBLOCK
 %token <number> NUMBER
 %token FORLOOP
+%token PARALLEL
+%token DYNAMIC
 %token WHILELOOP
 %token IF
 %token ELSE
@@ -45,6 +57,8 @@
 %token GEQ
 %token NEQ
 
+%locations
+
 %left '+'
 %left '-'
 %left '*'
@@ -56,19 +70,26 @@
 program:		DECLBLOCK '{' declaration '}' CODEBLOCK '{' statements '}'
 				{
 					$$ = new ASTProgram($3, $7);
+					$$->setLine(@1.first_line);
 					start = $$;
 				}
 				| DECLBLOCK '{' '}'	CODEBLOCK '{' statements '}'
 				{
 					$$ = new ASTProgram($6);
+					$$->setLine(@1.first_line);
+					start = $$;
 				}
 				|DECLBLOCK '{' declaration '}' CODEBLOCK '{' '}'
 				{
 					$$ = new ASTProgram($3);
+					$$->setLine(@1.first_line);
+					start = $$;
 				}
 				|DECLBLOCK '{' '}' CODEBLOCK '{' '}'
 				{
 					$$ = new ASTProgram();
+					$$->setLine(@1.first_line);
+					start = $$;
 				}
 				;
 
@@ -103,6 +124,7 @@ midentifiers:	identifierdecl
 statements:		statements IDENTIFIER ':' statement_line		/* Note to self: include goto */
 				{
 					$4->setLabel($2);
+					$4->setLine(@2.first_line);
 					$4->setParent($$);
 					$$->addStatement($4);
 				}
@@ -110,16 +132,19 @@ statements:		statements IDENTIFIER ':' statement_line		/* Note to self: include
 				{
 					$$ = new ASTCodeBlock();
 					$3->setLabel($1);
+					$3->setLine(@1.first_line);
 					$3->setParent($$);
 					$$->addStatement($3);
 				}
 				| statements statement_line
 				{
+					$2->setLine(@2.first_line);
 					$$->addStatement($2);
 				}
 				| statement_line
 				{
 					$$ = new ASTCodeBlock();
+					$1->setLine(@1.first_line);
 					$$->addStatement($1);
 				}
 				;
@@ -136,11 +161,18 @@ identifier:		IDENTIFIER '[' mathexp ']'
 
 identifierdecl:	IDENTIFIER '[' NUMBER ']'				/* identifier declaration */
 				{
+					if($3 > UINT_MAX)
+					{
+						fprintf(stderr, "[ERROR] Line %d: array %s of %lld elements is too large\n", @3.first_line, $1, $3);
+						YYERROR;
+					}
 					$$ = new ASTVariable(string($1), true, $3);
+					$$->setLine(@1.first_line);
 				}
 				| IDENTIFIER
 				{
 					$$ = new ASTVariable(string($1), false);
+					$$->setLine(@1.first_line);
 				}
 				;
 
@@ -181,6 +213,20 @@ mathexp:		mathexp '+' mathexp
 				{
 					$$ = $1;
 				}
+				| builtin_expr
+				{
+					$$ = $1;
+				}
+				;
+
+builtin_expr:	IDENTIFIER '(' IDENTIFIER ',' mathexp ',' mathexp ')'
+				{
+					$$ = new ASTBuiltinExpr($1, $3, {$5, $7});
+				}
+				| IDENTIFIER '(' IDENTIFIER ',' mathexp ',' mathexp ',' mathexp ')'
+				{
+					$$ = new ASTBuiltinExpr($1, $3, {$5, $7, $9});
+				}
 				;
 
 assignment:		identifier '=' mathexp
@@ -239,6 +285,16 @@ statement_line:	assignment ';'
 				{
 					$$ = $1;
 				}
+				| PARALLEL forloop
+				{
+					$2->setSchedule(staticchunks);
+					$$ = $2;
+				}
+				| PARALLEL DYNAMIC forloop
+				{
+					$3->setSchedule(dynamicchunks);
+					$$ = $3;
+				}
 				| whileloop
 				{
 					$$ = $1;
@@ -255,6 +311,16 @@ statement_line:	assignment ';'
 				{
 					$$ = $1;
 				}
+				| builtin ';'
+				{
+					$$ = $1;
+				}
+				;
+
+builtin:		IDENTIFIER IDENTIFIER ',' mathexp ',' mathexp ',' mathexp
+				{
+					$$ = new ASTBuiltinStatement($1, $2, $4, $6, $8);
+				}
 				;
 
 forloop:		FORLOOP assignment ',' mathexp ',' mathexp '{' statements '}'
@@ -321,29 +387,179 @@ void yyerror (char const *s)
 	   fprintf (stderr, "%s\n", s);
 }
 
+bool parseProgram(FILE *file, ASTProgram *&program)
+{
+	static mutex parsing;
+	lock_guard<mutex> hold(parsing);
+	extern int yylineno;
+	extern void yyrestart(FILE *);
+
+	start = nullptr;
+	yylineno = 1;
+	yyrestart(file);
+	bool parsed = yyparse() == 0;
+	program = start;
+	return parsed;
+}
+
 int main(int argc, char *argv[])
 {
-	extern FILE *yyin;
-	if (argc == 1 ) {
-		fprintf(stderr, "Correct usage: bcc filename\n");
+	vector<string> filenames;
+	bool debugInfo = false;
+	bool optimize = false;
+	bool objects = false;
+	bool autoParallel = false;
+	bool outline = false;
+	bool interpret = false;
+	bool service = false;
+	bool profile = false;
+	const char *timeReport = nullptr;
+	const char *memReport = nullptr;
+	bool instrument = false;
+	const char *profileFile = nullptr;
+	const char *trace = nullptr;
+	const char *usage = "Correct usage: bcc [-g] [-q] [-O] [-c] [-fauto-parallel] [-foutline-loops] [--time-report[=json]] [--mem-report[=json]] [--trace=out.json] [--instrument | --use-profile[=counts]] [--interpret | --profile | --service] filename...\n";
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-g") == 0)
+			debugInfo = true;
+		else if (strcmp(argv[i], "-q") == 0)
+			quiet = true;
+		else if (strcmp(argv[i], "-O") == 0)
+			optimize = true;
+		else if (strcmp(argv[i], "-c") == 0)
+			objects = true;
+		else if (strcmp(argv[i], "-fauto-parallel") == 0)
+			autoParallel = true;
+		else if (strcmp(argv[i], "-foutline-loops") == 0)
+			outline = true;
+		else if (strcmp(argv[i], "--interpret") == 0)
+			interpret = true;
+		else if (strcmp(argv[i], "--profile") == 0)
+			interpret = profile = true;
+		else if (strcmp(argv[i], "--service") == 0)
+			service = true;
+		else if (strcmp(argv[i], "--time-report") == 0 || strcmp(argv[i], "--time-report=json") == 0)
+			timeReport = argv[i];
+		else if (strcmp(argv[i], "--mem-report") == 0 || strcmp(argv[i], "--mem-report=json") == 0)
+			memReport = argv[i];
+		else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8])
+			trace = argv[i] + 8;
+		else if (strcmp(argv[i], "--instrument") == 0)
+			instrument = true;
+		else if (strcmp(argv[i], "--use-profile") == 0)
+			profileFile = "";
+		else if (strncmp(argv[i], "--use-profile=", 14) == 0)
+			profileFile = argv[i] + 14;
+		else
+			filenames.push_back(argv[i]);
+	}
+
+	// the reports and the trace follow the phases of a single file, and a profile belongs to one program
+	bool pgo = instrument || profileFile;
+	if (filenames.empty() || (filenames.size() > 1 && (interpret || service || timeReport || memReport || trace || pgo)) || (service && (timeReport || memReport || trace))
+		|| (instrument && profileFile) || (pgo && (interpret || service))) {
+		fprintf(stderr, "%s", usage);
 		exit(1);
 	}
+	const char *filename = filenames[0].c_str();
 
-	if (argc > 2) {
-		fprintf(stderr, "Passing more arguments than necessary.\n");
-		fprintf(stderr, "Correct usage: bcc filename\n");
+	if (service) {
+		quiet = true;
+		return runService(filename, autoParallel);
 	}
-	yyin = fopen(argv[1], "r");
+	if (filenames.size() > 1) {
+		quiet = true;
+		return compileBatch(filenames, debugInfo, autoParallel, optimize, objects, outline);
+	}
+
+	if (timeReport)
+		enableTimeReport(strcmp(timeReport, "--time-report=json") == 0);
+	if (memReport)
+		enableMemReport(strcmp(memReport, "--mem-report=json") == 0);
+	if (trace)
+		enableTrace(trace, filename);
 
-	yyparse();
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		exit(1);
+	}
+	ASTProgram *program;
+	{
+		TimedPhase phase("parse");
+		if (!parseProgram(file, program))
+			exit(1);
+	}
+	countAST(program);
 
-	if(start)
+	if(program)
 	{
 		ASTVisitor v;
-		v.visit(start);
-		//ASTInterpreter itpr(v.getSymbolTable());
-		//itpr.visit(start);
+		try {
+			TimedPhase phase("check and AST_XML");
+			v.visit(program);
+			if (memReportEnabled())
+				countSymbolTable("checker", v.getSymbolTable());
+		}
+		catch (SemanticError &e) {
+			for (auto error: e.errors)
+				cerr << "[ERROR] " << error << endl;
+			exit(1);
+		}
+		{
+			TimedPhase phase("fold constants");
+			ASTConstantFolder cf(v.getSymbolTable());
+			cf.visit(program);
+		}
+		if(autoParallel)
+		{
+			TimedPhase phase("auto-parallel");
+			ASTAutoParallel ap(v.getSymbolTable());
+			ap.visit(program);
+			// the report is asked for by -fauto-parallel, so -q keeps it; it goes to
+			// stderr to stay apart from what the program prints
+			cerr << "Auto-parallelization report:" << endl;
+			for(auto line: ap.report)
+				cerr << "  " << line << endl;
+		}
+		if(interpret)
+		{
+			TimedPhase phase("interpret");
+			if(profile)
+			{
+				ASTProfiler profiler(v.getSymbolTable(), filename);
+				profiler.visit(program);
+				return 0;
+			}
+			if(trace)
+			{
+				ASTTracer tracer(v.getSymbolTable());
+				tracer.visit(program);
+				return 0;
+			}
+			ASTInterpreter itpr(v.getSymbolTable());
+			itpr.visit(program);
+			return 0;
+		}
 		CodeGenVisitor cgv(v.getSymbolTable());
-		cgv.generateCode(start, argv[1]);
+		if(debugInfo)
+			cgv.enableDebugInfo();
+		if(optimize)
+			cgv.enableOptimization();
+		if(objects)
+			cgv.enableObjectOutput();
+		if(outline)
+			cgv.enableOutlining();
+		string counts = profileFile && *profileFile ? profileFile : string(filename) + ".counts";
+		if(instrument)
+			cgv.enableInstrumentation(counts);
+		if(trace)
+			cgv.enableTracing(trace);
+		if(profileFile && !cgv.useProfile(counts)) {
+			cerr << "[ERROR] Cannot read the profile " << counts << endl;
+			exit(1);
+		}
+		cgv.generateCode(program, filename);
 	}
 }
@@ -0,0 +1,307 @@
+// The array kernels of flatbrt.h. Each comes in a scalar version and in versions for
+// AVX2 and AVX-512, which are compiled for those instruction sets alone so that the
+// rest of the runtime still runs anywhere. The first call picks the widest version
+// the processor supports. FLATB_KERNELS=scalar, avx2 or avx512 asks for a narrower
+// one instead, which lets one machine check every version against the others.
+#include "flatbrt.h"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define FLATB_X86_KERNELS
+#endif
+
+using namespace std;
+
+namespace
+{
+
+// Each kernel works on the n elements starting at a
+struct Kernels
+{
+	void (*fill)(int64_t *, int64_t, int64_t);
+	int64_t (*sum)(const int64_t *, int64_t);
+	int64_t (*min)(const int64_t *, int64_t);
+	int64_t (*max)(const int64_t *, int64_t);
+	int64_t (*count)(const int64_t *, int64_t, int64_t);
+};
+
+/*************************** Scalar ******************************************/
+
+void fillScalar(int64_t *a, int64_t n, int64_t value)
+{
+	for(int64_t i = 0; i < n; i++)
+		a[i] = value;
+}
+
+// Sums wrap around, as the vector additions do
+int64_t sumScalar(const int64_t *a, int64_t n)
+{
+	uint64_t total = 0;
+	for(int64_t i = 0; i < n; i++)
+		total += a[i];
+	return total;
+}
+
+int64_t minScalar(const int64_t *a, int64_t n)
+{
+	int64_t least = INT64_MAX;
+	for(int64_t i = 0; i < n; i++)
+		if(a[i] < least)
+			least = a[i];
+	return least;
+}
+
+int64_t maxScalar(const int64_t *a, int64_t n)
+{
+	int64_t most = INT64_MIN;
+	for(int64_t i = 0; i < n; i++)
+		if(a[i] > most)
+			most = a[i];
+	return most;
+}
+
+int64_t countScalar(const int64_t *a, int64_t n, int64_t value)
+{
+	int64_t found = 0;
+	for(int64_t i = 0; i < n; i++)
+		found += a[i] == value;
+	return found;
+}
+
+const Kernels scalarKernels = {fillScalar, sumScalar, minScalar, maxScalar, countScalar};
+
+#ifdef FLATB_X86_KERNELS
+
+/*************************** AVX2 ********************************************/
+// Four elements a vector. AVX2 has no 64-bit min or max, so those compare and blend.
+
+__attribute__((target("avx2")))
+int64_t lanes(__m256i v, int64_t (*combine)(int64_t, int64_t))
+{
+	int64_t lane[4];
+	_mm256_storeu_si256((__m256i *)lane, v);
+	return combine(combine(lane[0], lane[1]), combine(lane[2], lane[3]));
+}
+
+int64_t add(int64_t a, int64_t b) { return (uint64_t)a + b; }
+int64_t least(int64_t a, int64_t b) { return a < b ? a : b; }
+int64_t most(int64_t a, int64_t b) { return a > b ? a : b; }
+
+__attribute__((target("avx2")))
+void fillAVX2(int64_t *a, int64_t n, int64_t value)
+{
+	__m256i v = _mm256_set1_epi64x(value);
+	int64_t i = 0;
+	for(; i + 4 <= n; i += 4)
+		_mm256_storeu_si256((__m256i *)(a + i), v);
+	for(; i < n; i++)
+		a[i] = value;
+}
+
+__attribute__((target("avx2")))
+int64_t sumAVX2(const int64_t *a, int64_t n)
+{
+	// two accumulators, so that consecutive additions do not wait on each other
+	__m256i total0 = _mm256_setzero_si256(), total1 = _mm256_setzero_si256();
+	int64_t i = 0;
+	for(; i + 8 <= n; i += 8)
+	{
+		total0 = _mm256_add_epi64(total0, _mm256_loadu_si256((const __m256i *)(a + i)));
+		total1 = _mm256_add_epi64(total1, _mm256_loadu_si256((const __m256i *)(a + i + 4)));
+	}
+	int64_t total = lanes(_mm256_add_epi64(total0, total1), add);
+	for(; i < n; i++)
+		total = add(total, a[i]);
+	return total;
+}
+
+__attribute__((target("avx2")))
+int64_t minAVX2(const int64_t *a, int64_t n)
+{
+	__m256i m = _mm256_set1_epi64x(INT64_MAX);
+	int64_t i = 0;
+	for(; i + 4 <= n; i += 4)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(m, x));
+	}
+	int64_t result = lanes(m, least);
+	for(; i < n; i++)
+		result = least(result, a[i]);
+	return result;
+}
+
+__attribute__((target("avx2")))
+int64_t maxAVX2(const int64_t *a, int64_t n)
+{
+	__m256i m = _mm256_set1_epi64x(INT64_MIN);
+	int64_t i = 0;
+	for(; i + 4 <= n; i += 4)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(x, m));
+	}
+	int64_t result = lanes(m, most);
+	for(; i < n; i++)
+		result = most(result, a[i]);
+	return result;
+}
+
+__attribute__((target("avx2")))
+int64_t countAVX2(const int64_t *a, int64_t n, int64_t value)
+{
+	// a match compares as -1, so subtracting the comparison counts it
+	__m256i v = _mm256_set1_epi64x(value), found = _mm256_setzero_si256();
+	int64_t i = 0;
+	for(; i + 4 <= n; i += 4)
+		found = _mm256_sub_epi64(found, _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(a + i)), v));
+	int64_t result = lanes(found, add);
+	for(; i < n; i++)
+		result += a[i] == value;
+	return result;
+}
+
+const Kernels avx2Kernels = {fillAVX2, sumAVX2, minAVX2, maxAVX2, countAVX2};
+
+/*************************** AVX-512 *****************************************/
+// Eight elements a vector. The last partial vector is loaded or stored under a mask
+// instead of element by element.
+
+__attribute__((target("avx512f")))
+__mmask8 tail(int64_t left)
+{
+	return (__mmask8)((1u << left) - 1);
+}
+
+__attribute__((target("avx512f")))
+void fillAVX512(int64_t *a, int64_t n, int64_t value)
+{
+	__m512i v = _mm512_set1_epi64(value);
+	int64_t i = 0;
+	for(; i + 8 <= n; i += 8)
+		_mm512_storeu_si512(a + i, v);
+	if(i < n)
+		_mm512_mask_storeu_epi64(a + i, tail(n - i), v);
+}
+
+__attribute__((target("avx512f")))
+int64_t sumAVX512(const int64_t *a, int64_t n)
+{
+	__m512i total = _mm512_setzero_si512();
+	int64_t i = 0;
+	for(; i + 8 <= n; i += 8)
+		total = _mm512_add_epi64(total, _mm512_loadu_si512(a + i));
+	if(i < n)
+		total = _mm512_add_epi64(total, _mm512_maskz_loadu_epi64(tail(n - i), a + i));
+	return _mm512_reduce_add_epi64(total);
+}
+
+__attribute__((target("avx512f")))
+int64_t minAVX512(const int64_t *a, int64_t n)
+{
+	__m512i m = _mm512_set1_epi64(INT64_MAX);
+	int64_t i = 0;
+	for(; i + 8 <= n; i += 8)
+		m = _mm512_min_epi64(m, _mm512_loadu_si512(a + i));
+	if(i < n)
+		m = _mm512_min_epi64(m, _mm512_mask_loadu_epi64(m, tail(n - i), a + i));
+	return _mm512_reduce_min_epi64(m);
+}
+
+__attribute__((target("avx512f")))
+int64_t maxAVX512(const int64_t *a, int64_t n)
+{
+	__m512i m = _mm512_set1_epi64(INT64_MIN);
+	int64_t i = 0;
+	for(; i + 8 <= n; i += 8)
+		m = _mm512_max_epi64(m, _mm512_loadu_si512(a + i));
+	if(i < n)
+		m = _mm512_max_epi64(m, _mm512_mask_loadu_epi64(m, tail(n - i), a + i));
+	return _mm512_reduce_max_epi64(m);
+}
+
+__attribute__((target("avx512f")))
+int64_t countAVX512(const int64_t *a, int64_t n, int64_t value)
+{
+	__m512i v = _mm512_set1_epi64(value);
+	int64_t found = 0, i = 0;
+	for(; i + 8 <= n; i += 8)
+		found += __builtin_popcount(_mm512_cmpeq_epi64_mask(_mm512_loadu_si512(a + i), v));
+	if(i < n)
+	{
+		__mmask8 mask = tail(n - i);
+		found += __builtin_popcount(_mm512_mask_cmpeq_epi64_mask(mask, _mm512_maskz_loadu_epi64(mask, a + i), v));
+	}
+	return found;
+}
+
+const Kernels avx512Kernels = {fillAVX512, sumAVX512, minAVX512, maxAVX512, countAVX512};
+
+#endif
+
+const Kernels& chooseKernels()
+{
+	const char *env = getenv("FLATB_KERNELS");
+	string wanted = env ? env : "avx512";
+
+#ifdef FLATB_X86_KERNELS
+	__builtin_cpu_init();
+	if(wanted == "avx512" && __builtin_cpu_supports("avx512f"))
+		return avx512Kernels;
+	if(wanted != "scalar" && __builtin_cpu_supports("avx2"))
+		return avx2Kernels;
+#endif
+	return scalarKernels;
+}
+
+const Kernels& kernels()
+{
+	static const Kernels &chosen = chooseKernels();
+	return chosen;
+}
+
+}
+
+extern "C"
+{
+
+void __flatb_fill(int64_t *a, int64_t lo, int64_t hi, int64_t value)
+{
+	if(lo <= hi)
+		kernels().fill(a + lo, hi - lo + 1, value);
+}
+
+// The two ranges are the same elements of different arrays, or the very same
+// elements, so this is a plain copy. memmove is already tuned to the processor by
+// the C library, and unlike memcpy allows src == dst.
+void __flatb_copy(int64_t *dst, const int64_t *src, int64_t lo, int64_t hi)
+{
+	if(lo <= hi)
+		memmove(dst + lo, src + lo, (hi - lo + 1) * sizeof(int64_t));
+}
+
+int64_t __flatb_sum(const int64_t *a, int64_t lo, int64_t hi)
+{
+	return lo <= hi ? kernels().sum(a + lo, hi - lo + 1) : 0;
+}
+
+// min and max of an empty range are 0
+int64_t __flatb_min(const int64_t *a, int64_t lo, int64_t hi)
+{
+	return lo <= hi ? kernels().min(a + lo, hi - lo + 1) : 0;
+}
+
+int64_t __flatb_max(const int64_t *a, int64_t lo, int64_t hi)
+{
+	return lo <= hi ? kernels().max(a + lo, hi - lo + 1) : 0;
+}
+
+int64_t __flatb_count(const int64_t *a, int64_t lo, int64_t hi, int64_t value)
+{
+	return lo <= hi ? kernels().count(a + lo, hi - lo + 1, value) : 0;
+}
+
+}
@@ -0,0 +1,90 @@
+#include "Output.h"
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+namespace flatb
+{
+
+static thread_local FILE *output = nullptr;
+
+void setOutput(FILE *file)
+{
+	output = file;
+}
+
+// The chunk running on this thread, if any
+OrderedOutput::Chunk *&OrderedOutput::current()
+{
+	static thread_local Chunk *chunk = nullptr;
+	return chunk;
+}
+
+void OrderedOutput::chunk(int64_t first, const function<void()> &body)
+{
+	Chunk *chunk = new Chunk{first, string(), nullptr};
+	Chunk *enclosing = current();
+	current() = chunk;
+	body();
+	current() = enclosing;
+
+	if(chunk->text.empty())
+	{
+		delete chunk;
+		return;
+	}
+	chunk->next = chunks.load(memory_order_relaxed);
+	while(!chunks.compare_exchange_weak(chunk->next, chunk, memory_order_release, memory_order_relaxed))
+		;
+}
+
+// Runs on the thread that started the loop, after every chunk has finished
+OrderedOutput::~OrderedOutput()
+{
+	vector<Chunk *> finished;
+	for(Chunk *chunk = chunks.load(memory_order_acquire); chunk; chunk = chunk->next)
+		finished.push_back(chunk);
+	sort(finished.begin(), finished.end(), [](Chunk *a, Chunk *b) { return a->first < b->first; });
+
+	for(auto chunk: finished)
+	{
+		write(chunk->text.data(), chunk->text.size());
+		delete chunk;
+	}
+}
+
+void write(const char *text, size_t length)
+{
+	OrderedOutput::Chunk *chunk = OrderedOutput::current();
+	if(chunk)
+		chunk->text.append(text, length);
+	else
+		fwrite(text, 1, length, output ? output : stdout);
+}
+
+int print(const char *format, va_list args)
+{
+	OrderedOutput::Chunk *chunk = OrderedOutput::current();
+	if(!chunk)
+		return vfprintf(output ? output : stdout, format, args);
+
+	// most prints fit in the buffer; longer ones are formatted a second time
+	char buffer[256];
+	va_list again;
+	va_copy(again, args);
+	int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	if(length >= (int) sizeof(buffer))
+	{
+		size_t end = chunk->text.size();
+		chunk->text.resize(end + length + 1);
+		vsnprintf(&chunk->text[end], length + 1, format, again);
+		chunk->text.resize(end + length);
+	}
+	else if(length > 0)
+		chunk->text.append(buffer, length);
+	va_end(again);
+	return length;
+}
+
+}
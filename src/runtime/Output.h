@@ -0,0 +1,55 @@
+#ifndef FLATB_OUTPUT_H
+#define FLATB_OUTPUT_H
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+namespace flatb
+{
+
+// What a FlatB program prints goes through here, so that the prints of a parallel
+// loop come out in the order a sequential run would print them.
+//
+// A chunk of a parallel loop runs its iterations in order on one thread, and prints
+// into a buffer of its own tagged with its first iteration. Finished chunks push
+// their buffer onto a lock-free list, and once the loop is over the buffers are
+// written out sorted by first iteration. Threads never wait on each other to print.
+//
+// Outside a chunk, text goes straight to the thread's output, stdout unless
+// setOutput says otherwise. A chunk of a loop nested inside another chunk prints
+// into the enclosing chunk's buffer once the inner loop is over.
+class OrderedOutput
+{
+	public:
+		OrderedOutput(): chunks(nullptr) {}
+		~OrderedOutput();
+
+		// Runs body as the chunk starting at iteration first
+		void chunk(int64_t first, const std::function<void()> &body);
+
+	private:
+		struct Chunk
+		{
+			int64_t first;
+			std::string text;
+			Chunk *next;
+		};
+
+		std::atomic<Chunk *> chunks;		// finished chunks that printed something
+
+		friend void write(const char *, size_t);
+		friend int print(const char *, va_list);
+		static Chunk *&current();
+};
+
+void setOutput(FILE *output);
+void write(const char *text, size_t length);
+int print(const char *format, va_list args);
+
+}
+
+#endif
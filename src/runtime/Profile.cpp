@@ -0,0 +1,70 @@
+// The counters of a program built with bcc --instrument. main hands them over as it
+// returns, and they are written out one line a counter:
+//
+//	# flatb profile 3f9a0c51d2e6b8a4 12
+//	1 main:entry
+//	1000 main:loop_header
+//	999 main:loop_header taken
+//
+// The shape in the first line identifies the module the counters were laid out for.
+// When the file already holds counts for the same shape, the new counts are added to
+// them, so several runs make up one profile. FLATB_PROFILE names another file.
+// The file is written as main returns rather than at exit, since under lli the
+// counters are freed by then.
+#include "flatbrt.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+// Counts already in the file for the same module, or none
+vector<int64_t> previousCounts(const char *path, const char *shape, int64_t n)
+{
+	vector<int64_t> counts;
+	FILE *file = fopen(path, "r");
+	if(!file)
+		return counts;
+	char found[64];
+	long long size;
+	if(fscanf(file, "# flatb profile %63s %lld", found, &size) == 2 && !strcmp(found, shape) && size == n)
+	{
+		long long count;
+		char line[4096];
+		while((int64_t)counts.size() < n && fscanf(file, "%lld", &count) == 1 && fgets(line, sizeof(line), file))
+			counts.push_back(count);
+	}
+	fclose(file);
+	if((int64_t)counts.size() != n)
+		counts.clear();
+	return counts;
+}
+
+}
+
+extern "C" void __flatb_profile(const char *path, const char *shape, const char *names, const int64_t *counters, int64_t n)
+{
+	const char *env = getenv("FLATB_PROFILE");
+	if(env && *env)
+		path = env;
+	vector<int64_t> counts = previousCounts(path, shape, n);
+	FILE *file = fopen(path, "w");
+	if(!file)
+	{
+		fprintf(stderr, "[ERROR] Cannot write the profile %s\n", path);
+		return;
+	}
+	fprintf(file, "# flatb profile %s %lld\n", shape, (long long)n);
+	for(int64_t i = 0; i < n; i++)
+	{
+		const char *end = strchr(names, '\n');
+		int length = end ? end - names : strlen(names);
+		fprintf(file, "%lld %.*s\n", (long long)(counters[i] + (counts.empty() ? 0 : counts[i])), length, names);
+		names += end ? length + 1 : length;
+	}
+	fclose(file);
+}
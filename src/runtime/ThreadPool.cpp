@@ -0,0 +1,177 @@
+#include "ThreadPool.h"
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+namespace flatb
+{
+
+static thread_local bool runningChunk = false;
+
+// FLATB_THREADS overrides the number of threads, which defaults to one per core
+ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool pool([]() {
+		const char *env = getenv("FLATB_THREADS");
+		int threads = env ? atoi(env) : (int)thread::hardware_concurrency();
+		return (unsigned)max(threads, 1);
+	}());
+	return pool;
+}
+
+bool ThreadPool::inWorker()
+{
+	return runningChunk;
+}
+
+ThreadPool::ThreadPool(unsigned size) : ranges(size)
+{
+	generation = 0;
+	active = 0;
+	stopping = false;
+	body = nullptr;
+	chunking = staticchunking;
+	grain = 1;
+
+	for(unsigned id = 1; id < size; id++)
+		threads.push_back(thread(&ThreadPool::workerLoop, this, id));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(auto &worker: threads)
+		worker.join();
+}
+
+void ThreadPool::workerLoop(unsigned id)
+{
+	unsigned seen = 0;
+	while(true)
+	{
+		unique_lock<mutex> guard(lock);
+		wake.wait(guard, [&]() { return stopping || generation != seen; });
+		if(stopping)
+			return;
+		seen = generation;
+		guard.unlock();
+
+		run(id);
+
+		guard.lock();
+		if(--active == 0)
+			done.notify_one();
+	}
+}
+
+void ThreadPool::parallelFor(int64_t trips, Chunking chunking, const Body &body)
+{
+	if(trips <= 0)
+		return;
+
+	if(runningChunk || size() == 1 || trips == 1 || !jobs.try_lock())
+	{
+		bool outer = runningChunk;
+		runningChunk = true;
+		body(0, trips);
+		runningChunk = outer;
+		return;
+	}
+
+	// even blocks, the first trips % size of them one iteration longer
+	int64_t workers = size(), begin = 0;
+	for(int64_t id = 0; id < workers; id++)
+	{
+		int64_t length = trips / workers + (id < trips % workers);
+		ranges[id].begin = begin;
+		ranges[id].end = begin + length;
+		begin += length;
+	}
+
+	this->body = &body;
+	this->chunking = chunking;
+	this->grain = max<int64_t>(1, trips / (workers * 8));
+
+	{
+		lock_guard<mutex> guard(lock);
+		active = threads.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	run(0);
+
+	{
+		unique_lock<mutex> guard(lock);
+		done.wait(guard, [&]() { return active == 0; });
+	}
+
+	this->body = nullptr;
+	jobs.unlock();
+}
+
+void ThreadPool::run(unsigned id)
+{
+	runningChunk = true;
+
+	if(chunking == staticchunking)
+	{
+		if(ranges[id].begin < ranges[id].end)
+			(*body)(ranges[id].begin, ranges[id].end);
+	}
+	else
+	{
+		int64_t first, last;
+		while(take(id, first, last) || (steal(id) && take(id, first, last)))
+			(*body)(first, last);
+	}
+
+	runningChunk = false;
+}
+
+// Takes up to grain iterations from the front of worker id's block
+bool ThreadPool::take(unsigned id, int64_t &first, int64_t &last)
+{
+	lock_guard<mutex> guard(ranges[id].lock);
+	if(ranges[id].begin >= ranges[id].end)
+		return false;
+
+	first = ranges[id].begin;
+	last = min(ranges[id].end, first + grain);
+	ranges[id].begin = last;
+	return true;
+}
+
+// Moves the back half of some other worker's block into worker id's empty block
+bool ThreadPool::steal(unsigned id)
+{
+	unsigned workers = size();
+	for(unsigned offset = 1; offset < workers; offset++)
+	{
+		Range &victim = ranges[(id + offset) % workers];
+		int64_t begin, end;
+		{
+			lock_guard<mutex> guard(victim.lock);
+			int64_t remaining = victim.end - victim.begin;
+			if(remaining <= 0)
+				continue;
+
+			end = victim.end;
+			begin = remaining > grain ? victim.end - remaining / 2 : victim.begin;
+			victim.end = begin;
+		}
+
+		lock_guard<mutex> guard(ranges[id].lock);
+		ranges[id].begin = begin;
+		ranges[id].end = end;
+		return true;
+	}
+	return false;
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef FLATB_THREADPOOL_H
+#define FLATB_THREADPOOL_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace flatb
+{
+
+enum Chunking {staticchunking, dynamicchunking};
+
+// A process-wide pool of worker threads that split the iteration space [0, trips) of
+// a parallel loop. The calling thread takes part as worker 0.
+//
+// Static chunking gives every worker one contiguous block. Dynamic chunking starts
+// from the same blocks, but a worker takes small chunks from the front of its own
+// block and, once that is empty, steals the back half of another worker's block.
+//
+// A loop started from inside a chunk, or while another thread is running a loop on
+// the pool, runs on the calling thread alone.
+class ThreadPool
+{
+	public:
+		typedef std::function<void(int64_t, int64_t)> Body;
+
+		static ThreadPool& instance();
+		static bool inWorker();
+
+		unsigned size() { return threads.size() + 1; }
+		void parallelFor(int64_t trips, Chunking chunking, const Body &body);
+		~ThreadPool();
+
+	private:
+		struct Range
+		{
+			std::mutex lock;
+			int64_t begin, end;
+		};
+
+		std::vector<std::thread> threads;
+		std::vector<Range> ranges;
+
+		std::mutex lock;			// guards generation, active and stopping
+		std::condition_variable wake, done;
+		unsigned generation, active;
+		bool stopping;
+
+		std::mutex jobs;			// held by the thread running the current loop
+		const Body *body;
+		Chunking chunking;
+		int64_t grain;
+
+		ThreadPool(unsigned);
+		void workerLoop(unsigned);
+		void run(unsigned);
+		bool take(unsigned, int64_t &, int64_t &);
+		bool steal(unsigned);
+};
+
+}
+
+#endif
@@ -0,0 +1,117 @@
+// Trace slices of a program compiled with bcc --trace: each top-level statement runs
+// from its mark until the next one, whether it gets there in order or by a goto.
+// When main returns, the slices are added to the trace bcc wrote, or to the file
+// FLATB_TRACE names, as Chrome trace events of a process of their own. The clock
+// is CLOCK_MONOTONIC, which bcc's steady_clock reads too, so compile and run line up.
+#include "flatbrt.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+struct Slice
+{
+	const char *name;
+	int64_t start, end;			// microseconds; end is 0 while the statement runs
+};
+
+vector<Slice> slices;
+uint64_t dropped = 0;
+
+// Statements past this many are counted but not recorded, so long runs stay viewable
+const size_t sliceLimit = 200000;
+
+int64_t microseconds()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void closeSlice(int64_t now)
+{
+	if(!slices.empty() && !slices.back().end)
+		slices.back().end = now;
+}
+
+// Opens the trace positioned to add events: over the closing ] of an existing one
+FILE* openTrace(const char *path, bool &fresh)
+{
+	FILE *file = fopen(path, "r+");
+	if(file && !fseek(file, 0, SEEK_END))
+	{
+		for(long position = ftell(file) - 1; position >= 0; position--)
+		{
+			fseek(file, position, SEEK_SET);
+			int c = fgetc(file);
+			if(c == ' ' || c == '\n' || c == '\t' || c == '\r')
+				continue;
+			if(c != ']')
+				break;
+			fseek(file, position, SEEK_SET);
+			fresh = false;
+			return file;
+		}
+	}
+	if(file)
+		fclose(file);
+	fresh = true;
+	return fopen(path, "w");
+}
+
+}
+
+extern "C"
+{
+
+void __flatb_trace_statement(const char *name)
+{
+	int64_t now = microseconds();
+	closeSlice(now);
+	if(slices.size() >= sliceLimit)
+	{
+		dropped++;
+		return;
+	}
+	slices.push_back(Slice{name, now, 0});
+}
+
+void __flatb_trace_write(const char *path, const char *program)
+{
+	int64_t now = microseconds();
+	closeSlice(now);
+	const char *env = getenv("FLATB_TRACE");
+	if(env && *env)
+		path = env;
+
+	bool fresh;
+	FILE *file = openTrace(path, fresh);
+	if(!file)
+	{
+		fprintf(stderr, "[ERROR] Cannot write the trace %s\n", path);
+		return;
+	}
+	int pid = getpid();
+	string name = string(program) + " (compiled)";
+	fprintf(file, "%s\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": %s}}", fresh ? "[" : ",", pid, flatb::quoted(name).c_str());
+	fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": 1, \"args\": {\"name\": \"main\"}}", pid);
+	for(auto &slice: slices)
+		fprintf(file, ",\n{\"name\": %s, \"cat\": \"run\", \"ph\": \"X\", \"pid\": %d, \"tid\": 1, \"ts\": %lld, \"dur\": %lld}",
+			flatb::quoted(slice.name).c_str(), pid, (long long)slice.start, (long long)(slice.end - slice.start));
+	if(dropped)
+		fprintf(file, ",\n{\"name\": \"dropped events\", \"ph\": \"i\", \"s\": \"p\", \"pid\": %d, \"tid\": 1, \"ts\": %lld, \"args\": {\"count\": %llu}}",
+			pid, (long long)now, (unsigned long long)dropped);
+	fprintf(file, "\n]\n");
+	fclose(file);
+	slices.clear();
+	dropped = 0;
+}
+
+}
@@ -0,0 +1,57 @@
+// The FlatB runtime, declared in flatbrt.h. Link compiled programs with libflatbrt,
+// or pass -load=src/runtime/libflatbrt.so to lli. The array kernels are in Kernels.cpp.
+#include "flatbrt.h"
+#include "Output.h"
+#include "ThreadPool.h"
+#include <cstdio>
+
+using namespace flatb;
+
+// Quotes and backslashes are escaped, and the other control characters written as
+// \u00XX; bytes from 0x80 up are passed through, so UTF-8 text stays as it is
+std::string flatb::quoted(const std::string &text)
+{
+	std::string escaped = "\"";
+	for(char c: text)
+	{
+		if(c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if((unsigned char)c < ' ')
+		{
+			char code[7];
+			snprintf(code, sizeof code, "\\u%04x", (unsigned char)c);
+			escaped += code;
+		}
+		else
+			escaped += c;
+	}
+	return escaped + "\"";
+}
+
+extern "C"
+{
+
+// Runs body(first, last, env) over chunks covering the counter values [0, trips) of
+// a parallel for-loop. schedule is 0 for static and 1 for dynamic chunking. What the
+// chunks print with __flatb_printf is written out in iteration order once all are done.
+void __flatb_parallel_for(void (*body)(int64_t, int64_t, void *), void *env, int64_t trips, int32_t schedule)
+{
+	OrderedOutput output;
+	ThreadPool::instance().parallelFor(trips, schedule ? dynamicchunking : staticchunking,
+		[=, &output](int64_t first, int64_t last) { output.chunk(first, [=]() { body(first, last, env); }); });
+}
+
+// printf for the body of a parallel for-loop
+int __flatb_printf(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int written = print(format, args);
+	va_end(args);
+	return written;
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef FLATB_RUNTIME_H
+#define FLATB_RUNTIME_H
+
+#include <cstdint>
+#include <string>
+
+// C entry points that code generated by bcc calls into, and that the interpreter
+// calls directly. The array kernels take the first element of an int array and an
+// inclusive range lo..hi of its elements; a range with lo > hi is empty.
+extern "C"
+{
+
+void __flatb_parallel_for(void (*body)(int64_t, int64_t, void *), void *env, int64_t trips, int32_t schedule);
+int __flatb_printf(const char *format, ...);
+void __flatb_profile(const char *path, const char *shape, const char *names, const int64_t *counters, int64_t n);
+void __flatb_trace_statement(const char *name);
+void __flatb_trace_write(const char *path, const char *program);
+
+void __flatb_fill(int64_t *a, int64_t lo, int64_t hi, int64_t value);
+void __flatb_copy(int64_t *dst, const int64_t *src, int64_t lo, int64_t hi);
+int64_t __flatb_sum(const int64_t *a, int64_t lo, int64_t hi);
+int64_t __flatb_min(const int64_t *a, int64_t lo, int64_t hi);
+int64_t __flatb_max(const int64_t *a, int64_t lo, int64_t hi);
+int64_t __flatb_count(const int64_t *a, int64_t lo, int64_t hi, int64_t value);
+
+}
+
+namespace flatb
+{
+
+// text as a JSON string, quotes included, for the traces and reports bcc and the
+// runtime write
+std::string quoted(const std::string &text);
+
+}
+
+#endif
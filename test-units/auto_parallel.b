@@ -0,0 +1,43 @@
+declblock{
+	int a[1000], b[1000], c[1000];
+	int i, j, t, sum;
+}
+
+codeblock{
+	for i = 0, 999 {
+		a[i] = i;
+		b[i] = 2 * i;
+	}
+
+	for i = 0, 998 {
+		c[i + 1] = a[i] + b[i + 1];
+	}
+
+	for i = 1, 999 {
+		a[i] = a[i - 1] + 1;
+	}
+
+	for i = 0, 998, 2 {
+		b[i + 1] = b[i];
+	}
+
+	sum = 0;
+	for i = 0, 999 {
+		t = c[i] * 2;
+		sum = sum + t;
+	}
+
+	for i = 0, 9 {
+		for j = 0, 99 {
+			b[10 * i + j] = i;
+		}
+	}
+
+	for i = 0, 9 {
+		println "a: ", a[i];
+	}
+
+	println "Sum: ", sum;
+	println "Last a: ", a[999];
+	println "b[999]: ", b[999];
+}
@@ -0,0 +1,55 @@
+declblock{
+	int a[100], b[100], c[100];
+	bool flags[200];
+	int i, n, sum, total, min;
+}
+
+codeblock{
+	for i = 0, 99 {
+		a[i] = (i * 37) - (i / 7) * 250;
+	}
+
+	println "Sum: ", sum(a, 0, 99);
+	println "Min: ", min(a, 0, 99);
+	println "Max: ", max(a, 0, 99);
+	println "Count of 0: ", count(a, 0, 0, 99);
+	println "Empty sum, min, max, count: ", sum(a, 5, 4) + min(a, 5, 4) + max(a, 5, 4) + count(a, 0, 5, 4);
+
+	fill b, 7, 0, 99;
+	fill b, -3, 10, 12;
+	println "Sum of b: ", sum(b, 0, 99);
+	println "Sevens in b: ", count(b, 7, 0, 99);
+
+	copy c, a, 0, 99;
+	copy c, b, 20, 29;
+	println "Sum of c: ", sum(c, 0, 99);
+	println "c[25]: ", c[25];
+
+	fill flags, 1, 3, 130;
+	fill flags, 0, 64, 64;
+	n = 0;
+	for i = 0, 199 {
+		n = n + flags[i];
+	}
+	println "Flags set: ", n;
+
+	sum = 0;
+	for i = 1, 9 {
+		sum = sum + max(a, 0, i * 10) - min(a, i, 99);
+	}
+	println "Running: ", sum;
+
+	total = 0;
+	parallel for i = 0, 9 {
+		fill c, i, i * 10, i * 10 + 9;
+		total = total + count(a, i, 0, 99);
+	}
+	println "Parallel total: ", total;
+	println "Sum of c after: ", sum(c, 0, 99);
+
+	min = 3;
+	goto skip if min > 5;
+	fill a, 1, 0, 2;
+	skip: fill a, min, min, min + 4;
+	println "Sum of a: ", sum(a, 0, sum(b, 0, 0) + 2 * max(c, 0, 99));
+}
@@ -0,0 +1,46 @@
+declblock
+{
+	int i, n, x, y, z, a[20];
+}
+codeblock
+{
+	n = 10;
+	x = n * 2 - (3 + 1);
+	y = -x;
+	println x;
+	println y;
+
+	if x > 5
+	{
+		z = 1;
+	}
+	else
+	{
+		z = 2;
+	}
+	println z;
+
+	for i = 0, n - 1
+	{
+		a[i] = n - i;
+	}
+
+	x = 0;
+	for i = 0, n - 1
+	{
+		x = x + a[i];
+	}
+	println x;
+
+	y = 3;
+	goto L2 if x > 50;
+	y = 4;
+L2:	z = y;
+	println z;
+
+	while y < 6
+	{
+		y = y + 1;
+	}
+	println y;
+}
@@ -0,0 +1,30 @@
+declblock{
+	int i, n, s, k;
+}
+
+codeblock{
+	n = 10;
+	s = 0;
+	for i = 1, n {
+		n = n + 1;
+		s = s + i;
+	}
+	println "Sum: ", s;
+	println "n: ", n;
+	println "i: ", i;
+
+	k = 0;
+	for i = 1, 20, 3 {
+		k = k + 1;
+		i = i + 100;
+	}
+	println "Trips: ", k;
+	println "i: ", i;
+
+	k = 0;
+	for i = 5, 1 {
+		k = k + 1;
+	}
+	println "Trips: ", k;
+	println "i: ", i;
+}
@@ -0,0 +1,14 @@
+declblock{
+	int i, sum;
+}
+
+codeblock{
+	i = 0;
+	sum = 0;
+	goto check;
+loop:	sum = sum + i;
+	i = i + 1;
+check:	goto done if i >= 10;
+	goto loop;
+done:	println "Sum value: ", sum;
+}
@@ -0,0 +1,30 @@
+declblock{
+	int data[40];
+	int i, j, sum;
+}
+
+codeblock{
+	println "Before";
+	parallel for i = 0, 39 {
+		data[i] = i * i;
+		print "Square of ", i;
+		println " is ", data[i];
+	}
+
+	sum = 0;
+	parallel dynamic for i = 0, 39 {
+		if (i / 7) * 7 == i {
+			println "Multiple of 7: ", i;
+		}
+		sum = sum + data[i];
+	}
+	println "Sum: ", sum;
+
+	parallel for i = 0, 3 {
+		println "Row ", i;
+		parallel for j = 0, 2 {
+			println "  Cell ", i * 3 + j;
+		}
+	}
+	println "After";
+}
@@ -0,0 +1,26 @@
+declblock{
+	int data[1000], squares[1000];
+	int i, sum, product, square, largest;
+}
+
+codeblock{
+	parallel for i = 0, 999 {
+		data[i] = i + 1;
+	}
+
+	sum = 0;
+	product = 1;
+	parallel dynamic for i = 0, 999 {
+		square = data[i] * data[i];
+		squares[i] = square;
+		sum = sum + square;
+		if i < 10 {
+			product = product * data[i];
+		}
+	}
+
+	println "Sum of squares: ", sum;
+	println "Product: ", product;
+	println "Last square: ", square;
+	println "Iterator: ", i;
+}
@@ -0,0 +1,17 @@
+declblock{
+	int parallel, dynamic, i, a[100];
+}
+
+codeblock{
+	parallel = 3;
+	dynamic = parallel * 2;
+	parallel
+	dynamic
+	for i = 0, 99 {
+		a[i] = i * dynamic;
+	}
+	goto done if parallel < dynamic;
+	println "skipped";
+done:	println "a[99] = ", a[99];
+	println "parallel + dynamic = ", parallel + dynamic;
+}
@@ -0,0 +1,20 @@
+declblock{
+	int a, b, x[2];
+	bool f;
+}
+
+codeblock{
+	a = 7;
+	b = 8;
+	x[1] = 9;
+	f = 1;
+	read a;
+	read b;
+	read x[1];
+	read f;
+	println "a = ", a;
+	println "-a = ", -a;
+	println "b = ", b;
+	println "x[1] = ", x[1];
+	println "f = ", f;
+}
@@ -0,0 +1,59 @@
+declblock{
+	int a[1000];
+	int i, sum, product, smallest, largest, evens;
+	int psum, pproduct, psmallest, plargest;
+}
+
+codeblock{
+	for i = 0, 999 {
+		a[i] = (i * 7919) - (i / 3) * 23760;
+	}
+
+	sum = 0;
+	product = 1;
+	smallest = a[0];
+	largest = a[0];
+	evens = 0;
+	for i = 0, 999 {
+		sum = sum + a[i];
+		if a[i] < smallest {
+			smallest = a[i];
+		}
+		if largest < a[i] {
+			largest = a[i];
+		}
+		if i < 20 {
+			product = product * (a[i] + 1);
+		}
+		if a[i] - (a[i] / 2) * 2 == 0 {
+			evens = evens + 1;
+		}
+	}
+
+	psum = 0;
+	pproduct = 1;
+	psmallest = a[0];
+	plargest = a[0];
+	parallel for i = 0, 999 {
+		psum = psum - a[i];
+		if a[i] <= psmallest {
+			psmallest = a[i];
+		}
+		if plargest <= a[i] {
+			plargest = a[i];
+		}
+		if i < 20 {
+			pproduct = pproduct * (a[i] + 1);
+		}
+	}
+
+	println "Sum: ", sum;
+	println "Product: ", product;
+	println "Smallest: ", smallest;
+	println "Largest: ", largest;
+	println "Evens: ", evens;
+	println "Parallel sum: ", psum;
+	println "Parallel product: ", pproduct;
+	println "Parallel smallest: ", psmallest;
+	println "Parallel largest: ", plargest;
+}
@@ -0,0 +1,352 @@
+#!/usr/bin/env python3
+# Runs every .b program in test-units under each execution engine, checks the output
+# against the golden file in test-units/expected, and reports wall time, user time
+# and peak RSS of each run as a table.
+#
+#   interp  - the AST interpreter, bcc --interpret
+#   lli     - the LLVM IR from bcc, run by lli
+#   native  - the LLVM IR compiled by llc and linked with the runtime
+#
+# An engine whose tools are missing is skipped. Programs run in parallel, one per
+# core unless -j says otherwise; use -j 1 for timings that do not compete for cores.
+#
+# expected/NAME.in, if present, is the program's input. expected/NAME.flags holds more
+# arguments for bcc, such as -fauto-parallel, used under every engine; with it,
+# expected/NAME.report, if present, is what bcc must print to stderr while building or
+# interpreting the program, such as the auto-parallelization report. NAME.xfail lists
+# engines, one per line with an optional # comment, that are known not to match
+# the golden output; their mismatches are reported as xfail and do not count.
+#
+# --counters also reads the CPU's counters for each run with perf_event_open(2):
+# cycles, instructions, branch, L1 data, last level cache and data TLB misses. They
+# are reported as instructions per cycle and as misses per loop iteration of the
+# program, which is the same for every engine; the iterations are counted by a
+# bcc --instrument build run under lli. Counters the kernel or the container does
+# not provide show as -.
+#
+# Usage: run_tests.py [-j N] [--engines interp,lli] [--update] [--counters] [--report FILE] [names]
+# The BCC environment variable overrides the compiler, src/bcc by default.
+
+import argparse
+import concurrent.futures
+import ctypes
+import hashlib
+import os
+import platform
+import re
+import shlex
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import struct
+import threading
+import time
+
+TESTS = os.path.dirname(os.path.abspath(__file__))
+SRC = os.path.join(os.path.dirname(TESTS), 'src')
+EXPECTED = os.path.join(TESTS, 'expected')
+RUNTIME = os.path.join(SRC, 'runtime')
+BCC = os.environ.get('BCC') or os.path.join(SRC, 'bcc')
+
+
+class Result:
+	def __init__(self, code, output, wall, user, rss, counts=None, errors=''):
+		self.code = code
+		self.output = output
+		self.errors = errors
+		self.wall = wall
+		self.user = user
+		self.rss = rss
+		self.counts = counts or {}
+
+	# what the golden file holds: the program's stdout, and its exit status when it
+	# is not 0
+	def transcript(self):
+		if self.code == 0:
+			return self.output
+		return self.output + '[exit %d]\n' % self.code
+
+
+# perf_event_open(2): (type, config) of each counter. Cache events are
+# cache | operation << 8 | result << 16, with read = 0 and miss = 1.
+EVENTS = {
+	'cycles': (0, 0),
+	'instructions': (0, 1),
+	'branch-misses': (0, 5),
+	'L1d-misses': (3, 0 | 1 << 16),
+	'LLC-misses': (3, 2 | 1 << 16),
+	'dTLB-misses': (3, 3 | 1 << 16),
+}
+PERF_EVENT_OPEN = {'x86_64': 298, 'aarch64': 241, 'ppc64le': 319, 's390x': 331}.get(platform.machine())
+counting = False
+unavailable = {}		# event: why it could not be opened
+
+
+# Opens the counters on the calling thread, disabled. Children it starts inherit
+# them and switch them on when they exec, so the counts are the child's alone,
+# added in when it exits.
+def open_counters():
+	if not counting:
+		return {}
+	libc = ctypes.CDLL(None, use_errno=True)
+	# disabled, inherit, exclude_kernel, exclude_hv and enable_on_exec; read the
+	# enabled and running times too, to scale counts the kernel multiplexed
+	flags = 1 | 1 << 1 | 1 << 5 | 1 << 6 | 1 << 12
+	counters = {}
+	for event, (type, config) in EVENTS.items():
+		attr = struct.pack('IIQQQQQIIQQ', type, 72, config, 0, 0, 1 | 2, flags, 0, 0, 0, 0)
+		fd = libc.syscall(PERF_EVENT_OPEN, ctypes.c_char_p(attr), 0, -1, -1, 8) if PERF_EVENT_OPEN else -1
+		if fd >= 0:
+			counters[event] = fd
+		else:
+			unavailable[event] = os.strerror(ctypes.get_errno()) if PERF_EVENT_OPEN else 'not supported on ' + platform.machine()
+	return counters
+
+
+def read_counters(counters):
+	counts = {}
+	for event, fd in counters.items():
+		value, enabled, running = struct.unpack('QQQ', os.read(fd, 24))
+		os.close(fd)
+		if running:
+			counts[event] = value * enabled / running
+	return counts
+
+
+# Runs command with stdin from the file input, measuring the child alone
+# With digest, the output is given as its SHA-256 rather than read into memory: a
+# child's peak RSS counts this process's own when it is spawned, so holding a large
+# output here would inflate that of every later run
+def measure(command, input, cwd, timeout, digest=False):
+	with open(input or os.devnull, 'rb') as stdin, tempfile.TemporaryFile() as stdout, tempfile.TemporaryFile() as stderr:
+		counters = open_counters()
+		start = time.monotonic()
+		child = subprocess.Popen(command, cwd=cwd, stdin=stdin, stdout=stdout, stderr=stderr)
+		timer = threading.Timer(timeout, lambda: child.send_signal(signal.SIGKILL))
+		timer.start()
+		_, status, usage = os.wait4(child.pid, 0)
+		wall = time.monotonic() - start
+		timer.cancel()
+		child.returncode = 0		# already reaped
+
+		stdout.seek(0)
+		if digest:
+			hasher = hashlib.sha256()
+			for block in iter(lambda: stdout.read(1 << 20), b''):
+				hasher.update(block)
+			output = hasher.hexdigest()
+		else:
+			output = stdout.read().decode('utf-8', 'replace')
+		stderr.seek(0)
+		errors = stderr.read().decode('utf-8', 'replace')
+		code = os.WEXITSTATUS(status) if os.WIFEXITED(status) else 128 + os.WTERMSIG(status)
+		# ru_maxrss is in kilobytes on Linux
+		return Result(code, output, wall, usage.ru_utime, usage.ru_maxrss, read_counters(counters), errors)
+
+
+def bcc(source, cwd, timeout, flags=()):
+	return measure([BCC, '-q'] + list(flags) + [source], None, cwd, timeout)
+
+
+def run_interp(source, input, cwd, timeout, flags=()):
+	return measure([BCC, '-q'] + list(flags) + ['--interpret', source], input, cwd, timeout)
+
+
+# The run of a compiled program, with what bcc printed to stderr while compiling it
+# in front of what the program did
+def run_lli(source, input, cwd, timeout, flags=()):
+	compiled = bcc(source, cwd, timeout, flags)
+	if compiled.code != 0:
+		return compiled
+	command = ['lli', source + '.ll']
+	library = os.path.join(RUNTIME, 'libflatbrt.so')
+	if os.path.exists(library):
+		command[1:1] = ['-load=' + library]
+	result = measure(command, input, cwd, timeout)
+	result.errors = compiled.errors + result.errors
+	return result
+
+
+def run_native(source, input, cwd, timeout, flags=()):
+	compiled = bcc(source, cwd, timeout, flags)
+	if compiled.code != 0:
+		return compiled
+	steps = [['llc', '-filetype=obj', '-relocation-model=pic', source + '.ll', '-o', source + '.o'],
+			[linker(), source + '.o', os.path.join(RUNTIME, 'libflatbrt.a'), '-lpthread', '-o', source + '.out']]
+	for step in steps:
+		built = measure(step, None, cwd, timeout)
+		if built.code != 0:
+			return built
+	result = measure([os.path.join(cwd, source + '.out')], input, cwd, timeout)
+	result.errors = compiled.errors + result.errors
+	return result
+
+
+def linker():
+	return os.environ.get('CXX') or shutil.which('clang++') or 'g++'
+
+
+ENGINES = {
+	'interp': (run_interp, lambda: os.path.exists(BCC)),
+	'lli': (run_lli, lambda: shutil.which('lli')),
+	'native': (run_native, lambda: shutil.which('llc') and shutil.which(linker())
+				and os.path.exists(os.path.join(RUNTIME, 'libflatbrt.a'))),
+}
+
+
+# Each run gets a directory of its own, since bcc writes AST_XML.xml to the working
+# directory and the .ll file next to the program
+def run(name, engine, timeout):
+	input = os.path.join(EXPECTED, name + '.in')
+	if not os.path.exists(input):
+		input = None
+
+	with tempfile.TemporaryDirectory(prefix='flatb-') as cwd:
+		shutil.copy(os.path.join(TESTS, name + '.b'), cwd)
+		return ENGINES[engine][0](name + '.b', input, cwd, timeout, flags(name))
+
+
+# The arguments of expected/NAME.flags, if any
+def flags(name):
+	path = os.path.join(EXPECTED, name + '.flags')
+	if not os.path.exists(path):
+		return []
+	with open(path) as f:
+		return shlex.split(f.read())
+
+
+# The loop iterations name runs: the runs of the loop_body blocks, which every
+# loop bcc generates enters once an iteration, in an --instrument build
+def loop_iterations(name, timeout):
+	input = os.path.join(EXPECTED, name + '.in')
+	with tempfile.TemporaryDirectory(prefix='flatb-') as cwd:
+		shutil.copy(os.path.join(TESTS, name + '.b'), cwd)
+		source = name + '.b'
+		if measure([BCC, '-q', '--instrument'] + flags(name) + [source], None, cwd, timeout).code != 0:
+			return None
+		command = ['lli', source + '.ll']
+		library = os.path.join(RUNTIME, 'libflatbrt.so')
+		if os.path.exists(library):
+			command[1:1] = ['-load=' + library]
+		measure(command, input if os.path.exists(input) else None, cwd, timeout)
+		try:
+			with open(os.path.join(cwd, source + '.counts')) as f:
+				lines = f.read().splitlines()[1:]
+		except OSError:
+			return None
+	blocks = (line.split(' ', 1) for line in lines)
+	return sum(int(count) for count, block in blocks if re.search(r':loop_body\d*$', block))
+
+
+def expected_failures(name):
+	path = os.path.join(EXPECTED, name + '.xfail')
+	if not os.path.exists(path):
+		return set()
+	with open(path) as f:
+		return set(line.split('#')[0].strip() for line in f) - {''}
+
+
+def verdict(name, engine, result, update):
+	golden = os.path.join(EXPECTED, name + '.out')
+	report = os.path.join(EXPECTED, name + '.report')
+	if update:
+		with open(golden, 'w') as f:
+			f.write(result.transcript())
+		if os.path.exists(report):
+			with open(report, 'w') as f:
+				f.write(result.errors)
+		return 'updated'
+	if not os.path.exists(golden):
+		return 'no golden'
+	with open(golden) as f:
+		matches = f.read() == result.transcript()
+	if os.path.exists(report):
+		with open(report) as f:
+			matches = matches and f.read() == result.errors
+	if engine in expected_failures(name):
+		return 'XPASS' if matches else 'xfail'
+	return 'ok' if matches else 'FAIL'
+
+
+MISSES = ('branch-misses', 'L1d-misses', 'LLC-misses', 'dTLB-misses')
+
+
+def counter_columns(result, iterations):
+	counts = result.counts
+	ipc = '%.2f' % (counts['instructions'] / counts['cycles']) if counts.get('cycles') and 'instructions' in counts else '-'
+	columns = [ipc, '%d' % iterations if iterations is not None else '-']
+	for event in MISSES:
+		columns.append('%.3f' % (counts[event] / iterations) if event in counts and iterations else '-')
+	return columns
+
+
+def table(rows, iterations=None):
+	header = ('Program', 'Engine', 'Result', 'Wall (s)', 'User (s)', 'Peak RSS (KB)')
+	if iterations is not None:
+		header += ('IPC', 'Iterations') + tuple(event[:-7] + ' misses/iter' for event in MISSES)
+	lines = ['| ' + ' | '.join(header) + ' |', '|' + '|'.join('---' for _ in header) + '|']
+	for name, engine, status, result in rows:
+		columns = ['%s' % name, engine, status, '%.3f' % result.wall, '%.3f' % result.user, '%d' % result.rss]
+		if iterations is not None:
+			columns += counter_columns(result, iterations.get(name))
+		lines.append('| ' + ' | '.join(columns) + ' |')
+	return '\n'.join(lines) + '\n'
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Run the test programs under every engine.')
+	parser.add_argument('names', nargs='*', help='programs to run, without .b (default: all)')
+	parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help='programs run at once')
+	parser.add_argument('--engines', default=','.join(ENGINES), help='comma separated engines')
+	parser.add_argument('--timeout', type=float, default=120, help='seconds allowed for each step')
+	parser.add_argument('--update', action='store_true', help='write the interpreter output as the golden files')
+	parser.add_argument('--counters', action='store_true', help='read the hardware performance counters of each run')
+	parser.add_argument('--report', help='also write the table to this file')
+	args = parser.parse_args()
+
+	names = args.names or sorted(f[:-2] for f in os.listdir(TESTS) if f.endswith('.b'))
+	engines = args.engines.split(',')
+	if args.update:
+		engines = ['interp']
+
+	for engine in list(engines):
+		if engine not in ENGINES:
+			parser.error('unknown engine ' + engine)
+		if not ENGINES[engine][1]():
+			print('skipping %s: not available' % engine, file=sys.stderr)
+			engines.remove(engine)
+
+	global counting
+	counting = args.counters and not args.update
+	with concurrent.futures.ThreadPoolExecutor(max_workers=max(args.jobs, 1)) as pool:
+		jobs = [(name, engine, pool.submit(run, name, engine, args.timeout)) for name in names for engine in engines]
+		rows = [(name, engine, verdict(name, engine, job.result(), args.update), job.result()) for name, engine, job in jobs]
+
+	iterations = None
+	if counting:
+		if shutil.which('lli'):
+			with concurrent.futures.ThreadPoolExecutor(max_workers=max(args.jobs, 1)) as pool:
+				counted = {name: pool.submit(loop_iterations, name, args.timeout) for name in names}
+				iterations = {name: job.result() for name, job in counted.items()}
+		else:
+			print('no loop iterations: lli is not available', file=sys.stderr)
+			iterations = {}
+		for reason in sorted(set(unavailable.values())):
+			events = [event for event in EVENTS if unavailable.get(event) == reason]
+			print('counters unavailable (%s): %s' % (reason, ', '.join(events)), file=sys.stderr)
+
+	report = table(rows, iterations)
+	sys.stdout.write(report)
+	if args.report:
+		with open(args.report, 'w') as f:
+			f.write(report)
+
+	failures = sum(1 for row in rows if row[2] in ('FAIL', 'XPASS', 'no golden'))
+	print('\n%d runs, %d failed' % (len(rows), failures))
+	return 1 if failures else 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
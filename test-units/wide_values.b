@@ -0,0 +1,42 @@
+declblock{
+	int a, b, c, n[3];
+	bool f;
+}
+
+codeblock{
+	a = 2147483647;
+	b = a + a;
+	c = b / 2;
+	println "b = ", b;
+	println "c = ", c;
+	a = 65536;
+	b = a * a * a;
+	println "b = ", b;
+	n[1] = -b;
+	println "n[1] = ", n[1];
+	c = -n[1];
+	println "-n[1] = ", c;
+	f = 1;
+	c = -f;
+	println "-f = ", c;
+	println "100% of b is ", b;
+	a = 5000000000;
+	b = a * 2;
+	println "a = ", a;
+	println "2a = ", b;
+	c = -9223372036854775807;
+	println "c = ", c;
+	a = c - 1;
+	n[2] = -1;
+	b = a / n[2];
+	println "a / -1 = ", b;
+	b = -a;
+	println "-a = ", b;
+	b = a + a;
+	println "a + a = ", b;
+	b = c * 3;
+	println "3c = ", b;
+	b = -1;
+	c = a / b;
+	println "a / b = ", c;
+}